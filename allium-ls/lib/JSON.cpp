@@ -1,3 +1,5 @@
+#include <cstring>
+
 #include "JSON.h"
 
 Optional<JSON> JSONObject::getAtKey(std::string key) {
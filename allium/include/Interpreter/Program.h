@@ -538,6 +538,7 @@ public:
     friend bool operator==(const Program &, const Program &);
     friend bool operator!=(const Program &, const Program &);
     friend std::ostream& operator<<(std::ostream &out, const Program &prog);
+    friend void writeProgramImage(const Program &, uint64_t, std::ostream &);
 
     bool prove(const Expression&);
 
@@ -0,0 +1,67 @@
+#ifndef INTERPRETER_PROGRAM_IMAGE_H
+#define INTERPRETER_PROGRAM_IMAGE_H
+
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Interpreter/Program.h"
+
+// A program image is a compact binary serialization of a lowered program.
+// Interpreting a program from its image skips lexing, parsing, semantic
+// analysis and lowering, which otherwise dominate the run time of short
+// programs.
+//
+// Images are a cache rather than a distribution format: integers are stored
+// in the byte order of the machine which wrote them, and an image is only
+// valid for the exact sources and version of Allium which produced it.
+
+namespace interpreter {
+
+/// Computes the key which identifies the images of a program whose source
+/// files have the given contents, in order. The key also depends on the
+/// version of Allium, so images are never shared between versions.
+uint64_t hashSources(const std::vector<std::string> &sources);
+
+/// Writes an image of `program` to `out`. `sourceHash` should be the result
+/// of `hashSources` for the sources of the program.
+void writeProgramImage(
+    const Program &program,
+    uint64_t sourceHash,
+    std::ostream &out);
+
+/// Rebuilds a program from an image written by `writeProgramImage`.
+///
+/// Returns null if the image is malformed, or if it was not written for the
+/// sources identified by `sourceHash` by this version of Allium. An image is
+/// malformed if its payload doesn't match the checksum in its header, or if
+/// any index of a predicate, constructor, effect or variable in it is out of
+/// range.
+std::unique_ptr<Program> readProgramImage(
+    std::string_view image,
+    uint64_t sourceHash,
+    Config config = Config());
+
+/// Loads the image for the sources identified by `sourceHash` from
+/// `cacheDirectory` by mapping it into memory. Returns null if there is no
+/// usable image.
+std::unique_ptr<Program> loadCachedProgram(
+    const std::string &cacheDirectory,
+    uint64_t sourceHash,
+    Config config = Config());
+
+/// Stores an image of `program` in `cacheDirectory` for later runs of the same
+/// sources. The image is written to a temporary file and then renamed, so
+/// concurrent runs never observe a partially written image. Since the cache
+/// is only an optimization, failures are silently ignored.
+void storeCachedProgram(
+    const std::string &cacheDirectory,
+    uint64_t sourceHash,
+    const Program &program);
+
+} // namespace interpreter
+
+#endif // INTERPRETER_PROGRAM_IMAGE_H
@@ -1,11 +1,16 @@
 #ifndef LLVMCODEGEN_CG_CONTEXT_H
 #define LLVMCODEGEN_CG_CONTEXT_H
 
+#include <memory>
+#include <set>
+#include <unordered_map>
+
 #include <llvm/IR/IRBuilder.h>
 #include <llvm/IR/LLVMContext.h>
 #include <llvm/IR/Module.h>
 #include <llvm/Target/TargetMachine.h>
 
+#include "LLVMCodeGen/CGDebugInfo.h"
 #include "SemAna/TypedAST.h"
 
 using namespace llvm;
@@ -19,8 +24,16 @@ struct AlliumType {
 
     /// The payload types for each of the Allium type's constructors.
     std::vector<Type *> payloadTypes;
+
+    /// Whether values of the type are a single tagged word rather than a tag
+    /// followed by a payload. See "Compact Layout" in docs/ABI.md.
+    bool isTaggedWord = false;
 };
 
+/// The counts recorded by a program built with -fprofile-generate, keyed by
+/// the names of their counters. See ProfileInstrumentor.
+typedef std::unordered_map<std::string, uint64_t> Profile;
+
 class CGContext {
 public:
     const TypedAST::AST &ast;
@@ -28,16 +41,60 @@ public:
     LLVMContext ctx;
     Module mod;
 
+    /// The index of the partition of the program which is lowered into this
+    /// context, and the number of partitions. Each partition is lowered into a
+    /// separate module, and they are linked together.
+    size_t partition = 0;
+    size_t partitionCount = 1;
+
     bool instrumentWithLogs = false;
 
+    /// Whether the program is lowered into a shared library with a C API,
+    /// rather than a program with an entry point. See LibraryAPI.h.
+    bool sharedLibrary = false;
+
+    /// Describes the program's source in DWARF, or null if the program isn't
+    /// compiled with debug info.
+    std::unique_ptr<DebugInfoGenerator> debugInfo;
+
+    /// The text of each trace site in this partition of a program instrumented
+    /// with logs. See LogInstrumentor.
+    std::vector<std::string> traceSites;
+
+    /// Whether to lower types with the compact layout described in
+    /// docs/ABI.md.
+    bool compactLayout = false;
+
+    /// The file to which the program writes its profile when it exits, or
+    /// empty if the program isn't instrumented with counters.
+    std::string profileOutput;
+
+    /// The names and globals of the counters in this partition of an
+    /// instrumented program.
+    std::vector<std::pair<std::string, GlobalVariable*>> profileCounters;
+
+    /// The profile used to optimize the program, which is empty unless the
+    /// program is compiled with -fprofile-use.
+    Profile profile;
+
+    /// The file to which the program writes the counts of -fcount as JSON, or
+    /// empty if the program isn't compiled with -fcount. See
+    /// CountInstrumentor.
+    std::string countOutput;
+
+    /// The predicates which are lowered into functions that return whether
+    /// they succeeded, rather than into coroutines. See DeterminismAnalysis.h.
+    std::set<Name<TypedAST::Predicate>> semideterministicPredicates;
+
     /// Relates a type's name with detailed information about it. This is built
     /// during type lowering, and is fully populated before any predicate
     /// lowering.
-    std::map<Name<TypedAST::Type>, AlliumType> loweredTypes;
+    std::unordered_map<Name<TypedAST::Type>, AlliumType> loweredTypes;
 
     CGContext(const TypedAST::AST &ast, TargetMachine *tm):
             ast(ast), ctx(), mod("allium", ctx), builder(ctx) {
         mod.setDataLayout(tm->createDataLayout());
+        mod.setTargetTriple(tm->getTargetTriple().str());
     }
 };
 
@@ -0,0 +1,72 @@
+#ifndef LLVMCODEGEN_CG_DEBUG_INFO_H
+#define LLVMCODEGEN_CG_DEBUG_INFO_H
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <llvm/IR/DIBuilder.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Module.h>
+
+#include "SemAna/TypedAST.h"
+
+using namespace llvm;
+
+/// Describes a program compiled with -g in DWARF, so that debuggers and
+/// profilers can attribute machine code to Allium source. Every function which
+/// is generated for a predicate has a subprogram, and code is located at the
+/// implication or subgoal which it was lowered from.
+///
+/// Variables and the types of arguments are not described.
+class DebugInfoGenerator {
+private:
+    DIBuilder diBuilder;
+    DICompileUnit *compileUnit;
+
+    /// The files of the program's modules, keyed by the names of the
+    /// predicates which they define.
+    std::unordered_map<std::string, DIFile*> predicateFiles;
+
+    /// Creates a subprogram for `func`, which is defined at `location` in
+    /// `file`, and locates the code which follows at the same place.
+    void beginFunction(
+        IRBuilderBase &builder,
+        Function *func,
+        DIFile *file,
+        SourceLocation location,
+        bool isArtificial);
+
+public:
+    /// `sourceFiles` are the paths of the program's modules, and
+    /// `predicateModules` gives the index of the module which defines each
+    /// predicate.
+    DebugInfoGenerator(
+        Module &mod,
+        const std::vector<std::string> &sourceFiles,
+        const std::unordered_map<std::string, size_t> &predicateModules);
+
+    /// Begins the coroutine into which a predicate is lowered.
+    void beginPredicate(
+        IRBuilderBase &builder,
+        Function *func,
+        const TypedAST::PredicateDecl &pDecl);
+
+    /// Begins a function which is part of the lowering of the function which
+    /// `builder` is currently in, such as a continuation or a handler.
+    void beginNestedFunction(
+        IRBuilderBase &builder,
+        Function *func,
+        SourceLocation location);
+
+    /// Begins a function which the compiler synthesizes, such as main.
+    void beginSyntheticFunction(IRBuilderBase &builder, Function *func);
+
+    /// Locates the code which follows in the current function at `location`.
+    void setLocation(IRBuilderBase &builder, SourceLocation location);
+
+    /// Finishes the debug info. This must come after all other lowering.
+    void finalize();
+};
+
+#endif // LLVMCODEGEN_CG_DEBUG_INFO_H
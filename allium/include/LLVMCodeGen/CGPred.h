@@ -1,7 +1,11 @@
 #ifndef LLVMCODEGEN_CG_PRED_H
 #define LLVMCODEGEN_CG_PRED_H
 
+#include <functional>
+#include <unordered_map>
+
 #include "LLVMCodeGen/CGContext.h"
+#include "SemAna/InhabitableAnalysis.h"
 #include "SemAna/TypedAST.h"
 
 struct PredCoroutine {
@@ -14,6 +18,10 @@ struct PredCoroutine {
     // The handle to the coroutine (see: @llvm.coro.begin)
     Instruction *handle = nullptr;
 
+    // The block which follows the allocation of the coroutine frame. Code
+    // which sets up the coroutine, such as allocas, goes here.
+    BasicBlock *entry = nullptr;
+
     // The block containing the last suspend point, which indicates that a
     // predicate has no more witnesses.
     BasicBlock *finalSuspend = nullptr;
@@ -24,10 +32,19 @@ struct PredCoroutine {
     // The block containing the code to cleanup the coroutine. This can be used
     // to clean up a predicate coroutine before all witnesses are exhausted.
     BasicBlock *cleanup = nullptr;
+
+    // The block which frees the coroutine frame, following the cleanup.
+    BasicBlock *freeFrame = nullptr;
+
+    // Allocas holding the handles of the coroutines called by this one, which
+    // are null once the callee has been destroyed.
+    std::vector<Value*> handleSlots;
 };
 
 using Scope = std::map<Name<TypedAST::Variable>, Value*>;
 
+class ProfileInstrumentor;
+
 class PredicateGenerator {
 private:
     CGContext &cg;
@@ -36,10 +53,28 @@ private:
     LLVMContext &ctx;
     Module &mod;
 
+    /// The types which have at least one value. Unifying a variable of any
+    /// other type always fails.
+    std::set<Name<TypedAST::Type>> inhabitableTypes;
+
+    /// The stack of handlers in scope for the code which is being lowered. This
+    /// is the `__allium_handler*` which is passed to every coroutine.
+    Value *handlers = nullptr;
+
+    /// While lowering a handler, the continuation of the effect being handled.
+    Value *continuation = nullptr;
+
+    /// The coroutine which is being lowered, if any.
+    PredCoroutine *currentCoroutine = nullptr;
+
     /// Creates the coroutine into which `pred` will be lowered, and sets up the
     /// entry block for an Allium predicate coroutine.
     PredCoroutine createPredicateCoroutine(const TypedAST::PredicateDecl &pDecl);
 
+    /// Sets up the entry block and exit points of a coroutine with the given
+    /// function, which must not have a body.
+    PredCoroutine createCoroutine(Function *func);
+
     /// Adds code to set up the coroutine by allocating the frame and creating a
     /// coroutine handle. This should only be called by createPredicateCoroutine.
     void addCoroutineInitialization(PredCoroutine &coro);
@@ -56,55 +91,320 @@ private:
     /// frame. This should only be called by createPredicateCoroutine.
     void addCleanup(PredCoroutine &coro);
 
+    /// Terminates the entry and cleanup blocks of a coroutine once all of its
+    /// alternatives have been lowered. The first alternative is `first`.
+    void finishCoroutine(PredCoroutine &coro, BasicBlock *first);
+
+    /// Lowers one alternative way of finding witnesses in a coroutine, such as
+    /// an implication, using `lowerBody` to lower everything before its
+    /// witness suspend point. `lowerBody` is given the block to continue with
+    /// if the proof fails, and returns the block which backtracks into the
+    /// alternative. Once the alternative is exhausted, the coroutine
+    /// continues with `next`, after undoing the bindings made by the
+    /// alternative. Returns the first block of the alternative.
+    BasicBlock *lowerAlternative(
+        PredCoroutine &coro,
+        BasicBlock *next,
+        const std::function<BasicBlock*(BasicBlock*)> &lowerBody);
+
+    /// Destroys the coroutines whose handles are held in the coroutine's
+    /// handle slots, starting from `firstSlot`.
+    void destroyHandles(PredCoroutine &coro, size_t firstSlot);
+
+    /// Adds a suspend point which yields a witness. When the coroutine is
+    /// resumed, it continues searching for witnesses from `next`.
+    void addWitnessSuspend(PredCoroutine &coro, BasicBlock *next);
+
+    /// Calls a coroutine and continues with the fail block if it has no
+    /// witnesses. The callee is destroyed when the proof backtracks past the
+    /// call, or when the calling coroutine is destroyed.
+    ///
+    /// Returns a block which resumes the callee to search for its next
+    /// witness, which is where the proof continues if a later goal fails.
+    BasicBlock *callCoroutine(
+        FunctionType *type,
+        Value *callee,
+        ArrayRef<Value*> arguments,
+        BasicBlock *fail);
+
+    /// Allocates and initializes the given variables as unbound.
+    Scope allocateVariables(const TypedAST::Scope &variables);
+
+    /// Returns whether the first argument in the head of `impl` could unify
+    /// with a value built by the given constructor of its type.
+    bool mayMatchFirstArgument(
+        const TypedAST::Implication &impl,
+        const TypedAST::Type &type,
+        size_t ctorIndex);
+
+    /// Builds a block which jumps to the first of the implications from
+    /// `position` onward whose first argument could match the constructor of
+    /// the predicate's first argument. `tag` is the first argument's tag when
+    /// the predicate was called, and `starts` holds the block which tries each
+    /// implication, followed by the block which is reached when there are no
+    /// more implications.
+    ///
+    /// If every constructor would jump to the same implication, no block is
+    /// built and that implication's block is returned.
+    BasicBlock *lowerFirstArgumentIndex(
+        const TypedAST::UserPredicate &pred,
+        Value *tag,
+        const std::vector<BasicBlock*> &starts,
+        size_t position);
+
+    /// Loads the tag of the first argument of `func`, which is used to skip
+    /// the implications of `pred` which can't match it. Returns null if no
+    /// implication has a constructor as its first argument.
+    Value *loadFirstTag(const TypedAST::UserPredicate &pred, Function *func);
+
+    /// Allocates the variables of the `i`th implication of `pred`, which is
+    /// being lowered into `func`, and unifies its head with the arguments. If
+    /// unification fails, execution continues with the fail block. Returns
+    /// the implication's variables.
+    Scope lowerImplicationHead(
+        const TypedAST::UserPredicate &pred,
+        size_t i,
+        Function *func,
+        ProfileInstrumentor &profiler,
+        BasicBlock *fail);
+
+    /// Lowers a semideterministic predicate into a function which returns
+    /// whether it has a witness. See DeterminismAnalysis.h.
+    Function *lowerSemideterministic(const TypedAST::UserPredicate &pred);
+
+    /// Lowers the body of an implication of a semideterministic predicate,
+    /// which continues with `success` once it is proven, or with `fail` if it
+    /// can't be. If its last goal can be a tail call, the function instead
+    /// returns that goal's result, unless the program is compiled with
+    /// -fcount. `mark` is the trail mark taken when the
+    /// function was called.
+    void lowerSemideterministicBody(
+        const Scope &scope,
+        const TypedAST::Implication &impl,
+        Value *mark,
+        BasicBlock *success,
+        BasicBlock *fail);
+
+    /// Returns whether `pr`, the last goal of `impl`, can be a guaranteed
+    /// tail call from a semideterministic predicate.
+    bool isTailCall(
+        const TypedAST::Implication &impl,
+        const TypedAST::PredicateRef &pr);
+
+    /// Lowers `pr` into a guaranteed tail call, which returns whether it was
+    /// proven. The bindings made since `mark` are undone first.
+    void lowerTailCall(
+        const Scope &scope,
+        const TypedAST::PredicateRef &pr,
+        Value *mark);
+
+    /// Returns the function into which a predicate is lowered, declaring it
+    /// if necessary.
+    Function *getPredFunc(const TypedAST::PredicateDecl &pDecl);
+
+    /// Unifies the arguments of `func` with the values in the head of one of
+    /// its implications. If unification fails, execution continues with the
+    /// fail block. If given, `branchWeights` are the weights of each argument
+    /// unifying or not.
+    void unifyHead(
+        const Scope &scope,
+        Function *func,
+        const std::vector<TypedAST::Parameter> &parameters,
+        const std::vector<TypedAST::Value> &head,
+        BasicBlock *fail,
+        MDNode *branchWeights = nullptr);
+
+    /// Unifies `value`, which has the given type, with a value in the head of
+    /// an implication. Constructors and integers are matched inline, and are
+    /// only built if `value` refers to an unbound variable. `boundVariables`
+    /// holds the variables which have already occurred in the head. If
+    /// unification fails, execution continues with the fail block.
+    void unify(
+        const Scope &scope,
+        const AlliumType &type,
+        const TypedAST::Value &pattern,
+        Value *value,
+        std::set<Name<TypedAST::Variable>> &boundVariables,
+        BasicBlock *fail,
+        MDNode *branchWeights = nullptr);
+
+    /// Returns the identifier of an effect type at runtime. Builtin effects
+    /// are numbered first, followed by the effects defined by the program.
+    unsigned getEffectID(const Name<TypedAST::Effect> &effect);
+
+    /// Returns the type of the nodes of the handler stack.
+    StructType *getHandlerIRType();
+
+    /// Returns the type of a continuation, which is a closure over the
+    /// variables of the implication where an effect occurred.
+    StructType *getContinuationIRType();
+
+    /// Returns the type of the coroutine into which a continuation is lowered.
+    FunctionType *getContinuationFuncType();
+
+    /// Returns the type of the coroutine which implements an effect
+    /// constructor in a handler.
+    FunctionType *getHandlerFuncType(const TypedAST::EffectCtor &eCtor);
+
+    /// Adds a handler to the top of the current handler stack. `ctors` is an
+    /// array of the handler's coroutines, one for each effect constructor.
+    void pushHandler(const Name<TypedAST::Effect> &effect, Constant *ctors);
+
+    /// Lowers each effect constructor of a user-defined handler into a
+    /// coroutine, and returns an array of the coroutines.
+    Constant *lower(
+        const TypedAST::UserPredicate &pred,
+        const TypedAST::Handler &handler);
+
+    /// Lowers the builtin handler of the IO effect, which is performed by the
+    /// runtime library.
+    Constant *lowerBuiltinIOHandler();
+
+    /// Lowers a continuation into a coroutine which proves it.
+    Function *lowerContinuation(
+        const Scope &scope,
+        const TypedAST::Expression &expr);
+
     /// Lowers a truth literal into a no-op or branch instruction the current
     /// builder. If the proof fails, execution continues with the fail block.
-    void lower(
+    BasicBlock *lower(
         const Scope &scope,
         const TypedAST::TruthLiteral &tl,
         BasicBlock *fail);
 
     /// Lowers a predicate reference into a coroutine invocation in the current
-    /// builder. If the proof fails, execution continues with the fail block.
-    void lower(
+    /// builder, or a call if the predicate is semideterministic. If the proof
+    /// fails, execution continues with the fail block.
+    BasicBlock *lower(
         const Scope &scope,
         const TypedAST::PredicateRef &pr,
         BasicBlock *fail);
 
+    /// Lowers an effect into a call to the innermost handler of the effect. The
+    /// continuation of the effect is lowered into a separate coroutine, which
+    /// the handler may prove any number of times. If the proof fails, execution
+    /// continues with the fail block.
+    BasicBlock *lower(
+        const Scope &scope,
+        const TypedAST::EffectCtorRef &ecr,
+        BasicBlock *fail);
+
+    /// Lowers the `continue` keyword into an invocation of the continuation of
+    /// the effect being handled. If the proof fails, execution continues with
+    /// the fail block.
+    BasicBlock *lower(
+        const Scope &scope,
+        const TypedAST::Continuation &k,
+        BasicBlock *fail);
+
     /// Recursively lowers a conjunction in the current builder. If the proof
     /// fails, execution continues with the fail block.
-    void lower(
+    BasicBlock *lower(
         const Scope &scope,
         const TypedAST::Conjunction &conj,
         BasicBlock *fail);
 
+    /// Recursively lowers a conjunction inside of a handler in the current
+    /// builder. If the proof fails, execution continues with the fail block.
+    BasicBlock *lower(
+        const Scope &scope,
+        const TypedAST::HandlerConjunction &hConj,
+        BasicBlock *fail);
+
     /// Recursively lowers a logical expression in the current builder. If the
     /// proof fails, execution continues with the fail block.
-    void lower(
+    BasicBlock *lower(
         const Scope &scope,
         const TypedAST::Expression &expr,
         BasicBlock *fail);
 
+    /// Recursively lowers a logical expression inside of a handler in the
+    /// current builder. If the proof fails, execution continues with the fail
+    /// block.
+    ///
+    /// Like the other overloads which lower expressions, this returns the
+    /// block which backtracks into the expression to search for its next
+    /// witness. For an expression with no more witnesses, this is `fail`.
+    BasicBlock *lower(
+        const Scope &scope,
+        const TypedAST::HandlerExpression &hExpr,
+        BasicBlock *fail);
+
     /// Recursively lowers an Allium value into stack-allocated memory. This
     /// consists of an alloca followed by one or more stores to initialize the
-    /// value.
+    /// value. A variable is not copied; the variable itself is returned.
     Value *lower(const Scope &scope, AlliumType type, const TypedAST::Value &v);
 
+    /// Recursively stores an Allium value into the memory at `dest`, which
+    /// is used for the arguments of constructors. A variable is stored as a
+    /// pointer to the variable.
+    void lowerInto(
+        const Scope &scope,
+        const AlliumType &type,
+        const TypedAST::Value &v,
+        Value *dest);
+
+    /// Returns a pointer to a NUL-terminated constant with the given text.
+    /// Each distinct string is only emitted once.
+    Constant *getStringConstant(const std::string &text);
+
+    /// Lowers a call to a builtin predicate, which is implemented by a
+    /// function in the runtime library that returns whether it has a witness.
+    /// Builtin predicates have at most one witness.
+    BasicBlock *lowerBuiltinCall(
+        const Scope &scope,
+        const TypedAST::BuiltinPredicate &bp,
+        const TypedAST::PredicateRef &pr,
+        BasicBlock *fail);
+
+    /// The string constants which have been emitted, by their text.
+    std::unordered_map<std::string, Constant*> stringConstants;
+
+    /// In a shared library, the stack of handlers with which queries are
+    /// proven, and the function which destroys the coroutine of a query. They
+    /// are created along with the first query.
+    GlobalVariable *queryHandlers = nullptr;
+    Function *destroyCoroutine = nullptr;
+
+    /// Initializes the runtime library, and registers the instrumentation of
+    /// every partition of the program.
+    void initializeRuntime();
+
 public:
     PredicateGenerator(CGContext &cg):
-        cg(cg), ast(cg.ast), builder(cg.builder), ctx(cg.ctx), mod(cg.mod) {}
+        cg(cg), ast(cg.ast), builder(cg.builder), ctx(cg.ctx), mod(cg.mod),
+        inhabitableTypes(getInhabitableTypes(ast.getTypes())) {}
 
-    /// Lowers an Allium predicate into an LLVM coroutine.
+    /// Lowers an Allium predicate into an LLVM coroutine, or into an ordinary
+    /// function if it is semideterministic.
     Function *lower(const TypedAST::UserPredicate &pred);
 
     /// Creates a main function which calls the Allium main predicate.
     Function *createMain();
 
+    /// Creates a function which initializes a shared library when it is
+    /// loaded, in place of main.
+    Function *createLibraryInit();
+
+    /// Creates the function of the C API which creates a query of `pred`,
+    /// along with the function which proves it. See LibraryAPI.h.
+    Function *createQuery(const TypedAST::UserPredicate &pred);
+
+    /// Creates a function which registers the partition's trace sites and
+    /// counters with the runtime library, which main calls for every
+    /// partition. This must come after all other instrumentation in the
+    /// partition.
+    Function *createRegistration();
+
     /// Returns the LLVM type corresponding to the given AST type.
     StructType *getTypeIRType(const Name<TypedAST::Type> &type);
 
-    /// Returns the type of the LLVM coroutine that the given predicate will be
-    /// lowered into.
+    /// Returns the type of the LLVM coroutine or function that the given
+    /// predicate will be lowered into.
     FunctionType *getPredIRType(const TypedAST::PredicateDecl &pd);
 };
 
+/// The name of the function which registers a partition's instrumentation.
+std::string registrationFuncName(size_t partition);
+
 #endif // LLVMCODEGEN_CG_PRED_H
@@ -9,6 +9,7 @@
 #include <map>
 
 #include "LLVMCodeGen/CGContext.h"
+#include "SemAna/InhabitableAnalysis.h"
 #include "SemAna/TypedAST.h"
 #include "SemAna/TypeRecursionAnalysis.h"
 
@@ -16,6 +17,26 @@ using namespace llvm;
 
 std::string unifyFuncName(Name<TypedAST::Type> name);
 
+/// Stores the tag of `value`, which has the given type. The tag is 0 for an
+/// unbound variable, or 2 + i for the type's i-th constructor.
+void storeTag(IRBuilderBase &builder, const AlliumType &type, Value *value, unsigned tag);
+
+/// Returns the representation of a tag in values of the given type, which is
+/// what `loadTag` returns for a value with that tag.
+ConstantInt *getTagConstant(const AlliumType &type, unsigned tag);
+
+/// Returns the value which `value` refers to, following variables.
+Value *loadValue(IRBuilderBase &builder, Module &mod, const AlliumType &type, Value *value);
+
+/// Loads the tag of the value which `value` refers to, following variables.
+/// The result is the representation of either an unbound variable's tag or a
+/// constructor's tag; see `getTagConstant`.
+Value *loadTag(IRBuilderBase &builder, Module &mod, const AlliumType &type, Value *value);
+
+/// Makes `value` a variable which refers to `target`, another value of the
+/// same type.
+void storePointer(IRBuilderBase &builder, const AlliumType &type, Value *value, Value *target);
+
 class TypeGenerator {
     CGContext &cgctx;
     const TypedAST::AST &ast;
@@ -25,10 +46,36 @@ class TypeGenerator {
 
     TypedAST::TypeRecursionAnalysis typeRecursionAnalysis;
 
+    /// The types which have at least one value.
+    std::set<Name<TypedAST::Type>> inhabitableTypes;
+
+    /// Sets the body of a lowered type, given the size and alignment of its
+    /// largest payload.
+    void setBody(StructType *irType, TypeSize payloadSize, Align payloadAlignment);
+
+    /// Lowers one of the builtin types, whose unification is implemented by
+    /// the runtime library.
+    AlliumType lowerBuiltinType(const TypedAST::Type &type);
+
+    /// Creates the function, without a body, which unifies values of a type
+    /// defined by the program. The function may already have been declared
+    /// by the unify function of a type which refers to this one.
+    Function *createUnifyFunc(const TypedAST::Type &type, const AlliumType &loweredType);
+
+    /// Constructs a function to unify values of a type which is lowered to a
+    /// tagged word.
+    Function *buildTaggedWordUnifyFunc(const TypedAST::Type &type, const AlliumType &loweredType);
+
+    /// Constructs a function to unify values of a type which has no values.
+    /// A variable of such a type can never be bound, so unification always
+    /// fails, as in the interpreter.
+    Function *buildUninhabitedUnifyFunc(const TypedAST::Type &type, const AlliumType &loweredType);
+
 public:
     TypeGenerator(CGContext &cgctx):
         cgctx(cgctx), ast(cgctx.ast), builder(cgctx.builder), ctx(cgctx.ctx),
-        mod(cgctx.mod), typeRecursionAnalysis(ast.types) {}
+        mod(cgctx.mod), typeRecursionAnalysis(ast.getTypes()),
+        inhabitableTypes(getInhabitableTypes(ast.getTypes())) {}
 
     /// Returns the identified struct type representing `type` in the IR.
     AlliumType getIRType(const TypedAST::Type &type);
@@ -36,6 +83,10 @@ public:
     /// Constructs a function to unify values of `type`.
     Function *buildUnifyFunc(const TypedAST::Type &type, const AlliumType &loweredType);
 
+    /// Constructs the functions of the C API which create and inspect values
+    /// of `type`. See LLVMCodeGen/LibraryAPI.h.
+    void buildValueAPI(const TypedAST::Type &type, const AlliumType &loweredType);
+
     void lowerAllTypes();
 };
 
@@ -1,6 +1,10 @@
 #ifndef LLVMCODEGEN_CODE_GEN_H
 #define LLVMCODEGEN_CODE_GEN_H
 
+#include <string>
+#include <unordered_map>
+#include <vector>
+
 #include "SemAna/TypedAST.h"
 
 namespace compiler {
@@ -8,18 +12,76 @@ namespace compiler {
 enum class OutputType {
     EXECUTABLE,
     OBJECT,
+
+    /// A shared library with a C API, rather than an entry point. See
+    /// LLVMCodeGen/LibraryAPI.h.
+    SHARED_LIBRARY,
 };
 
 // A container for configuration parameters of the program.
 struct Config {
     bool printLLVMIR = false;
     bool debug = false;
+    bool compactLayout = false;
+
+    /// The optimization level, from 0 to 3.
+    unsigned optimizationLevel = 1;
+
+    /// The CPU to generate code for, or "native" for the host's CPU.
+    std::string cpu = "generic";
+
+    /// Whether to optimize the program and the runtime library's bitcode
+    /// together as a whole program. For object files, this emits bitcode
+    /// instead of machine code.
+    bool linkTimeOptimization = false;
+
+    /// The number of threads which compile the program, or 0 for one for each
+    /// core. The program is split into at most this many partitions, which
+    /// are lowered, optimized and emitted concurrently.
+    unsigned threads = 0;
+
+    /// Whether to compile the program in memory and run it immediately,
+    /// rather than writing an output file.
+    bool jit = false;
+
+    /// If not empty, the program counts how often each predicate and
+    /// implication is used, and writes the counts to this file when it exits.
+    std::string profileGenerate;
+
+    /// If not empty, a profile written by a program built with
+    /// `profileGenerate`, which guides optimization.
+    std::string profileUse;
+
+    /// If not empty, the program counts the calls, head unifications,
+    /// witnesses and backtracks of each predicate and implication, and writes
+    /// the counts to this file as JSON when it exits or receives SIGUSR1.
+    std::string countOutput;
+
+    /// If not empty, the object file of each partition of the program is
+    /// cached in this directory, and reused by later compilations if the
+    /// partition is unchanged. See ObjectCache.h.
+    std::string objectCacheDirectory;
+
+    /// The paths of the program's modules, and the index of the module which
+    /// defines each predicate, keyed by the predicate's name. These locate
+    /// predicates in the debug info of programs compiled with `debug`.
+    std::vector<std::string> sourceFiles;
+    std::unordered_map<std::string, size_t> predicateModules;
+
     OutputType outputType = OutputType::EXECUTABLE;
     std::string outputFile;
+
+    /// For a shared library, the path of the header which declares its C API.
+    std::string headerFile;
 };
 
 } // namespace compiler
 
-void cgProgram(const TypedAST::AST &ast, compiler::Config config);
+/// Compiles the program into the output file. Returns whether it was written.
+bool cgProgram(const TypedAST::AST &ast, compiler::Config config);
+
+/// Compiles the program in memory and runs it in this process. Returns the
+/// exit code of the program.
+int jitProgram(const TypedAST::AST &ast, compiler::Config config);
 
 #endif // LLVMCODEGEN_CODE_GEN_H
@@ -0,0 +1,47 @@
+#ifndef LLVMCODEGEN_COUNT_INSTRUMENTOR_H
+#define LLVMCODEGEN_COUNT_INSTRUMENTOR_H
+
+#include "LLVMCodeGen/CGContext.h"
+
+/// Counts calls of predicates, and the attempts, head unifications, witnesses
+/// and backtracks of their implications, for programs built with -fcount. The
+/// counters are incremented with relaxed atomic operations, and the runtime
+/// library writes them as JSON when the program exits or receives SIGUSR1.
+/// See LibAllium/Counts.h.
+class CountInstrumentor {
+private:
+    CGContext &cg;
+
+    /// Returns the array of counters of a predicate which is lowered in this
+    /// partition, creating it if necessary.
+    GlobalVariable *getCounters(const TypedAST::UserPredicate &pred);
+
+    /// Emits code which increments the counter at `index` in the predicate's
+    /// array.
+    void count(const TypedAST::UserPredicate &pred, size_t index);
+
+    /// Emits code which increments one of an implication's counters.
+    void count(const TypedAST::UserPredicate &pred, size_t impl, unsigned counter);
+
+public:
+    CountInstrumentor(CGContext &cg): cg(cg) {}
+
+    void countCall(const TypedAST::UserPredicate &pred);
+    void countAttempt(const TypedAST::UserPredicate &pred, size_t impl);
+    void countHead(const TypedAST::UserPredicate &pred, size_t impl);
+    void countSolution(const TypedAST::UserPredicate &pred, size_t impl);
+
+    /// Returns a new block which counts a backtrack into the implication and
+    /// then branches to `retry`. The insertion point is left unchanged.
+    BasicBlock *countBacktrack(
+        const TypedAST::UserPredicate &pred,
+        size_t impl,
+        BasicBlock *retry);
+
+    /// Emits code which registers the counters of every predicate in the
+    /// partition with the runtime library. This must come after all other
+    /// instrumentation in the partition.
+    void registerCounters();
+};
+
+#endif // LLVMCODEGEN_COUNT_INSTRUMENTOR_H
@@ -0,0 +1,37 @@
+#ifndef LLVMCODEGEN_LIBRARY_API_H
+#define LLVMCODEGEN_LIBRARY_API_H
+
+#include <string>
+
+#include "SemAna/TypedAST.h"
+
+// The C API of a program compiled into a shared library. The runtime library
+// implements the parts which don't depend on the program (see
+// LibAllium/Allium.h), and the compiler generates a function for each type,
+// constructor and predicate, which are declared by a generated header.
+
+/// The names of the functions which create an unbound variable of a type,
+/// create a value with one of its constructors, return the index of a value's
+/// constructor, and return an argument of a value's constructor. The names of
+/// types, constructors and predicates are mangled so that the C API's names
+/// never collide with each other or with the runtime library's.
+std::string variableFuncName(const Name<TypedAST::Type> &type);
+std::string ctorFuncName(
+    const Name<TypedAST::Type> &type,
+    const Name<TypedAST::Constructor> &ctor);
+std::string ctorIndexFuncName(const Name<TypedAST::Type> &type);
+std::string argumentFuncName(const Name<TypedAST::Type> &type);
+
+/// The name of the function which creates a query of a predicate.
+std::string queryFuncName(const Name<TypedAST::Predicate> &pred);
+
+/// Returns whether a predicate can be proven through the C API. Every effect
+/// of such a predicate must be handled by the builtin handlers, since a C
+/// caller can't handle effects.
+bool isExported(const TypedAST::UserPredicate &pred);
+
+/// Writes the header which declares the program's part of the C API. Returns
+/// false if the header can't be written.
+bool writeLibraryHeader(const TypedAST::AST &ast, const std::string &path);
+
+#endif // LLVMCODEGEN_LIBRARY_API_H
@@ -3,17 +3,43 @@
 
 #include "LLVMCodeGen/CGContext.h"
 
+/// Instruments a program to report events to the runtime library, which
+/// prints them as a text trace or records them in a binary trace. Each place
+/// which reports an event is a trace site, which has the text that it prints.
+/// See LibAllium/Trace.h.
 class LogInstrumentor {
 private:
     CGContext &cg;
 
+    /// Returns the index of a predicate among the program's predicates, or
+    /// ALLIUM_TRACE_NONE if it is a builtin predicate.
+    uint32_t getPredicateID(const Name<TypedAST::Predicate> &name);
+
+    /// Returns the global holding the number of the partition's first trace
+    /// site among all of the program's trace sites.
+    GlobalVariable *getSiteBase();
+
 public:
     LogInstrumentor(CGContext &cg): cg(cg) {}
 
-    void log(int minimumLogLevel, const std::string &message);
+    /// Reports an event at a new trace site with the given text.
+    void log(
+        uint32_t event,
+        const std::string &message,
+        uint32_t predicate,
+        uint32_t implication);
+
     void logEffect(const TypedAST::EffectCtorRef &ec);
     void logSubproof(const TypedAST::PredicateRef &pr);
-    void logImplication(const TypedAST::Implication &impl);
+    void logImplication(
+        const TypedAST::PredicateDecl &pred,
+        const TypedAST::Implication &impl,
+        size_t index);
+
+    /// Emits code which gives the runtime library the text of every trace
+    /// site in the partition. This must come after all other instrumentation
+    /// in the partition.
+    void registerSites();
 };
 
 #endif // LLVMCODEGEN_LOG_INSTRUMENTOR_H
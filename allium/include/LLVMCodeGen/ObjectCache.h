@@ -0,0 +1,45 @@
+#ifndef LLVMCODEGEN_OBJECT_CACHE_H
+#define LLVMCODEGEN_OBJECT_CACHE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "LLVMCodeGen/CGContext.h"
+#include "LLVMCodeGen/CodeGen.h"
+#include "SemAna/TypedAST.h"
+
+// The object cache holds the object file of each partition of a program which
+// has been compiled, keyed by a hash of everything which determines the
+// partition's object code. Recompiling a program after a small edit only
+// regenerates the partitions which the edit affects.
+//
+// Cached objects are only valid for the build of Allium which produced them,
+// and for the runtime bitcode which was linked into them.
+
+/// Computes the key which identifies the object code of the partition of
+/// `cgctx`'s program made up of the given predicates, compiled with `tm` and
+/// `config`. The key covers the partition's predicates, the signatures of
+/// every predicate in the program, every type and effect, the options which
+/// affect code generation, the compiler's build id and the runtime bitcode.
+uint64_t hashPartition(
+    const CGContext &cgctx,
+    const std::vector<const TypedAST::UserPredicate*> &predicates,
+    const TargetMachine &tm,
+    const compiler::Config &config);
+
+/// Returns the path of the cached object file for the partition identified by
+/// `hash` in `cacheDirectory`, or an empty string if there is none.
+std::string findCachedObject(const std::string &cacheDirectory, uint64_t hash);
+
+/// Stores a copy of the object file at `objFileName` in `cacheDirectory` for
+/// the partition identified by `hash`. The copy is written to a temporary
+/// file and then renamed, so concurrent compilations never observe a
+/// partially written object. Since the cache is only an optimization, failures
+/// are silently ignored.
+void storeCachedObject(
+    const std::string &cacheDirectory,
+    uint64_t hash,
+    const std::string &objFileName);
+
+#endif // LLVMCODEGEN_OBJECT_CACHE_H
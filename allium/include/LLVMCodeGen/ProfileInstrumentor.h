@@ -0,0 +1,55 @@
+#ifndef LLVMCODEGEN_PROFILE_INSTRUMENTOR_H
+#define LLVMCODEGEN_PROFILE_INSTRUMENTOR_H
+
+#include <string>
+#include <unordered_map>
+
+#include "LLVMCodeGen/CGContext.h"
+
+/// Reads a profile written by an instrumented program. Returns false if the
+/// file can't be read or is malformed.
+bool readProfile(const std::string &path, Profile &profile);
+
+/// Counts calls of predicates, attempts of their implications, and successful
+/// unifications of implications' heads. The counts are written to a profile
+/// when the program exits, which a later compilation can use to optimize the
+/// program for the same workload.
+///
+/// Each counter has a name which is derived from the program, so that the
+/// counts can be matched with the same points in a later compilation.
+class ProfileInstrumentor {
+private:
+    CGContext &cg;
+
+    /// Emits code which increments the named counter.
+    void count(const std::string &counter);
+
+public:
+    ProfileInstrumentor(CGContext &cg): cg(cg) {}
+
+    static std::string callCounter(const TypedAST::PredicateDecl &pred);
+    static std::string attemptCounter(const TypedAST::PredicateDecl &pred, size_t impl);
+    static std::string matchCounter(const TypedAST::PredicateDecl &pred, size_t impl);
+
+    void countCall(const TypedAST::PredicateDecl &pred);
+    void countAttempt(const TypedAST::PredicateDecl &pred, size_t impl);
+    void countMatch(const TypedAST::PredicateDecl &pred, size_t impl);
+
+    /// Emits code which registers every counter in the partition with the
+    /// runtime library, which writes them to the profile when the program
+    /// exits. This must come after all other instrumentation in the partition.
+    void registerCounters();
+
+    /// Sets the entry count of a predicate's coroutine from the profile.
+    void annotateCalls(Function *func, const TypedAST::PredicateDecl &pred);
+
+    /// Returns the branch weights of the unification of an implication's head
+    /// from the profile, or null if there are none.
+    MDNode *getMatchWeights(const TypedAST::PredicateDecl &pred, size_t impl);
+
+    /// Adds a summary of the profile to the module, which lets LLVM tell hot
+    /// code from cold code.
+    void addProfileSummary();
+};
+
+#endif // LLVMCODEGEN_PROFILE_INSTRUMENTOR_H
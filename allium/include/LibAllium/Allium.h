@@ -0,0 +1,58 @@
+#ifndef LIBALLIUM_ALLIUM_H
+#define LIBALLIUM_ALLIUM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// The C API of programs compiled into a shared library with `-shared`. The
+// compiler writes a header alongside the library which includes this one, and
+// declares functions to create and inspect values of the program's types and
+// to prove its predicates. See "Shared Libraries" in docs/ABI.md.
+//
+// The runtime library is single threaded, so a program's functions must not
+// be called concurrently.
+
+// A value of any Allium type, with the layout described in docs/ABI.md.
+typedef struct allium_value allium_value;
+
+// A proof of a predicate, which finds the predicate's witnesses one at a time.
+typedef struct allium_query allium_query;
+
+// Creates an Int or a String. The text of a String is copied.
+allium_value *allium_int_new(int64_t value);
+allium_value *allium_string_new(const char *value);
+
+// Creates an unbound variable of type Int or String.
+allium_value *allium_int_variable(void);
+allium_value *allium_string_variable(void);
+
+// Stores the value of an Int in `result`, and returns true. Returns false if
+// the value is an unbound variable.
+bool allium_int_get(const allium_value *value, int64_t *result);
+
+// Returns the text of a String, which belongs to the value, or NULL if the
+// value is an unbound variable.
+const char *allium_string_get(const allium_value *value);
+
+// Frees a value which was created by the API, rather than found inside of
+// another value. Values which refer to it must no longer be used.
+void allium_value_free(allium_value *value);
+
+// Searches for the next witness of the query's predicate, and returns whether
+// there is one. The variables in the query's arguments are bound to the
+// witness until the next search, or until the query is freed.
+bool allium_query_next(allium_query *query);
+
+// Frees the query, undoing its bindings of the variables in its arguments.
+// Queries must be freed in the reverse of the order of their first searches.
+void allium_query_free(allium_query *query);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LIBALLIUM_ALLIUM_H
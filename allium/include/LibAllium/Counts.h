@@ -0,0 +1,40 @@
+#ifndef LIBALLIUM_COUNTS_H
+#define LIBALLIUM_COUNTS_H
+
+#include <stdint.h>
+
+// The counters of programs built with `-fcount`. They are shared by the
+// compiler, which emits code that increments them, and the runtime library,
+// which writes them as JSON when the program exits or receives SIGUSR1.
+//
+// Each predicate has an array of 64-bit counters. The first counts calls of
+// the predicate, and it is followed by ALLIUM_COUNT_SIZE counters for each of
+// the predicate's implications. A predicate's other counts are the sums of
+// its implications' counts, which are added up when they are written.
+
+// The counters of an implication, relative to its first counter.
+enum {
+    // Attempts of the implication.
+    ALLIUM_COUNT_CALLS,
+
+    // Successful unifications of the implication's head with the arguments.
+    ALLIUM_COUNT_HEADS,
+
+    // Witnesses found by the implication.
+    ALLIUM_COUNT_SOLUTIONS,
+
+    // Times that the proof backtracked into the implication to search for
+    // another witness.
+    ALLIUM_COUNT_BACKTRACKS,
+
+    ALLIUM_COUNT_SIZE,
+};
+
+// Describes the counters of a predicate to the runtime library.
+typedef struct allium_count_predicate_t {
+    const char *name;
+    uint64_t implicationCount;
+    uint64_t *counters;
+} allium_count_predicate_t;
+
+#endif // LIBALLIUM_COUNTS_H
@@ -0,0 +1,49 @@
+#ifndef LIBALLIUM_TRACE_H
+#define LIBALLIUM_TRACE_H
+
+#include <stdint.h>
+
+// The binary trace written by compiled programs built with `-g` when the
+// ALLIUM_TRACE_FILE environment variable is set. It is shared by the runtime
+// library, which writes traces, and `allium-trace`, which renders them.
+//
+// A trace begins with a header:
+//   char magic[8];          // ALLIUM_TRACE_MAGIC
+//   uint32_t version;       // ALLIUM_TRACE_VERSION
+//   uint32_t siteCount;
+// followed by the program's trace sites. Each site is the text which the site
+// prints in a text trace, as a uint32_t length followed by that many bytes.
+// The rest of the trace is a sequence of records. Integers are stored in the
+// byte order of the machine which wrote the trace.
+
+#define ALLIUM_TRACE_MAGIC "ALLTRACE"
+#define ALLIUM_TRACE_VERSION 1
+
+// The kinds of events, whose values are also the lowest ALLIUM_LOG_LEVEL at
+// which they are printed in a text trace.
+enum {
+    ALLIUM_TRACE_EFFECT = 1,
+    ALLIUM_TRACE_SUBPROOF = 2,
+    ALLIUM_TRACE_IMPLICATION = 3,
+};
+
+// Identifies a predicate or implication which doesn't apply to an event.
+#define ALLIUM_TRACE_NONE UINT32_MAX
+
+typedef struct allium_trace_record_t {
+    // Nanoseconds since an arbitrary point before the program started.
+    uint64_t timestamp;
+
+    uint32_t event;
+
+    // The index of the event's site in the trace's header.
+    uint32_t site;
+
+    // The index of the predicate being proven, among the program's predicates,
+    // and the index of the implication being tried, among the predicate's
+    // implications. Either may be ALLIUM_TRACE_NONE.
+    uint32_t predicate;
+    uint32_t implication;
+} allium_trace_record_t;
+
+#endif // LIBALLIUM_TRACE_H
@@ -4,6 +4,7 @@
 #include <algorithm>
 #include <assert.h>
 #include <memory>
+#include <unordered_map>
 #include <vector>
 
 #include "Utils/Optional.h"
@@ -105,11 +106,11 @@ std::ostream& operator<<(std::ostream &out, const PredicateDecl &pd);
 struct PredicateRef {
     PredicateRef() {}
 
-    PredicateRef(std::string name, SourceLocation location):
+    PredicateRef(std::string_view name, SourceLocation location):
         name(name), location(location) {}
 
     PredicateRef(
-        std::string name,
+        std::string_view name,
         std::vector<Value> arguments,
         SourceLocation location
     ): name(name), arguments(arguments), location(location) {}
@@ -129,7 +130,7 @@ struct EffectImplHead {
     EffectImplHead() {}
 
     EffectImplHead(
-        std::string name,
+        std::string_view name,
         std::vector<Value> arguments,
         SourceLocation location
     ): name(name), arguments(arguments), location(location) {}
@@ -149,7 +150,7 @@ struct EffectCtorRef {
     EffectCtorRef() {}
 
     EffectCtorRef(
-        std::string name,
+        std::string_view name,
         std::vector<Value> arguments,
         const Expression &continuation,
         SourceLocation location);
@@ -177,8 +178,9 @@ struct Conjunction {
 public:
     Conjunction(Expression left, Expression right);
     Conjunction(const Conjunction &other);
+    Conjunction(Conjunction &&other) = default;
 
-    Conjunction operator=(Conjunction other) {
+    Conjunction &operator=(Conjunction other) {
         using std::swap;
         swap(_left, other._left);
         swap(_right, other._right);
@@ -228,7 +230,7 @@ struct Implication {
     Implication(): rhs(PredicateRef()) {}
     Implication(PredicateRef left, Expression right): lhs(left), rhs(right) {}
 
-    Implication operator=(Implication other) {
+    Implication &operator=(Implication other) {
         using std::swap;
         swap(lhs, other.lhs);
         swap(rhs, other.rhs);
@@ -249,7 +251,7 @@ struct Predicate {
     Predicate(PredicateDecl name, std::vector<Implication> implications, std::vector<Handler> handlers):
         name(name), implications(implications), handlers(handlers) {}
 
-    Predicate operator=(Predicate other) {
+    Predicate &operator=(Predicate other) {
         using std::swap;
         swap(name, other.name);
         swap(implications, other.implications);
@@ -269,7 +271,7 @@ std::ostream& operator<<(std::ostream &out, const Predicate &pred);
 /// Represents the declaration of a type at the begining of its definition.
 struct TypeDecl {
     TypeDecl() {}
-    TypeDecl(std::string name, SourceLocation location):
+    TypeDecl(std::string_view name, SourceLocation location):
         name(name), location(location) {}
 
     Name<Type> name;
@@ -284,7 +286,7 @@ std::ostream& operator<<(std::ostream &out, const TypeDecl &td);
 struct CtorParameter {
     CtorParameter(): name(""), location(SourceLocation()) {}
 
-    CtorParameter(std::string name, SourceLocation location):
+    CtorParameter(std::string_view name, SourceLocation location):
         name(name), location(location) {}
 
     Name<Type> name;
@@ -298,7 +300,7 @@ std::ostream& operator<<(std::ostream &out, const CtorParameter &p);
 struct Constructor {
     Constructor() {}
     Constructor(
-        std::string name,
+        std::string_view name,
         std::vector<CtorParameter> parameters,
         SourceLocation location
     ): name(name), parameters(parameters), location(location) {}
@@ -320,11 +322,11 @@ std::ostream& operator<<(std::ostream &out, const Constructor &ctor);
 struct NamedValue {
     NamedValue() {}
 
-    NamedValue(std::string name, bool isDefinition, SourceLocation location):
+    NamedValue(std::string_view name, bool isDefinition, SourceLocation location):
         name(name), isDefinition(isDefinition), location(location) {}
 
     NamedValue(
-        std::string name,
+        std::string_view name,
         std::vector<Value> arguments,
         SourceLocation location
     ): name(name), isDefinition(false), arguments(arguments),
@@ -385,7 +387,7 @@ std::ostream& operator<<(std::ostream &out, const Type &type);
 struct EffectRef {
     EffectRef(): name(""), location(SourceLocation()) {}
 
-    EffectRef(std::string name, SourceLocation location):
+    EffectRef(std::string_view name, SourceLocation location):
         name(name), location(location) {}
 
     Name<Effect> name;
@@ -399,7 +401,7 @@ std::ostream& operator<<(std::ostream &out, const EffectRef &e);
 /// Represents the declaration of an effect at the begining of its definition.
 struct EffectDecl {
     EffectDecl() {}
-    EffectDecl(std::string name, SourceLocation location):
+    EffectDecl(std::string_view name, SourceLocation location):
         name(name), location(location) {}
 
     Name<Effect> name;
@@ -414,7 +416,7 @@ std::ostream& operator<<(std::ostream &out, const EffectDecl &type);
 struct Parameter {
     Parameter(): name(""), isInputOnly(true), location(SourceLocation()) {}
 
-    Parameter(std::string name, bool isInputOnly, SourceLocation location):
+    Parameter(std::string_view name, bool isInputOnly, SourceLocation location):
         name(name), isInputOnly(isInputOnly), location(location) {}
 
     /// The name of the parameter's type.
@@ -435,7 +437,7 @@ std::ostream& operator<<(std::ostream &out, const Parameter &typeRef);
 struct EffectConstructor {
     EffectConstructor() {}
     EffectConstructor(
-        std::string name,
+        std::string_view name,
         std::vector<Parameter> parameters,
         SourceLocation location
     ): name(name), parameters(parameters), location(location) {}
@@ -491,17 +493,28 @@ std::ostream& operator<<(std::ostream &out, const Handler &type);
 struct AST {
     AST() {}
     AST(std::vector<Type> types, std::vector<Effect> effects,
-        std::vector<Predicate> predicates
-    ): types(types), effects(effects), predicates(predicates) {}
+        std::vector<Predicate> predicates);
 
     Optional<Type> resolveTypeRef(const Name<Type> &tr) const;
     Optional<const Effect*> resolveEffectRef(const EffectRef &er) const;
     Optional<std::pair<const Effect*, const EffectConstructor*>> resolveEffectCtorRef(const EffectCtorRef &ecr) const;
     Optional<PredicateDecl> resolvePredicateRef(const PredicateRef &pr) const;
 
+    const std::vector<Type> &getTypes() const { return types; }
+    const std::vector<Effect> &getEffects() const { return effects; }
+    const std::vector<Predicate> &getPredicates() const { return predicates; }
+
+private:
+    // The declarations can't be modified after construction, so that the
+    // indices below, which the constructor builds, always match them.
     std::vector<Type> types;
     std::vector<Effect> effects;
     std::vector<Predicate> predicates;
+
+    // Indices of the declarations by name.
+    std::unordered_map<Name<Type>, size_t> typeIndices;
+    std::unordered_map<Name<Effect>, size_t> effectIndices;
+    std::unordered_map<Name<Predicate>, size_t> predicateIndices;
 };
 
 bool operator==(const AST &lhs, const AST &rhs);
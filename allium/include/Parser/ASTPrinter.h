@@ -234,9 +234,9 @@ public:
         indent();
         out << "<AST>\n";
         ++depth;
-        for(const auto &type : ast.types) visit(type);
-        for(const auto &effect : ast.effects) visit(effect);
-        for(const auto &predicate : ast.predicates) visit(predicate);
+        for(const auto &type : ast.getTypes()) visit(type);
+        for(const auto &effect : ast.getEffects()) visit(effect);
+        for(const auto &predicate : ast.getPredicates()) visit(predicate);
         --depth;
     }
 
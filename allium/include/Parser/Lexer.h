@@ -3,6 +3,9 @@
 
 #include <fstream>
 #include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
 
 #include "Utils/Optional.h"
 #include "Utils/ParserValues.h"
@@ -34,13 +37,14 @@ struct Token {
         paren_r,
         string_literal,
         true_literal,
+        unknown,
     };
 
-    Token(): type(Type::end_of_file), text(""), location(0, 0) {}
+    Token(): type(Type::end_of_file), text(""), location(0, 0), offset(0) {}
     Token(
-        Type type, std::string text, SourceLocation location,
-        std::streampos loc
-    ):  type(type), text(text), location(location), sourceLocation(loc) {}
+        Type type, std::string_view text, SourceLocation location,
+        size_t offset
+    ):  type(type), text(text), location(location), offset(offset) {}
 
         friend bool operator==(const Token &lhs, const Token &rhs) {
             return lhs.type == rhs.type && lhs.text == rhs.text &&
@@ -54,30 +58,54 @@ struct Token {
 
     /// The source code text corresponding to this token in the program.
     ///
-    /// E.g. the string "p" for a predicate `p` in the source program.
-    // TODO: replace this with a std::string_view to reduce memory usage.
-    std::string text;
+    /// E.g. the string "p" for a predicate `p` in the source program. This is
+    /// a view into the lexer's source buffer, so it must not outlive the lexer.
+    std::string_view text;
 
     /// The location of the start of the token in the source file.
     SourceLocation location;
 
-    /// Represents the start position of the token in the source program.
+    /// The offset of the start of the token from the beginning of the source
+    /// buffer.
     ///
-    /// This is useful for reseting after an unsuccessful parse and for
-    /// diagnostics. It should only be used with the Lexer's `file` stream.
-    std::streampos sourceLocation;
+    /// This identifies the token within the lexer's token buffer, which is
+    /// useful for reseting after an unsuccessful parse. It should only be used
+    /// with the Lexer that produced the token.
+    size_t offset;
 };
 
 std::ostream& operator<<(std::ostream& out, const Token value);
 std::ostream& operator<<(std::ostream& out, const Token::Type value);
 
+/// Splits source text into tokens for the parser.
+///
+/// The whole source is lexed up front into a token buffer, so looking ahead
+/// and rewinding are just moves within that buffer and never lex anything
+/// twice.
 class Lexer {
 public:
-    Lexer(std::istream &f) : file(f), lineNumber(1), columnNumber(0) {}
+    /// Reads the entire stream into memory, and lexes it from there. The
+    /// locations of the tokens are in `module`, if the source is one of
+    /// several modules of a program.
+    Lexer(std::istream &f, int module = -1);
+
+    /// Lexes the given source text in place. The text must outlive the lexer
+    /// and all of the tokens it produces.
+    Lexer(std::string_view source);
+
+    // Tokens refer to the source buffer owned by the lexer, so copying it
+    // would leave them dangling.
+    Lexer(const Lexer &) = delete;
+    Lexer &operator=(const Lexer &) = delete;
 
     /// Identify and return the next token in the stream without consuming it.
     Token peek_next();
 
+    /// Returns the token `distance` tokens after the next one without
+    /// consuming anything, such that `peek_ahead(0)` is `peek_next()`. Looking
+    /// past the end of the file yields the end of file token.
+    Token peek_ahead(size_t distance);
+
     /// Identify, consume, and return the next token in the stream.
     Token take_next();
 
@@ -94,35 +122,60 @@ public:
     void rewind(Token tok);
     
 private:
+    /// A position within the source buffer.
+    struct Cursor {
+        /// The offset of the next character to be lexed.
+        size_t offset;
+
+        /// The number of the line in the source code of the next character to
+        /// be lexed.
+        int lineNumber;
+
+        /// The offset of the first character of the current line. The column
+        /// of the next character is its distance from this offset.
+        size_t lineStart;
+    };
+
+    /// Lexes the entire source into `tokens`.
+    void tokenize();
+
+    /// Identifies and consumes the token at the cursor.
+    Token lex();
+
+    /// Advances the lexer past any whitespace and comments.
+    void skipWhitespaceAndComments();
+
     /// Advances the lexer to the next non-whitespace character.
     void skipWhitespace();
 
-    /// After the lexer has taken a word `str`, read over it and peel off the
-    /// longest possible identifier from the beginning, and rewind the file to
-    /// the end of that identifier. This may be used to separate an identifier
-    /// from other tokens that don't need to be separated by whitespace.
-    ///
-    /// For example, if the lexer takes "name{name<-true;}", then the result
-    /// will be "name" and the stream will be rewound to before the "{".
-    std::string takeIdentifier(const std::string str);
+    /// Consumes an identifier or keyword.
+    Token takeWord(SourceLocation location);
 
     /// Consumes any text up to the next double quote.
-    Token takeStringLiteral();
+    Token takeStringLiteral(SourceLocation location);
 
     /// Consumes a sequence of digits from the stream.
-    Token takeIntegerLiteral();
+    Token takeIntegerLiteral(SourceLocation location);
+
+    /// The contents of the stream passed to the lexer, if there was one. This
+    /// must precede `source`, which refers to it.
+    std::string buffer;
+
+    /// The source code text which is lexed by this lexer.
+    std::string_view source;
 
-    /// Advances the lexer to the end of a comment.
-    void skipComment();
+    /// The module of the locations of the tokens.
+    int module = -1;
 
-    /// The source code file which is lexed by this lexer.
-    std::istream &file;
+    /// The position of the next token to be lexed while tokenizing.
+    Cursor cursor;
 
-    /// The number of the line in the source code of the next token to be lexed.
-    int lineNumber;
+    /// Every token in the source, in order. The last token is always the end
+    /// of file token.
+    std::vector<Token> tokens;
 
-    /// The column number of the start of the next token to be lexed.
-    int columnNumber;
+    /// The index in `tokens` of the next token to be taken.
+    size_t position = 0;
 };
 
 } // namespace parser
@@ -0,0 +1,64 @@
+#ifndef PARSER_MODULES_H
+#define PARSER_MODULES_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "Parser/AST.h"
+#include "Parser/Parser.h"
+
+namespace parser {
+
+/// Represents a definition in one module which conflicts with a definition in
+/// another module of the same program.
+class LinkError {
+public:
+    LinkError(const std::string &message, const std::string &path, SourceLocation location):
+        message(message), path(path), location(location) {}
+
+    friend bool operator==(const LinkError &lhs, const LinkError &rhs) {
+        return lhs.message == rhs.message && lhs.path == rhs.path &&
+            lhs.location == rhs.location;
+    }
+
+    friend std::ostream& operator<<(std::ostream& stream, const LinkError& error) {
+        stream << "link error " << error.path << " " << error.location <<
+            " - " << error.message << std::endl;
+        return stream;
+    }
+
+    /// The error message associated with the error.
+    std::string message;
+
+    /// The path of the module containing the conflicting definition.
+    std::string path;
+
+    /// The location of the conflicting definition within its module.
+    SourceLocation location;
+};
+
+/// Parses each of the given source files independently. Files are parsed
+/// concurrently on a pool of up to one thread per hardware core, and the
+/// results are returned in the same order as `filePaths`. Every source
+/// location in a module's AST has the module's index in `filePaths`.
+///
+/// Note: files which cannot be read are parsed as if they were empty, so
+/// callers should report unreadable files before parsing.
+std::vector<ParserResult<AST>> parseModules(const std::vector<std::string> &filePaths);
+
+/// Merges the ASTs of the modules of a program into a single AST for the whole
+/// program, in the order of `modules`. `paths` gives the path of each module
+/// for use in diagnostics.
+///
+/// A type, effect, or predicate may only be defined by one module. Conflicting
+/// definitions are added to `errors`. Conflicts within a single module are
+/// left for SemAna to diagnose.
+AST link(
+    const std::vector<AST> &modules,
+    const std::vector<std::string> &paths,
+    std::vector<LinkError> &errors);
+
+} // namespace parser
+
+#endif // PARSER_MODULES_H
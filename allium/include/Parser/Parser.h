@@ -43,9 +43,9 @@ class ParserResult: public TaggedUnion<T, std::vector<SyntaxError>> {
 public:
     // Constructs a ParserResult which represents the provided list of errors if any errors are present.
     // If no errors are present, the result will contain the provided value.
-    ParserResult(T value, std::vector<SyntaxError> errors): TaggedUnion<T, std::vector<SyntaxError>>(value) {
+    ParserResult(T value, std::vector<SyntaxError> errors): TaggedUnion<T, std::vector<SyntaxError>>(std::move(value)) {
         if (!errors.empty()) {
-            this->wrapped = errors;
+            this->wrapped = std::move(errors);
         }
     }
     // Constructs a ParserResult for the failure case (no value, no errors).
@@ -75,6 +75,8 @@ public:
 
     // Unwrap the value of the result into the provided location if a value is present or add any errors to the provided list
     // if errors are present. Return false in the failure case and true in the success and error cases.
+    //
+    // Note: the value is moved out of the result, so it may only be unwrapped once.
     bool unwrapResultInto(T& val, std::vector<SyntaxError>& errorsList) {
         if (errored()) {
             std::vector resultErrors = std::get<std::vector<SyntaxError>>(this->wrapped);
@@ -83,13 +85,15 @@ public:
         } else if (failed()) {
             return false;
         } else {
-            val = std::get<T>(this->wrapped);
+            val = std::move(std::get<T>(this->wrapped));
             return true;
         }
     }
 
     // Unwrap the value of the result into the provided location if a value is present or add any errors to the provided list
-    // if errors are present. Return false in the failure case and true in the success and error cases.
+    // if errors are present. Return true in the failure case and false in the success and error cases.
+    //
+    // Note: the value is moved out of the result, so it may only be unwrapped once.
     bool unwrapResultGuard(T& val, std::vector<SyntaxError>& errorsList) {
         if (errored()) {
             std::vector resultErrors = std::get<std::vector<SyntaxError>>(this->wrapped);
@@ -98,7 +102,7 @@ public:
         } else if (failed()) {
             return true;
         } else {
-            val = std::get<T>(this->wrapped);
+            val = std::move(std::get<T>(this->wrapped));
             return false;
         }
     }
@@ -151,7 +155,15 @@ public:
 class Parser {
 public:
     Parser(std::istream &f, std::ostream &out = std::cout):
-        lexer(f), out(std::cout) {}
+        lexer(f), out(out) {}
+
+    /// Parses one of several modules of a program, whose index is `module`.
+    Parser(std::istream &f, int module, std::ostream &out = std::cout):
+        lexer(f, module), out(out) {}
+
+    /// Parses the given source text in place. The text must outlive the parser.
+    Parser(std::string_view source, std::ostream &out = std::cout):
+        lexer(source), out(out) {}
 
     ParserResult<Implication> parseImplication();
     ParserResult<Predicate> parsePredicate();
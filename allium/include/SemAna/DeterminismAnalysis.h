@@ -0,0 +1,16 @@
+#include <set>
+
+#include "TypedAST.h"
+
+namespace TypedAST {
+
+/// Given a program, determines which of its predicates are semideterministic
+/// tests: predicates which have at most one witness, and whose proofs never
+/// bind their arguments. Such a predicate can be proven by an ordinary call
+/// which returns whether it succeeded, rather than by a coroutine.
+///
+/// Only predicates whose parameters are all "in" are considered, since ground
+/// analysis guarantees that their arguments contain no unbound variables.
+std::set<Name<Predicate>> getSemideterministicPredicates(const AST &ast);
+
+}
@@ -12,4 +12,9 @@ namespace TypedAST {
 /// Because this is an interprocedural analysis, it operates on a typed AST.
 void checkGroundParameters(const AST &ast, ErrorEmitter &error);
 
+/// Like checkGroundParameters, for a library whose entry points are all of its
+/// predicates rather than main. Callers of the library must pass ground
+/// arguments to each "in" parameter.
+void checkLibraryGroundParameters(const AST &ast, ErrorEmitter &error);
+
 }
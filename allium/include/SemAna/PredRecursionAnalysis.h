@@ -1,8 +1,8 @@
 #ifndef SEMANA_PRED_RECURSION_ANALYSIS_H
 #define SEMANA_PRED_RECURSION_ANALYSIS_H
 
-#include <map>
-#include <set>
+#include <unordered_map>
+#include <unordered_set>
 
 #include "SemAna/TypedAST.h"
 
@@ -12,12 +12,12 @@ namespace TypedAST {
 /// a directed edge from p to q if q occurs in the body of one of p's
 /// implications.
 class PredDependenceGraph {
-    std::map<Name<Predicate>, std::set<Name<Predicate>>> adjacencyList;
+    std::unordered_map<Name<Predicate>, std::unordered_set<Name<Predicate>>> adjacencyList;
 
     bool dependsOnHelper(
         const Name<Predicate> &first,
         const Name<Predicate> &second,
-        std::set<Name<Predicate>> &visited
+        std::unordered_set<Name<Predicate>> &visited
     ) const;
 
 public:
@@ -32,6 +32,13 @@ public:
         const Name<Predicate> &first,
         const Name<Predicate> &second
     ) const;
+
+    /// Returns the strongly connected components of the graph, which are sets
+    /// of mutually recursive predicates. A component comes after every
+    /// component which it depends on.
+    std::vector<std::vector<Name<Predicate>>> getStronglyConnectedComponents(
+        const AST &ast
+    ) const;
 };
 
 inline void forAllPredRefs(
@@ -2,6 +2,8 @@
 #define SEMANA_STATIC_ERROR_H
 
 #include <iostream>
+#include <string>
+#include <vector>
 
 #include "Utils/ParserValues.h"
 
@@ -71,7 +73,10 @@ std::ostream& operator<<(std::ostream &out, const ErrorMessage &msg);
 
 class ErrorEmitter {
 public:
-    ErrorEmitter(std::ostream &out): out(out) {}
+    /// Errors at locations in one of several modules of a program name the
+    /// module's path in `modulePaths`.
+    ErrorEmitter(std::ostream &out, std::vector<std::string> modulePaths = {}):
+        out(out), modulePaths(modulePaths) {}
 
     // It would be preferable to implement emit as a variadic function,
     // but there are several drawbacks to doing so:
@@ -98,7 +103,11 @@ public:
     unsigned int getErrors() { return errors; }
 
 private:
+    /// Writes the start of an error at `loc`.
+    void writeLocation(SourceLocation loc) const;
+
     std::ostream &out;
+    std::vector<std::string> modulePaths;
     mutable unsigned int errors = 0;
 };
 
@@ -5,6 +5,7 @@
 #include <memory>
 #include <sstream>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "Utils/ParserValues.h"
@@ -255,19 +256,26 @@ struct PredicateDecl {
     PredicateDecl(
         std::string name,
         std::vector<Parameter> parameters,
-        std::vector<EffectRef> effects
-    ): name(name), parameters(parameters), effects(effects) {}
+        std::vector<EffectRef> effects,
+        SourceLocation location = SourceLocation()
+    ): name(name), parameters(parameters), effects(effects),
+        location(location) {}
 
     Name<Predicate> name;
     std::vector<Parameter> parameters;
     std::vector<EffectRef> effects;
+    SourceLocation location;
 };
 
 struct PredicateRef {
-    PredicateRef(std::string name, std::vector<Value> arguments);
+    PredicateRef(
+        std::string name,
+        std::vector<Value> arguments,
+        SourceLocation location = SourceLocation());
 
     Name<Predicate> name;
     std::vector<Value> arguments;
+    SourceLocation location;
 };
 
 std::ostream& operator<<(std::ostream &out, const PredicateRef &pr);
@@ -436,8 +444,7 @@ class AST {
 public:
     AST(std::vector<Type> types,
         std::vector<Effect> effects,
-        std::vector<UserPredicate> predicates
-    ): types(types), effects(effects), predicates(predicates) {}
+        std::vector<UserPredicate> predicates);
 
     const Type &resolveTypeRef(const Name<Type> &tr) const;
 
@@ -452,9 +459,22 @@ public:
 
     const Predicate resolvePredicateRef(const PredicateRef &pr) const;
 
+    const std::vector<Type> &getTypes() const { return types; }
+    const std::vector<Effect> &getEffects() const { return effects; }
+    const std::vector<UserPredicate> &getPredicates() const { return predicates; }
+
+private:
+    // The declarations can't be modified after construction, so that the
+    // indices below, which the constructor builds, always match them.
     std::vector<Type> types;
     std::vector<Effect> effects;
     std::vector<UserPredicate> predicates;
+
+    // Indices of the user-defined declarations by name. These are positions
+    // rather than pointers, so they remain valid when the AST is copied.
+    std::unordered_map<Name<Type>, size_t> typeIndices;
+    std::unordered_map<Name<Effect>, size_t> effectIndices;
+    std::unordered_map<Name<Predicate>, size_t> predicateIndices;
 };
 
 /// Represents the variables and their types defined in a scope.
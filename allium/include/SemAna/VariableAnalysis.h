@@ -8,4 +8,8 @@ namespace TypedAST {
 /// implication.
 Scope getVariables(const AST &ast, const Implication &impl);
 
+/// Returns the variables and their types which are defined inside of the given
+/// handler implication.
+Scope getVariables(const AST &ast, const EffectImplication &eImpl);
+
 }
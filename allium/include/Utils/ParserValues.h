@@ -2,17 +2,25 @@
 #define SOURCE_LOCATION_H
 
 #include <sstream>
+#include <functional>
+#include <shared_mutex>
 #include <string>
+#include <string_view>
+#include <unordered_set>
 
 /// A line and column within a source file.
 struct SourceLocation {
     int lineNumber;
     int columnNumber;
 
-    SourceLocation(): lineNumber(-1), columnNumber(-1) {}
+    /// The index of the module of the program which the location is in, or -1
+    /// if the source wasn't parsed as one of several modules.
+    int module;
 
-    SourceLocation(int lineNumber, int columnNumber):
-        lineNumber(lineNumber), columnNumber(columnNumber) {}
+    SourceLocation(): lineNumber(-1), columnNumber(-1), module(-1) {}
+
+    SourceLocation(int lineNumber, int columnNumber, int module = -1):
+        lineNumber(lineNumber), columnNumber(columnNumber), module(module) {}
     
     std::string toString() const {
         std::ostringstream stringBuilder;
@@ -21,7 +29,9 @@ struct SourceLocation {
     }
 
     friend bool operator==(const SourceLocation &lhs, const SourceLocation &rhs) {
-        return lhs.lineNumber == rhs.lineNumber && lhs.columnNumber == rhs.columnNumber;
+        return lhs.lineNumber == rhs.lineNumber &&
+            lhs.columnNumber == rhs.columnNumber &&
+            lhs.module == rhs.module;
     }
 
     friend bool operator!=(const SourceLocation &lhs, const SourceLocation &rhs) {
@@ -29,21 +39,100 @@ struct SourceLocation {
     }
 
     friend bool operator<(const SourceLocation &lhs, const SourceLocation &rhs) {
+        if(lhs.module != rhs.module) return lhs.module < rhs.module;
         if(lhs.lineNumber != rhs.lineNumber) return lhs.lineNumber < rhs.lineNumber;
         return lhs.columnNumber < rhs.columnNumber;
     }
     
+    /// Writes the line and column. The module is left to the caller, which
+    /// knows the paths of the modules.
     friend std::ostream& operator<<(std::ostream &out, SourceLocation loc) {
         return out << loc.lineNumber << ":" << loc.columnNumber;
     }
 };
 
-/// Represents the name of an AST node. Just a strongly typed std::string.
+/// Owns the canonical copies of interned symbols.
+///
+/// A compilation owns a table, and makes it the current table of each of its
+/// threads with a SymbolTable::Scope, so that its symbols are freed along with
+/// it. Symbols interned outside of any compilation, such as the names of
+/// builtins, are kept in a process-wide table which every other table shares.
+class SymbolTable {
+public:
+    SymbolTable();
+    ~SymbolTable();
+
+    SymbolTable(const SymbolTable&) = delete;
+    SymbolTable &operator=(const SymbolTable&) = delete;
+
+    /// Returns the canonical copy of `text`, adding it if necessary. Equal
+    /// strings always yield the same pointer, which is valid for as long as
+    /// the table. This is thread-safe, and symbols which the calling thread
+    /// has seen before are found without taking a lock.
+    const std::string *intern(std::string_view text);
+
+    /// Returns the calling thread's current table, which is the process-wide
+    /// table outside of any scope.
+    static SymbolTable &current();
+
+    /// Makes a table the current table of the calling thread until the scope
+    /// ends.
+    class Scope {
+    public:
+        explicit Scope(SymbolTable &table);
+        ~Scope();
+
+        Scope(const Scope&) = delete;
+        Scope &operator=(const Scope&) = delete;
+
+    private:
+        SymbolTable *previous;
+    };
+
+private:
+    /// Hashes strings and string views alike, so the table can be searched
+    /// without first copying a token's text into a std::string.
+    struct Hash {
+        using is_transparent = void;
+
+        size_t operator()(std::string_view text) const noexcept {
+            return std::hash<std::string_view>()(text);
+        }
+    };
+
+    /// Returns the symbol for `text` if the table has one, or null.
+    const std::string *find(std::string_view text);
+
+    /// Distinguishes the table in the threads' caches of symbols, since a new
+    /// table may reuse the address of one which has been destroyed.
+    uint64_t generation;
+
+    /// Elements of an unordered set are never moved, so pointers to them
+    /// remain valid as it grows.
+    std::shared_mutex mutex;
+    std::unordered_set<std::string, Hash, std::equal_to<>> symbols;
+};
+
+/// Returns the canonical copy of `text` in the calling thread's current symbol
+/// table. See SymbolTable::intern.
+const std::string *internSymbol(std::string_view text);
+
+/// Returns the symbol of the empty string, which is shared by every table and
+/// needs no lookup.
+const std::string *emptySymbol();
+
+/// Represents the name of an AST node.
+///
+/// Names are interned, so copying, comparing for equality, and hashing a name
+/// are constant-time operations on a pointer. A name must not outlive the
+/// symbol table in which it was created. Names are still ordered by their
+/// text, so ordered containers of names iterate in a deterministic order.
 template <typename Node>
 struct Name {
-    Name() {}
-    explicit Name(std::string wrapped): wrapped(wrapped) {}
-    Name(const char *literal): wrapped(std::string(literal)) {}
+    Name(): wrapped(emptySymbol()) {}
+    explicit Name(std::string_view text): wrapped(internSymbol(text)) {}
+    explicit Name(const std::string &text): wrapped(internSymbol(text)) {}
+    Name(const char *literal): wrapped(internSymbol(literal)) {}
 
     friend inline bool operator==(const Name<Node> &left, const Name<Node> &right) {
         return left.wrapped == right.wrapped;
@@ -54,20 +143,33 @@ struct Name {
     }
 
     friend inline bool operator<(const Name<Node> &left, const Name<Node> &right) {
-        return left.wrapped < right.wrapped;
+        return left.wrapped != right.wrapped && *left.wrapped < *right.wrapped;
     }
 
     friend inline std::ostream& operator<<(std::ostream &out, const Name<Node> &pn) {
-        return out << pn.wrapped;
+        return out << *pn.wrapped;
     }
 
     /// Expose a const reference to the string as a last resort for where a string
     /// is really needed.
     inline const std::string &string() const {
+        return *wrapped;
+    }
+
+    /// Identifies the symbol. Two names of the same node type are equal if and
+    /// only if their symbols are equal.
+    inline const void *symbol() const {
         return wrapped;
     }
 private:
-    std::string wrapped;
+    const std::string *wrapped;
+};
+
+template <typename Node>
+struct std::hash<Name<Node>> {
+    size_t operator()(const Name<Node> &name) const noexcept {
+        return std::hash<const void*>()(name.symbol());
+    }
 };
 
 #endif // SOURCE_LOCATION_H
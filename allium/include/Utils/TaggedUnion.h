@@ -30,8 +30,8 @@ protected:
     std::variant<Ts...> wrapped;
 
 public:
-    TaggedUnion(typename std::tuple_element<0, std::tuple<Ts...>>::type t): wrapped(t) {}
-    explicit TaggedUnion(std::variant<Ts...> value): wrapped(value) {}
+    TaggedUnion(typename std::tuple_element<0, std::tuple<Ts...>>::type t): wrapped(std::move(t)) {}
+    explicit TaggedUnion(std::variant<Ts...> value): wrapped(std::move(value)) {}
 
     friend bool operator==(const TaggedUnion &lhs, const TaggedUnion &rhs) {
         return lhs.wrapped == rhs.wrapped;
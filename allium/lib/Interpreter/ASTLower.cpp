@@ -20,7 +20,7 @@ class ASTLowerer {
 public:
     ASTLowerer(
         const AST &ast
-    ): ast(ast), inhabitableTypes(getInhabitableTypes(ast.types)) {}
+    ): ast(ast), inhabitableTypes(getInhabitableTypes(ast.getTypes())) {}
 
     interpreter::MatcherVariable visit(const AnonymousVariable &av) {
         bool isTypeInhabited = inhabitableTypes.contains(av.type);
@@ -262,21 +262,21 @@ private:
         // TODO: it should be possible to do this in logarithmic time,
         // but the current implementation is linear.
         auto x = std::find_if(
-            ast.predicates.begin(),
-            ast.predicates.end(),
+            ast.getPredicates().begin(),
+            ast.getPredicates().end(),
             [&](const UserPredicate &up) { return up.declaration.name == pn; });
 
-        assert(x != ast.predicates.end());
-        return x - ast.predicates.begin();
+        assert(x != ast.getPredicates().end());
+        return x - ast.getPredicates().begin();
     }
 
     size_t getTypeConstructorIndex(const Name<Type> &tr, const ConstructorRef &cr) {
         auto type = std::find_if(
-            ast.types.begin(),
-            ast.types.end(),
+            ast.getTypes().begin(),
+            ast.getTypes().end(),
             [&](const Type &type) { return type.declaration.name == tr; });
         
-        assert(type != ast.types.end());
+        assert(type != ast.getTypes().end());
         return getConstructorIndex(*type, cr);
     }
 
@@ -293,12 +293,12 @@ private:
     size_t getEffectIndex(const EffectRef &er) {
         // search for a user-defined effect type with the given name.
         auto effect = std::find_if(
-            ast.effects.begin(),
-            ast.effects.end(),
+            ast.getEffects().begin(),
+            ast.getEffects().end(),
             [&](const Effect &e) { return er == e.declaration.name; });
         
-        if(effect != ast.effects.end()) {
-            return effect - ast.effects.begin() + TypedAST::builtinEffects.size();
+        if(effect != ast.getEffects().end()) {
+            return effect - ast.getEffects().begin() + TypedAST::builtinEffects.size();
         }
 
         // If the effect type is not user-defined, it must be builtin.
@@ -315,11 +315,11 @@ private:
         const Name<EffectCtor> ctorName
     ) {
         auto effect = std::find_if(
-            ast.effects.begin(),
-            ast.effects.end(),
+            ast.getEffects().begin(),
+            ast.getEffects().end(),
             [&](const Effect &e) { return effectName == e.declaration.name; });
 
-        if(effect != ast.effects.end()) {
+        if(effect != ast.getEffects().end()) {
             auto eCtor = std::find_if(
                 effect->constructors.begin(),
                 effect->constructors.end(),
@@ -328,7 +328,7 @@ private:
             assert(eCtor != effect->constructors.end());
 
             return {
-                effect - ast.effects.begin() + TypedAST::builtinEffects.size(),
+                effect - ast.getEffects().begin() + TypedAST::builtinEffects.size(),
                 eCtor - effect->constructors.begin()
             };
         }
@@ -364,14 +364,14 @@ interpreter::Program lower(const AST &ast, interpreter::Config config) {
     ASTLowerer lowerer(ast);
     
     std::vector<interpreter::Predicate> loweredPredicates;
-    loweredPredicates.reserve(ast.predicates.size());
+    loweredPredicates.reserve(ast.getPredicates().size());
 
     std::vector<std::string> predicateNameTable;
-    predicateNameTable.reserve(ast.predicates.size());
+    predicateNameTable.reserve(ast.getPredicates().size());
 
     Optional<interpreter::PredicateReference> main;
 
-    for(const auto &p : ast.predicates) {
+    for(const auto &p : ast.getPredicates()) {
         interpreter::Predicate lowered = lowerer.visit(p);
         loweredPredicates.push_back(lowered);
 
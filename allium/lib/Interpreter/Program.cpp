@@ -50,6 +50,15 @@ bool operator!=(const EffectImplication &left, const EffectImplication &right) {
     return !(left == right);
 }
 
+bool operator==(const UserHandler &left, const UserHandler &right) {
+    return left.effect == right.effect &&
+        left.implications == right.implications;
+}
+
+bool operator!=(const UserHandler &left, const UserHandler &right) {
+    return !(left == right);
+}
+
 bool operator==(const Predicate &left, const Predicate &right) {
     return left.implications == right.implications;
 }
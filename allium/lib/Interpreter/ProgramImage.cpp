@@ -0,0 +1,672 @@
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <random>
+#include <sstream>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "Interpreter/BuiltinPredicates.h"
+#include "Interpreter/ProgramImage.h"
+#include "SemAna/Builtins.h"
+
+namespace interpreter {
+
+static const char imageMagic[8] = { 'A', 'L', 'L', 'I', 'U', 'M', 'I', 'M' };
+
+/// Incremented whenever the layout of images changes, so that stale images
+/// are rejected even if the version of Allium is unchanged.
+static const uint32_t imageFormatVersion = 2;
+
+static const char *alliumVersion = ALLIUM_VERSION;
+
+// Tags identifying the case of each tagged union in an image.
+enum class MatcherTag : uint8_t { None, Ctor, String, Int, Variable };
+enum class ExpressionTag : uint8_t {
+    Truth, Continuation, Predicate, Builtin, Effect, Conjunction
+};
+
+/// Marks a constructor of a user-defined effect in the effect table of an
+/// image which the program never refers to.
+static const uint64_t unusedEffectCtor = UINT64_MAX;
+
+/// Adds `bytes` to a 64-bit FNV-1a hash.
+static void addToHash(uint64_t &hash, std::string_view bytes) {
+    for(unsigned char c : bytes) {
+        hash ^= c;
+        hash *= 0x100000001b3;
+    }
+}
+
+static const uint64_t emptyHash = 0xcbf29ce484222325;
+
+uint64_t hashSources(const std::vector<std::string> &sources) {
+    uint64_t hash = emptyHash;
+    auto add = [&](std::string_view bytes) { addToHash(hash, bytes); };
+
+    add(alliumVersion);
+    for(const std::string &source : sources) {
+        // Include the size of each source, so that moving text from the end
+        // of one module to the start of the next changes the hash.
+        uint64_t size = source.size();
+        add(std::string_view((const char *) &size, sizeof(size)));
+        add(source);
+    }
+    return hash;
+}
+
+class ImageWriter {
+public:
+    ImageWriter(std::ostream &out): out(out) {}
+
+    void write(uint64_t value) {
+        out.write((const char *) &value, sizeof(value));
+    }
+
+    void writeByte(uint8_t value) {
+        out.put((char) value);
+    }
+
+    void write(std::string_view str) {
+        write((uint64_t) str.size());
+        out.write(str.data(), str.size());
+    }
+
+    void write(const MatcherValue &value) {
+        value.switchOver(
+        [&](std::monostate) { writeByte((uint8_t) MatcherTag::None); },
+        [&](MatcherCtorRef ctor) {
+            writeByte((uint8_t) MatcherTag::Ctor);
+            write((uint64_t) ctor.index);
+            ctorCount = std::max<uint64_t>(ctorCount, ctor.index + 1);
+            write(ctor.arguments);
+        },
+        [&](String str) {
+            writeByte((uint8_t) MatcherTag::String);
+            write(std::string_view(str.value));
+        },
+        [&](Int i) {
+            writeByte((uint8_t) MatcherTag::Int);
+            write((uint64_t) i.value);
+        },
+        [&](MatcherVariable var) {
+            writeByte((uint8_t) MatcherTag::Variable);
+            write((uint64_t) var.index);
+            writeByte(var.isTypeInhabited);
+        });
+    }
+
+    void write(const std::vector<MatcherValue> &values) {
+        write((uint64_t) values.size());
+        for(const MatcherValue &value : values) write(value);
+    }
+
+    void write(const PredicateReference &pr) {
+        write((uint64_t) pr.index);
+        write(pr.arguments);
+    }
+
+    void write(const BuiltinPredicateReference &bpr) {
+        // Builtins are stored by name, since their addresses differ between
+        // runs.
+        write(std::string_view(getBuiltinPredicateName(bpr.predicate)));
+        write(bpr.arguments);
+    }
+
+    void write(const EffectCtorRef &ecr) {
+        recordEffectCtor(ecr.effectIndex, ecr.effectCtorIndex, ecr.arguments.size());
+        write((uint64_t) ecr.effectIndex);
+        write((uint64_t) ecr.effectCtorIndex);
+        write(ecr.arguments);
+        write(ecr.getContinuation());
+    }
+
+    void write(const Expression &expr) {
+        expr.switchOver(
+        [&](TruthValue tv) {
+            writeByte((uint8_t) ExpressionTag::Truth);
+            writeByte(tv.value);
+        },
+        [&](PredicateReference pr) {
+            writeByte((uint8_t) ExpressionTag::Predicate);
+            write(pr);
+        },
+        [&](BuiltinPredicateReference bpr) {
+            writeByte((uint8_t) ExpressionTag::Builtin);
+            write(bpr);
+        },
+        [&](EffectCtorRef ecr) {
+            writeByte((uint8_t) ExpressionTag::Effect);
+            write(ecr);
+        },
+        [&](Conjunction conj) {
+            writeByte((uint8_t) ExpressionTag::Conjunction);
+            write(conj.getLeft());
+            write(conj.getRight());
+        });
+    }
+
+    void write(const HandlerExpression &hExpr) {
+        hExpr.switchOver(
+        [&](TruthValue tv) {
+            writeByte((uint8_t) ExpressionTag::Truth);
+            writeByte(tv.value);
+        },
+        [&](Continuation) {
+            writeByte((uint8_t) ExpressionTag::Continuation);
+        },
+        [&](PredicateReference pr) {
+            writeByte((uint8_t) ExpressionTag::Predicate);
+            write(pr);
+        },
+        [&](BuiltinPredicateReference bpr) {
+            writeByte((uint8_t) ExpressionTag::Builtin);
+            write(bpr);
+        },
+        [&](EffectCtorRef ecr) {
+            writeByte((uint8_t) ExpressionTag::Effect);
+            write(ecr);
+        },
+        [&](HandlerConjunction hConj) {
+            writeByte((uint8_t) ExpressionTag::Conjunction);
+            write(hConj.getLeft());
+            write(hConj.getRight());
+        });
+    }
+
+    void write(const UserHandler &handler) {
+        if(handler.effect >= TypedAST::builtinEffects.size()) {
+            effectArities[handler.effect];
+        }
+        write((uint64_t) handler.effect);
+        write((uint64_t) handler.implications.size());
+        for(const EffectImplication &impl : handler.implications) {
+            recordEffectCtor(
+                impl.head.effectIndex,
+                impl.head.effectCtorIndex,
+                impl.head.arguments.size());
+            write((uint64_t) impl.head.effectIndex);
+            write((uint64_t) impl.head.effectCtorIndex);
+            write(impl.head.arguments);
+            write(impl.body);
+            write((uint64_t) impl.variableCount);
+        }
+    }
+
+    void write(const Predicate &p) {
+        write((uint64_t) p.implications.size());
+        for(const Implication &impl : p.implications) {
+            write(impl.head);
+            write(impl.body);
+            write((uint64_t) impl.variableCount);
+        }
+
+        write((uint64_t) p.handlers.size());
+        for(const UserHandler &handler : p.handlers) write(handler);
+    }
+
+    /// Writes the bounds of the constructor indices and the arities of the
+    /// constructors of user-defined effects which the program refers to,
+    /// against which the reader checks the rest of the image.
+    void writeTables() {
+        write(ctorCount);
+        size_t userEffectCount = effectArities.empty() ? 0 :
+            effectArities.rbegin()->first + 1 - TypedAST::builtinEffects.size();
+        write((uint64_t) userEffectCount);
+        for(size_t i = 0; i < userEffectCount; ++i) {
+            auto arities = effectArities.find(i + TypedAST::builtinEffects.size());
+            if(arities == effectArities.end()) {
+                write((uint64_t) 0);
+                continue;
+            }
+            write((uint64_t) arities->second.size());
+            for(uint64_t arity : arities->second) write(arity);
+        }
+    }
+
+private:
+    void recordEffectCtor(size_t effect, size_t ctor, size_t arity) {
+        if(effect < TypedAST::builtinEffects.size()) {
+            return;
+        }
+        std::vector<uint64_t> &arities = effectArities[effect];
+        if(arities.size() <= ctor) {
+            arities.resize(ctor + 1, unusedEffectCtor);
+        }
+        arities[ctor] = arity;
+    }
+
+    std::ostream &out;
+
+    uint64_t ctorCount = 0;
+    std::map<size_t, std::vector<uint64_t>> effectArities;
+};
+
+void writeProgramImage(
+    const Program &program,
+    uint64_t sourceHash,
+    std::ostream &out
+) {
+    // The payload follows a header which holds its checksum, so it is
+    // written to a buffer first.
+    std::ostringstream payload;
+    ImageWriter writer(payload);
+
+    writer.write((uint64_t) program.predicates.size());
+    for(size_t i = 0; i < program.predicates.size(); ++i) {
+        writer.write(program.predicates[i]);
+        writer.write(std::string_view(
+            i < program.predicateNameTable.size() ?
+                program.predicateNameTable[i] : ""));
+    }
+
+    PredicateReference main(0, {});
+    if(program.entryPoint.unwrapInto(main)) {
+        writer.writeByte(1);
+        writer.write(main);
+    } else {
+        writer.writeByte(0);
+    }
+    writer.writeTables();
+
+    std::string bytes = payload.str();
+    uint64_t checksum = emptyHash;
+    addToHash(checksum, bytes);
+
+    ImageWriter header(out);
+    out.write(imageMagic, sizeof(imageMagic));
+    header.write((uint64_t) imageFormatVersion);
+    header.write(std::string_view(alliumVersion));
+    header.write(sourceHash);
+    header.write(checksum);
+    out.write(bytes.data(), bytes.size());
+}
+
+/// Reads the contents of an image. Rather than checking every read, the reader
+/// produces placeholder values once it runs out of input or finds invalid
+/// data, and records that the image is malformed.
+///
+/// Indices of variables are checked against the variable count of their
+/// implication as they are read. Indices of predicates, constructors and
+/// effects are recorded, and checked against the tables once the whole image
+/// has been read.
+class ImageReader {
+public:
+    ImageReader(std::string_view image): image(image) {}
+
+    bool failed = false;
+
+    bool atEnd() const { return image.empty(); }
+
+    /// Returns the bytes which have not been read yet.
+    std::string_view remaining() const { return image; }
+
+    uint64_t read() {
+        uint64_t value = 0;
+        if(image.size() < sizeof(value)) return fail(), 0;
+        memcpy(&value, image.data(), sizeof(value));
+        image.remove_prefix(sizeof(value));
+        return value;
+    }
+
+    uint8_t readByte() {
+        if(image.empty()) return fail(), 0;
+        uint8_t value = image[0];
+        image.remove_prefix(1);
+        return value;
+    }
+
+    std::string_view readBytes(uint64_t size) {
+        if(image.size() < size) return fail(), std::string_view();
+        std::string_view bytes = image.substr(0, size);
+        image.remove_prefix(size);
+        return bytes;
+    }
+
+    std::string_view readString() {
+        return readBytes(read());
+    }
+
+    /// Reads the length of a list whose elements each occupy at least one
+    /// byte, rejecting lengths which cannot possibly fit in the image. This
+    /// keeps a corrupted length from causing a huge allocation.
+    uint64_t readCount() {
+        uint64_t count = read();
+        if(count > image.size()) return fail(), 0;
+        return count;
+    }
+
+    MatcherValue readMatcherValue() {
+        switch((MatcherTag) readByte()) {
+        case MatcherTag::None:
+            return MatcherValue();
+        case MatcherTag::Ctor: {
+            size_t index = read();
+            ctorBound = std::max<uint64_t>(ctorBound, index + 1);
+            return MatcherValue(MatcherCtorRef(index, readMatcherValues()));
+        }
+        case MatcherTag::String:
+            return MatcherValue(String(std::string(readString())));
+        case MatcherTag::Int:
+            return MatcherValue(Int((int64_t) read()));
+        case MatcherTag::Variable: {
+            size_t index = read();
+            if(index != MatcherVariable::anonymousIndex) {
+                variableBound = std::max<uint64_t>(variableBound, index + 1);
+            }
+            bool isTypeInhabited = readByte();
+            return MatcherValue(MatcherVariable(index, isTypeInhabited));
+        }
+        }
+        return fail(), MatcherValue();
+    }
+
+    std::vector<MatcherValue> readMatcherValues() {
+        std::vector<MatcherValue> values(readCount());
+        for(MatcherValue &value : values) value = readMatcherValue();
+        return values;
+    }
+
+    PredicateReference readPredicateReference() {
+        size_t index = read();
+        predicateBound = std::max<uint64_t>(predicateBound, index + 1);
+        return PredicateReference(index, readMatcherValues());
+    }
+
+    BuiltinPredicateReference readBuiltinPredicateReference() {
+        std::string name(readString());
+        BuiltinPredicate predicate = getBuiltinPredicateByName(name);
+        std::vector<MatcherValue> arguments = readMatcherValues();
+
+        // Builtins index their arguments without checking their count.
+        auto declaration = std::find_if(
+            TypedAST::builtinPredicates.begin(),
+            TypedAST::builtinPredicates.end(),
+            [&](const TypedAST::BuiltinPredicate &bp) {
+                return bp.declaration.name.string() == name;
+            });
+        if( !predicate ||
+            declaration == TypedAST::builtinPredicates.end() ||
+            declaration->declaration.parameters.size() != arguments.size()) {
+            fail();
+        }
+        return BuiltinPredicateReference(predicate, arguments);
+    }
+
+    EffectCtorRef readEffectCtorRef() {
+        size_t effectIndex = read();
+        size_t effectCtorIndex = read();
+        std::vector<MatcherValue> arguments = readMatcherValues();
+        effectCtors.push_back({ effectIndex, effectCtorIndex, arguments.size() });
+        return EffectCtorRef(
+            effectIndex, effectCtorIndex, arguments, readExpression());
+    }
+
+    Expression readExpression() {
+        switch((ExpressionTag) readByte()) {
+        case ExpressionTag::Truth:
+            return Expression(TruthValue(readByte()));
+        case ExpressionTag::Predicate:
+            return Expression(readPredicateReference());
+        case ExpressionTag::Builtin:
+            return Expression(readBuiltinPredicateReference());
+        case ExpressionTag::Effect:
+            return Expression(readEffectCtorRef());
+        case ExpressionTag::Conjunction: {
+            Expression left = readExpression();
+            return Expression(Conjunction(left, readExpression()));
+        }
+        case ExpressionTag::Continuation:
+            break;
+        }
+        return fail(), Expression(TruthValue(false));
+    }
+
+    HandlerExpression readHandlerExpression() {
+        switch((ExpressionTag) readByte()) {
+        case ExpressionTag::Truth:
+            return HandlerExpression(TruthValue(readByte()));
+        case ExpressionTag::Continuation:
+            return HandlerExpression(Continuation());
+        case ExpressionTag::Predicate:
+            return HandlerExpression(readPredicateReference());
+        case ExpressionTag::Builtin:
+            return HandlerExpression(readBuiltinPredicateReference());
+        case ExpressionTag::Effect:
+            return HandlerExpression(readEffectCtorRef());
+        case ExpressionTag::Conjunction: {
+            HandlerExpression left = readHandlerExpression();
+            return HandlerExpression(HandlerConjunction(left, readHandlerExpression()));
+        }
+        }
+        return fail(), HandlerExpression(TruthValue(false));
+    }
+
+    UserHandler readUserHandler() {
+        size_t effect = read();
+        effectBound = std::max<uint64_t>(effectBound, effect + 1);
+        std::vector<EffectImplication> implications;
+        for(uint64_t count = readCount(); count > 0 && !failed; --count) {
+            variableBound = 0;
+            size_t effectIndex = read();
+            size_t effectCtorIndex = read();
+            std::vector<MatcherValue> arguments = readMatcherValues();
+            effectCtors.push_back({ effectIndex, effectCtorIndex, arguments.size() });
+            HandlerExpression body = readHandlerExpression();
+            implications.emplace_back(
+                EffectImplHead(effectIndex, effectCtorIndex, arguments),
+                body,
+                readVariableCount());
+        }
+        return UserHandler(effect, implications);
+    }
+
+    Predicate readPredicate() {
+        std::vector<Implication> implications;
+        for(uint64_t count = readCount(); count > 0 && !failed; --count) {
+            variableBound = 0;
+            PredicateReference head = readPredicateReference();
+            Expression body = readExpression();
+            implications.emplace_back(head, body, readVariableCount());
+        }
+
+        std::vector<UserHandler> handlers;
+        for(uint64_t count = readCount(); count > 0 && !failed; --count) {
+            handlers.push_back(readUserHandler());
+        }
+        return Predicate(implications, handlers);
+    }
+
+    /// Reads the tables written by ImageWriter::writeTables, and checks every
+    /// index which has been read against them and against the program's
+    /// `predicateCount` predicates.
+    void readTables(size_t predicateCount) {
+        uint64_t ctorCount = read();
+        std::vector<std::vector<uint64_t>> userEffects(readCount());
+        for(std::vector<uint64_t> &arities : userEffects) {
+            arities.resize(readCount());
+            for(uint64_t &arity : arities) arity = read();
+        }
+        if(failed) return;
+
+        size_t effectCount = TypedAST::builtinEffects.size() + userEffects.size();
+        if( predicateBound > predicateCount ||
+            ctorBound > ctorCount ||
+            effectBound > effectCount) {
+            return fail();
+        }
+
+        for(const EffectCtorUse &use : effectCtors) {
+            uint64_t arity;
+            if(use.effect < TypedAST::builtinEffects.size()) {
+                const auto &ctors = TypedAST::builtinEffects[use.effect].constructors;
+                if(use.ctor >= ctors.size()) return fail();
+                arity = ctors[use.ctor].parameters.size();
+            } else if(use.effect < effectCount) {
+                const auto &arities =
+                    userEffects[use.effect - TypedAST::builtinEffects.size()];
+                if(use.ctor >= arities.size()) return fail();
+                arity = arities[use.ctor];
+            } else {
+                return fail();
+            }
+            if(use.arity != arity) return fail();
+        }
+    }
+
+private:
+    void fail() { failed = true; }
+
+    /// Reads the variable count of an implication, which must cover every
+    /// variable in it.
+    uint64_t readVariableCount() {
+        uint64_t count = read();
+        if(variableBound > count) fail();
+        return count;
+    }
+
+    std::string_view image;
+
+    /// One more than the largest index of each kind which has been read.
+    uint64_t predicateBound = 0;
+    uint64_t ctorBound = 0;
+    uint64_t effectBound = 0;
+
+    /// One more than the largest variable index in the current implication.
+    uint64_t variableBound = 0;
+
+    /// A reference to a constructor of an effect, with its number of
+    /// arguments.
+    struct EffectCtorUse {
+        uint64_t effect;
+        uint64_t ctor;
+        uint64_t arity;
+    };
+    std::vector<EffectCtorUse> effectCtors;
+};
+
+std::unique_ptr<Program> readProgramImage(
+    std::string_view image,
+    uint64_t sourceHash,
+    Config config
+) {
+    ImageReader reader(image);
+
+    if( reader.readBytes(sizeof(imageMagic)) != std::string_view(imageMagic, sizeof(imageMagic)) ||
+        reader.read() != imageFormatVersion ||
+        reader.readString() != alliumVersion ||
+        reader.read() != sourceHash ||
+        reader.failed) {
+        return nullptr;
+    }
+
+    uint64_t expectedChecksum = reader.read();
+    uint64_t checksum = emptyHash;
+    addToHash(checksum, reader.remaining());
+    if(reader.failed || checksum != expectedChecksum) {
+        return nullptr;
+    }
+
+    std::vector<Predicate> predicates;
+    std::vector<std::string> predicateNameTable;
+    for(uint64_t count = reader.readCount(); count > 0 && !reader.failed; --count) {
+        predicates.push_back(reader.readPredicate());
+        predicateNameTable.emplace_back(reader.readString());
+    }
+
+    Optional<PredicateReference> main;
+    if(reader.readByte()) {
+        main = reader.readPredicateReference();
+    }
+    reader.readTables(predicates.size());
+
+    if(reader.failed || !reader.atEnd()) {
+        return nullptr;
+    }
+
+    return std::make_unique<Program>(
+        predicates, main, predicateNameTable, config);
+}
+
+static std::filesystem::path imagePath(
+    const std::string &cacheDirectory,
+    uint64_t sourceHash
+) {
+    std::ostringstream name;
+    name << std::hex << sourceHash << ".alliumimage";
+    return std::filesystem::path(cacheDirectory) / name.str();
+}
+
+std::unique_ptr<Program> loadCachedProgram(
+    const std::string &cacheDirectory,
+    uint64_t sourceHash,
+    Config config
+) {
+    std::string path = imagePath(cacheDirectory, sourceHash).string();
+
+#ifndef _WIN32
+    int fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0) return nullptr;
+
+    struct stat info;
+    if(fstat(fd, &info) != 0 || info.st_size == 0) {
+        close(fd);
+        return nullptr;
+    }
+
+    void *image = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(image == MAP_FAILED) return nullptr;
+
+    std::unique_ptr<Program> program = readProgramImage(
+        std::string_view((const char *) image, info.st_size),
+        sourceHash,
+        config);
+    munmap(image, info.st_size);
+    return program;
+#else
+    std::ifstream file(path, std::ios::binary);
+    if(!file.is_open()) return nullptr;
+
+    std::ostringstream image;
+    image << file.rdbuf();
+    return readProgramImage(image.str(), sourceHash, config);
+#endif
+}
+
+void storeCachedProgram(
+    const std::string &cacheDirectory,
+    uint64_t sourceHash,
+    const Program &program
+) {
+    std::error_code error;
+    std::filesystem::create_directories(cacheDirectory, error);
+    if(error) return;
+
+    std::filesystem::path path = imagePath(cacheDirectory, sourceHash);
+    std::filesystem::path temporaryPath = path;
+    temporaryPath += "." + std::to_string(std::random_device()()) + ".tmp";
+
+    {
+        std::ofstream file(temporaryPath, std::ios::binary);
+        if(!file.is_open()) return;
+        writeProgramImage(program, sourceHash, file);
+        if(!file) {
+            file.close();
+            std::filesystem::remove(temporaryPath, error);
+            return;
+        }
+    }
+
+    std::filesystem::rename(temporaryPath, path, error);
+    if(error) std::filesystem::remove(temporaryPath, error);
+}
+
+} // namespace interpreter
@@ -0,0 +1,127 @@
+#include <llvm/BinaryFormat/Dwarf.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Path.h>
+
+#include "LLVMCodeGen/CGDebugInfo.h"
+
+/// Returns the file at `path`, described by its absolute path so that tools
+/// can find it from any working directory.
+static DIFile *createFile(DIBuilder &diBuilder, const std::string &path) {
+    SmallString<128> absolutePath(path);
+    sys::fs::make_absolute(absolutePath);
+    return diBuilder.createFile(
+        sys::path::filename(absolutePath),
+        sys::path::parent_path(absolutePath));
+}
+
+DebugInfoGenerator::DebugInfoGenerator(
+    Module &mod,
+    const std::vector<std::string> &sourceFiles,
+    const std::unordered_map<std::string, size_t> &predicateModules
+): diBuilder(mod) {
+    std::vector<DIFile*> files;
+    for(const std::string &path : sourceFiles) {
+        files.push_back(createFile(diBuilder, path));
+    }
+    if(files.empty()) {
+        files.push_back(diBuilder.createFile("<unknown>", ""));
+    }
+    for(const auto &[name, module] : predicateModules) {
+        predicateFiles.insert({ name, files.at(module) });
+    }
+
+    // DWARF has no language code for Allium.
+    compileUnit = diBuilder.createCompileUnit(
+        dwarf::DW_LANG_C,
+        files.front(),
+        "allium",
+        false,
+        "",
+        0,
+        "",
+        DICompileUnit::FullDebug);
+
+    mod.addModuleFlag(Module::Warning, "Debug Info Version", DEBUG_METADATA_VERSION);
+    mod.addModuleFlag(Module::Warning, "Dwarf Version", 4);
+}
+
+void DebugInfoGenerator::beginFunction(
+    IRBuilderBase &builder,
+    Function *func,
+    DIFile *file,
+    SourceLocation location,
+    bool isArtificial
+) {
+    unsigned line = std::max(location.lineNumber, 0);
+    DISubprogram::DISPFlags spFlags = DISubprogram::SPFlagDefinition;
+    if(func->hasLocalLinkage()) {
+        spFlags |= DISubprogram::SPFlagLocalToUnit;
+    }
+    DISubprogram *sp = diBuilder.createFunction(
+        file,
+        func->getName(),
+        StringRef(),
+        file,
+        line,
+        diBuilder.createSubroutineType(diBuilder.getOrCreateTypeArray({})),
+        line,
+        isArtificial ? DINode::FlagArtificial : DINode::FlagZero,
+        spFlags);
+    func->setSubprogram(sp);
+    builder.SetCurrentDebugLocation(
+        DILocation::get(func->getContext(), line, 0, sp));
+}
+
+void DebugInfoGenerator::beginPredicate(
+    IRBuilderBase &builder,
+    Function *func,
+    const TypedAST::PredicateDecl &pDecl
+) {
+    auto file = predicateFiles.find(pDecl.name.string());
+    beginFunction(
+        builder,
+        func,
+        file != predicateFiles.end() ? file->second : compileUnit->getFile(),
+        pDecl.location,
+        false);
+}
+
+void DebugInfoGenerator::beginNestedFunction(
+    IRBuilderBase &builder,
+    Function *func,
+    SourceLocation location
+) {
+    DIFile *file = compileUnit->getFile();
+    BasicBlock *bb = builder.GetInsertBlock();
+    if(bb && bb->getParent()->getSubprogram()) {
+        file = bb->getParent()->getSubprogram()->getFile();
+    }
+    if(location.lineNumber < 0) {
+        location = SourceLocation(builder.getCurrentDebugLocation().getLine(), 0);
+    }
+    beginFunction(builder, func, file, location, false);
+}
+
+void DebugInfoGenerator::beginSyntheticFunction(IRBuilderBase &builder, Function *func) {
+    beginFunction(builder, func, compileUnit->getFile(), SourceLocation(), true);
+}
+
+void DebugInfoGenerator::setLocation(IRBuilderBase &builder, SourceLocation location) {
+    // Synthesized code, such as main's reference to the main predicate, has no
+    // location of its own.
+    if(location.lineNumber < 0) {
+        return;
+    }
+
+    // The parser counts columns from zero, but DWARF counts them from one.
+    Function *func = builder.GetInsertBlock()->getParent();
+    builder.SetCurrentDebugLocation(DILocation::get(
+        func->getContext(),
+        location.lineNumber,
+        location.columnNumber + 1,
+        func->getSubprogram()));
+}
+
+void DebugInfoGenerator::finalize() {
+    diBuilder.finalize();
+}
@@ -1,5 +1,15 @@
+#include <algorithm>
+#include <set>
+
+#include <llvm/Transforms/Utils/ModuleUtils.h>
+
 #include "LLVMCodeGen/CGPred.h"
+#include "LLVMCodeGen/CGType.h"
+#include "LLVMCodeGen/CountInstrumentor.h"
+#include "LLVMCodeGen/LibraryAPI.h"
 #include "LLVMCodeGen/LogInstrumentor.h"
+#include "LLVMCodeGen/ProfileInstrumentor.h"
+#include "SemAna/Builtins.h"
 #include "SemAna/TypedAST.h"
 #include "SemAna/VariableAnalysis.h"
 
@@ -19,10 +29,226 @@ FunctionType *PredicateGenerator::getPredIRType(const TypedAST::PredicateDecl &p
         Type *typePtr = PointerType::get(type, 0);
         paramTypes.push_back(typePtr);
     }
-    return FunctionType::get(i8ptr, paramTypes, false);
+    paramTypes.push_back(PointerType::get(getHandlerIRType(), 0));
+
+    // A semideterministic predicate returns whether it has a witness, rather
+    // than the handle of a coroutine.
+    Type *returnType = cg.semideterministicPredicates.contains(pred.name) ?
+        Type::getInt1Ty(ctx) :
+        i8ptr;
+    return FunctionType::get(returnType, paramTypes, false);
+}
+
+StructType *PredicateGenerator::getHandlerIRType() {
+    StructType *handlerType = StructType::getTypeByName(ctx, "__allium_handler");
+    if(handlerType) {
+        return handlerType;
+    }
+
+    // This must match handler_t in the runtime library.
+    handlerType = StructType::create(ctx, "__allium_handler");
+    handlerType->setBody({
+        PointerType::get(handlerType, 0),
+        Type::getInt32Ty(ctx),
+        PointerType::get(Type::getInt8PtrTy(ctx), 0) });
+    return handlerType;
+}
+
+StructType *PredicateGenerator::getContinuationIRType() {
+    StructType *kType = StructType::getTypeByName(ctx, "__allium_continuation");
+    if(kType) {
+        return kType;
+    }
+
+    kType = StructType::create(ctx, "__allium_continuation");
+    kType->setBody({
+        PointerType::get(getContinuationFuncType(), 0),
+        PointerType::get(Type::getInt8PtrTy(ctx), 0),
+        PointerType::get(getHandlerIRType(), 0) });
+    return kType;
+}
+
+FunctionType *PredicateGenerator::getContinuationFuncType() {
+    // A continuation's environment is an array of pointers to the variables
+    // which were in scope where the effect occurred.
+    Type *i8ptr = Type::getInt8PtrTy(ctx);
+    return FunctionType::get(
+        i8ptr,
+        {
+            PointerType::get(i8ptr, 0),
+            PointerType::get(getHandlerIRType(), 0)
+        },
+        false);
+}
+
+FunctionType *PredicateGenerator::getHandlerFuncType(const TypedAST::EffectCtor &eCtor) {
+    std::vector<Type*> paramTypes;
+    for(const TypedAST::Parameter &param : eCtor.parameters) {
+        paramTypes.push_back(PointerType::get(getTypeIRType(param.type), 0));
+    }
+    paramTypes.push_back(PointerType::get(getContinuationIRType(), 0));
+    paramTypes.push_back(PointerType::get(getHandlerIRType(), 0));
+    return FunctionType::get(Type::getInt8PtrTy(ctx), paramTypes, false);
+}
+
+unsigned PredicateGenerator::getEffectID(const Name<TypedAST::Effect> &effect) {
+    for(size_t i=0; i<TypedAST::builtinEffects.size(); ++i) {
+        if(TypedAST::builtinEffects[i].declaration.name == effect) {
+            return i;
+        }
+    }
+    for(size_t i=0; i<ast.getEffects().size(); ++i) {
+        if(ast.getEffects()[i].declaration.name == effect) {
+            return TypedAST::builtinEffects.size() + i;
+        }
+    }
+    assert(false && "unknown effect!");
+    return 0;
 }
 
-void PredicateGenerator::lower(
+BasicBlock *PredicateGenerator::callCoroutine(
+    FunctionType *type,
+    Value *callee,
+    ArrayRef<Value*> arguments,
+    BasicBlock *fail
+) {
+    Function *f = builder.GetInsertBlock()->getParent();
+    BasicBlock *retry = BasicBlock::Create(ctx, "retry", f);
+    BasicBlock *exhausted = BasicBlock::Create(ctx, "exhausted", f);
+    BasicBlock *success = BasicBlock::Create(ctx, "", f);
+    Function *coroDone = Intrinsic::getDeclaration(&mod, Intrinsic::coro_done);
+    Function *coroResume = Intrinsic::getDeclaration(&mod, Intrinsic::coro_resume);
+    Function *coroDestroy = Intrinsic::getDeclaration(&mod, Intrinsic::coro_destroy);
+
+    // A coroutine with no more witnesses is destroyed right away. Otherwise,
+    // values in its frame may be bound to variables of the caller, so it lives
+    // until the proof backtracks past this point. Its handle is kept in a slot
+    // so that it can be destroyed along with the calling coroutine.
+    Value *slot = nullptr;
+    if(currentCoroutine) {
+        Type *i8ptr = Type::getInt8PtrTy(ctx);
+        IRBuilder<> entryBuilder(currentCoroutine->entry);
+        slot = entryBuilder.CreateAlloca(i8ptr, nullptr, "hdl.slot");
+        entryBuilder.CreateStore(ConstantPointerNull::get(Type::getInt8PtrTy(ctx)), slot);
+        currentCoroutine->handleSlots.push_back(slot);
+    }
+
+    //   %hdl = call i8* @callee(...)
+    //   %done = call i1 @llvm.coro.done(i8* %hdl)
+    //   br i1 %done, label %exhausted, label %success
+    // retry:
+    //   call void @llvm.coro.resume(i8* %hdl)
+    //   %done = call i1 @llvm.coro.done(i8* %hdl)
+    //   br i1 %done, label %exhausted, label %success
+    // exhausted:
+    //   call void @llvm.coro.destroy(i8* %hdl)
+    //   store i8* null, i8** %hdl.slot
+    //   br label %fail
+    // success:
+    //   store i8* %hdl, i8** %hdl.slot
+    Value *hdl = builder.CreateCall(type, callee, arguments, "hdl");
+    Value *done = builder.CreateCall(
+        coroDone->getFunctionType(),
+        coroDone,
+        { hdl },
+        "done");
+    builder.CreateCondBr(done, exhausted, success);
+
+    builder.SetInsertPoint(retry);
+    builder.CreateCall(coroResume->getFunctionType(), coroResume, { hdl });
+    done = builder.CreateCall(
+        coroDone->getFunctionType(),
+        coroDone,
+        { hdl },
+        "done");
+    builder.CreateCondBr(done, exhausted, success);
+
+    builder.SetInsertPoint(exhausted);
+    builder.CreateCall(coroDestroy->getFunctionType(), coroDestroy, { hdl });
+    if(slot) {
+        builder.CreateStore(ConstantPointerNull::get(Type::getInt8PtrTy(ctx)), slot);
+    }
+    builder.CreateBr(fail);
+
+    builder.SetInsertPoint(success);
+    if(slot) {
+        builder.CreateStore(hdl, slot);
+    }
+    return retry;
+}
+
+void PredicateGenerator::destroyHandles(PredCoroutine &coro, size_t firstSlot) {
+    Type *i8ptr = Type::getInt8PtrTy(ctx);
+    Function *coroDestroy = Intrinsic::getDeclaration(&mod, Intrinsic::coro_destroy);
+
+    // Coroutines are destroyed in the reverse of the order they were created,
+    // so that their frames are freed in LIFO order.
+    for(size_t i = coro.handleSlots.size(); i-- > firstSlot; ) {
+        Value *slot = coro.handleSlots[i];
+        BasicBlock *destroy = BasicBlock::Create(ctx, "destroy", coro.func);
+        BasicBlock *next = BasicBlock::Create(ctx, "", coro.func);
+
+        Value *hdl = builder.CreateLoad(i8ptr, slot, "hdl");
+        Value *isNull = builder.CreateIsNull(hdl);
+        builder.CreateCondBr(isNull, next, destroy);
+
+        builder.SetInsertPoint(destroy);
+        builder.CreateCall(coroDestroy->getFunctionType(), coroDestroy, { hdl });
+        builder.CreateStore(ConstantPointerNull::get(Type::getInt8PtrTy(ctx)), slot);
+        builder.CreateBr(next);
+
+        builder.SetInsertPoint(next);
+    }
+}
+
+BasicBlock *PredicateGenerator::lowerAlternative(
+    PredCoroutine &coro,
+    BasicBlock *next,
+    const std::function<BasicBlock*(BasicBlock*)> &lowerBody
+) {
+    BasicBlock *bb = BasicBlock::Create(ctx, "", coro.func, next);
+    BasicBlock *unwind = BasicBlock::Create(ctx, "unwind", coro.func, next);
+    size_t firstSlot = coro.handleSlots.size();
+    IntegerType *markType = mod.getDataLayout().getIntPtrType(ctx);
+
+    builder.SetInsertPoint(bb);
+    FunctionCallee trailMark = mod.getOrInsertFunction(
+        "__allium_trail_mark",
+        FunctionType::get(markType, {}, false));
+    Value *mark = builder.CreateCall(trailMark, {}, "mark");
+    BasicBlock *retry = lowerBody(unwind);
+
+    // There should be one non-final suspend at the end of each alternative,
+    // which is used if a witness is found for it. When the coroutine is
+    // resumed, it backtracks into the alternative's body. Once the body has
+    // no more witnesses, the bindings made by this alternative are undone and
+    // the coroutines which it called are destroyed before trying the next
+    // one. Bindings are undone first, since some of them may be in the frames
+    // of those coroutines.
+    addWitnessSuspend(coro, retry);
+
+    builder.SetInsertPoint(unwind);
+    FunctionCallee trailUndo = mod.getOrInsertFunction(
+        "__allium_trail_undo",
+        FunctionType::get(Type::getVoidTy(ctx), { markType }, false));
+    builder.CreateCall(trailUndo, { mark });
+    destroyHandles(coro, firstSlot);
+    builder.CreateBr(next);
+
+    return bb;
+}
+
+void PredicateGenerator::finishCoroutine(PredCoroutine &coro, BasicBlock *first) {
+    // Any coroutines which are still alive are destroyed along with this one.
+    builder.SetInsertPoint(coro.cleanup);
+    destroyHandles(coro, 0);
+    builder.CreateBr(coro.freeFrame);
+
+    builder.SetInsertPoint(coro.entry);
+    builder.CreateBr(first);
+}
+
+BasicBlock *PredicateGenerator::lower(
     const Scope &scope,
     const TypedAST::TruthLiteral &tl,
     BasicBlock *fail
@@ -37,74 +263,489 @@ void PredicateGenerator::lower(
         BasicBlock *dead = BasicBlock::Create(ctx, "dead.code", f);
         builder.SetInsertPoint(dead);
     }
+    return fail;
 }
 
-void PredicateGenerator::lower(
+BasicBlock *PredicateGenerator::lower(
     const Scope &scope,
     const TypedAST::PredicateRef &pr,
     BasicBlock *fail
 ) {
+    auto predicate = ast.resolvePredicateRef(pr);
+    const TypedAST::BuiltinPredicate *bp;
+    if(predicate.as_a<const TypedAST::BuiltinPredicate*>().unwrapInto(bp)) {
+        return lowerBuiltinCall(scope, *bp, pr, fail);
+    }
+
+    if(cg.debugInfo) {
+        cg.debugInfo->setLocation(builder, pr.location);
+    }
+
+    const auto &pDecl = predicate.getDeclaration();
+    Function *pFunc = getPredFunc(pDecl);
+
+    if(cg.instrumentWithLogs) {
+        LogInstrumentor(cg).logSubproof(pr);
+    }
+
+    std::vector<Value*> arguments;
+    for(size_t i=0; i<pr.arguments.size(); ++i) {
+        AlliumType type = cg.loweredTypes.at(pDecl.parameters[i].type);
+        arguments.push_back(lower(scope, type, pr.arguments[i]));
+    }
+    arguments.push_back(handlers);
+
+    if(cg.semideterministicPredicates.contains(pr.name)) {
+        // call tailcc i1 @pred(...)
+        // br i1 %proven, label %proven, label %fail
+        CallInst *proven = builder.CreateCall(pFunc, arguments, "proven");
+        proven->setCallingConv(pFunc->getCallingConv());
+        Function *f = builder.GetInsertBlock()->getParent();
+        BasicBlock *success = BasicBlock::Create(ctx, "proven", f);
+        builder.CreateCondBr(proven, success, fail);
+        builder.SetInsertPoint(success);
+
+        // Like a builtin predicate, it has no more witnesses to retry.
+        return fail;
+    }
+
+    return callCoroutine(pFunc->getFunctionType(), pFunc, arguments, fail);
+}
+
+void PredicateGenerator::lowerTailCall(
+    const Scope &scope,
+    const TypedAST::PredicateRef &pr,
+    Value *mark
+) {
+    if(cg.debugInfo) {
+        cg.debugInfo->setLocation(builder, pr.location);
+    }
+
     const auto &pDecl = ast.resolvePredicateRef(pr).getDeclaration();
-    FunctionCallee pFunc = mod.getOrInsertFunction(
-        mangledPredName(pr.name),
-        getPredIRType(pDecl));
+    Function *pFunc = getPredFunc(pDecl);
 
     if(cg.instrumentWithLogs) {
         LogInstrumentor(cg).logSubproof(pr);
     }
 
-    Function *f = builder.GetInsertBlock()->getParent();
-    BasicBlock *success = BasicBlock::Create(ctx, "", f);
+    // Each argument is a variable from the head, which is bound to part of
+    // the caller's arguments. Passing that value, rather than the variable,
+    // means that nothing refers to this function's frame, which the tail call
+    // replaces. For the same reason, the bindings of this function's
+    // variables are undone before the call rather than after it.
+    std::vector<Value*> arguments;
+    for(size_t i=0; i<pr.arguments.size(); ++i) {
+        AlliumType type = cg.loweredTypes.at(pDecl.parameters[i].type);
+        arguments.push_back(loadValue(builder, mod, type, lower(scope, type, pr.arguments[i])));
+    }
+    arguments.push_back(handlers);
+
+    FunctionCallee trailUndo = mod.getOrInsertFunction(
+        "__allium_trail_undo",
+        FunctionType::get(Type::getVoidTy(ctx), { mark->getType() }, false));
+    builder.CreateCall(trailUndo, { mark });
 
+    // %proven = musttail call tailcc i1 @pred(...)
+    // ret i1 %proven
+    CallInst *proven = builder.CreateCall(pFunc, arguments, "proven");
+    proven->setCallingConv(pFunc->getCallingConv());
+    proven->setTailCallKind(CallInst::TCK_MustTail);
+    builder.CreateRet(proven);
+}
+
+BasicBlock *PredicateGenerator::lowerBuiltinCall(
+    const Scope &scope,
+    const TypedAST::BuiltinPredicate &bp,
+    const TypedAST::PredicateRef &pr,
+    BasicBlock *fail
+) {
+    const auto &pDecl = bp.declaration;
+    std::vector<Type*> parameterTypes;
     std::vector<Value*> arguments;
     for(size_t i=0; i<pr.arguments.size(); ++i) {
         AlliumType type = cg.loweredTypes.at(pDecl.parameters[i].type);
+        parameterTypes.push_back(PointerType::get(type.irType, 0));
         arguments.push_back(lower(scope, type, pr.arguments[i]));
     }
 
-    Value *hdl = builder.CreateCall(pFunc, arguments, "hdl");
-    Function *coroDone = Intrinsic::getDeclaration(&mod, Intrinsic::coro_done);
-    Value *done = builder.CreateCall(
-        coroDone->getFunctionType(),
-        coroDone,
-        { hdl },
-        "done");
-
-    builder.CreateCondBr(done, fail, success);
+    // call i1 @__allium_<name>(T0* %arg0, ...)
+    // br i1 %proven, label %builtin.proven, label %fail
+    FunctionCallee builtin = mod.getOrInsertFunction(
+        "__allium_" + pDecl.name.string(),
+        FunctionType::get(builder.getInt1Ty(), parameterTypes, false));
+    Value *proven = builder.CreateCall(builtin, arguments, "proven");
+    Function *f = builder.GetInsertBlock()->getParent();
+    BasicBlock *success = BasicBlock::Create(ctx, "builtin.proven", f);
+    builder.CreateCondBr(proven, success, fail);
     builder.SetInsertPoint(success);
+
+    // A builtin predicate has no more witnesses to retry.
+    return fail;
 }
 
-void PredicateGenerator::lower(
+BasicBlock *PredicateGenerator::lower(
+    const Scope &scope,
+    const TypedAST::EffectCtorRef &ecr,
+    BasicBlock *fail
+) {
+    if(cg.debugInfo) {
+        cg.debugInfo->setLocation(builder, ecr.location);
+    }
+    if(cg.instrumentWithLogs) {
+        LogInstrumentor(cg).logEffect(ecr);
+    }
+
+    const TypedAST::Effect &effect = ast.resolveEffectRef(ecr.effectName);
+    const TypedAST::EffectCtor &eCtor = ast.resolveEffectCtorRef(
+        ecr.effectName,
+        ecr.ctorName);
+    size_t ctorIndex = &eCtor - effect.constructors.data();
+
+    std::vector<Value*> arguments;
+    for(size_t i=0; i<ecr.arguments.size(); ++i) {
+        AlliumType type = cg.loweredTypes.at(eCtor.parameters[i].type);
+        arguments.push_back(lower(scope, type, ecr.arguments[i]));
+    }
+
+    // The continuation closes over all of the variables in scope, so that the
+    // handler can prove it in the context where the effect occurred.
+    Function *kFunc = lowerContinuation(scope, ecr.getContinuation());
+
+    Type *i8ptr = Type::getInt8PtrTy(ctx);
+    Value *env = builder.CreateAlloca(
+        i8ptr,
+        ConstantInt::get(Type::getInt32Ty(ctx), scope.size()),
+        "k.env");
+    unsigned i = 0;
+    for(const auto &[name, var] : scope) {
+        Value *slot = builder.CreateConstGEP1_32(i8ptr, env, i++);
+        builder.CreateStore(builder.CreatePointerCast(var, i8ptr), slot);
+    }
+
+    StructType *kType = getContinuationIRType();
+    Value *k = builder.CreateAlloca(kType, nullptr, "k");
+    builder.CreateStore(kFunc, builder.CreateStructGEP(kType, k, 0));
+    builder.CreateStore(env, builder.CreateStructGEP(kType, k, 1));
+    builder.CreateStore(handlers, builder.CreateStructGEP(kType, k, 2));
+    arguments.push_back(k);
+
+    // The body of a handler is proven with the handlers which enclose it, so
+    // any effects it performs are handled by the handling predicate's callers.
+    StructType *handlerType = getHandlerIRType();
+    PointerType *handlerPtr = PointerType::get(handlerType, 0);
+    FunctionCallee findHandler = mod.getOrInsertFunction(
+        "__allium_find_handler",
+        FunctionType::get(
+            handlerPtr,
+            { handlerPtr, Type::getInt32Ty(ctx) },
+            false));
+    Value *handler = builder.CreateCall(
+        findHandler,
+        {
+            handlers,
+            ConstantInt::get(Type::getInt32Ty(ctx), getEffectID(ecr.effectName))
+        },
+        "handler");
+    Value *next = builder.CreateLoad(
+        handlerPtr,
+        builder.CreateStructGEP(handlerType, handler, 0),
+        "handler.next");
+    arguments.push_back(next);
+
+    Value *ctors = builder.CreateLoad(
+        PointerType::get(i8ptr, 0),
+        builder.CreateStructGEP(handlerType, handler, 2),
+        "handler.ctors");
+    Value *ctor = builder.CreateLoad(
+        i8ptr,
+        builder.CreateConstGEP1_32(i8ptr, ctors, ctorIndex),
+        "handler.ctor");
+    FunctionType *ctorType = getHandlerFuncType(eCtor);
+    return callCoroutine(
+        ctorType,
+        builder.CreatePointerCast(ctor, PointerType::get(ctorType, 0)),
+        arguments,
+        fail);
+}
+
+BasicBlock *PredicateGenerator::lower(
+    const Scope &scope,
+    const TypedAST::Continuation &k,
+    BasicBlock *fail
+) {
+    assert(continuation && "continue must occur inside of a handler!");
+
+    StructType *kType = getContinuationIRType();
+    FunctionType *kFuncType = getContinuationFuncType();
+    Value *kFunc = builder.CreateLoad(
+        PointerType::get(kFuncType, 0),
+        builder.CreateStructGEP(kType, continuation, 0),
+        "k.func");
+    Value *env = builder.CreateLoad(
+        PointerType::get(Type::getInt8PtrTy(ctx), 0),
+        builder.CreateStructGEP(kType, continuation, 1),
+        "k.env");
+    Value *kHandlers = builder.CreateLoad(
+        PointerType::get(getHandlerIRType(), 0),
+        builder.CreateStructGEP(kType, continuation, 2),
+        "k.handlers");
+    return callCoroutine(kFuncType, kFunc, { env, kHandlers }, fail);
+}
+
+BasicBlock *PredicateGenerator::lower(
     const Scope &scope,
     const TypedAST::Conjunction &conj,
     BasicBlock *fail
 ) {
-    lower(scope, conj.getLeft(), fail);
-    lower(scope, conj.getRight(), fail);
+    // If the right side fails, backtrack into the left side.
+    BasicBlock *retryLeft = lower(scope, conj.getLeft(), fail);
+    return lower(scope, conj.getRight(), retryLeft);
+}
+
+BasicBlock *PredicateGenerator::lower(
+    const Scope &scope,
+    const TypedAST::HandlerConjunction &hConj,
+    BasicBlock *fail
+) {
+    BasicBlock *retryLeft = lower(scope, hConj.getLeft(), fail);
+    return lower(scope, hConj.getRight(), retryLeft);
 }
 
-void PredicateGenerator::lower(
+BasicBlock *PredicateGenerator::lower(
     const Scope &scope,
     const TypedAST::Expression &expr,
     BasicBlock *fail
 ) {
-    expr.switchOver(
-    [&](TypedAST::TruthLiteral &tl) { lower(scope, tl, fail); },
-    [&](TypedAST::PredicateRef &pr) { lower(scope, pr, fail); },
-    [](TypedAST::EffectCtorRef &ecr) { assert(false && "not implemented!"); },
-    [&](TypedAST::Conjunction &conj) { lower(scope, conj, fail); }
+    return expr.match<BasicBlock*>(
+    [&](TypedAST::TruthLiteral &tl) { return lower(scope, tl, fail); },
+    [&](TypedAST::PredicateRef &pr) { return lower(scope, pr, fail); },
+    [&](TypedAST::EffectCtorRef &ecr) { return lower(scope, ecr, fail); },
+    [&](TypedAST::Conjunction &conj) { return lower(scope, conj, fail); }
     );
 }
 
-PredCoroutine PredicateGenerator::createPredicateCoroutine(const TypedAST::PredicateDecl &pDecl) {
-    PredCoroutine coro;
+BasicBlock *PredicateGenerator::lower(
+    const Scope &scope,
+    const TypedAST::HandlerExpression &hExpr,
+    BasicBlock *fail
+) {
+    return hExpr.match<BasicBlock*>(
+    [&](TypedAST::TruthLiteral &tl) { return lower(scope, tl, fail); },
+    [&](TypedAST::Continuation &k) { return lower(scope, k, fail); },
+    [&](TypedAST::PredicateRef &pr) { return lower(scope, pr, fail); },
+    [&](TypedAST::EffectCtorRef &ecr) { return lower(scope, ecr, fail); },
+    [&](TypedAST::HandlerConjunction &hConj) { return lower(scope, hConj, fail); }
+    );
+}
+
+Function *PredicateGenerator::lowerContinuation(
+    const Scope &scope,
+    const TypedAST::Expression &expr
+) {
+    IRBuilderBase::InsertPointGuard guard(builder);
+    Value *enclosingHandlers = handlers;
+    PredCoroutine *enclosingCoroutine = currentCoroutine;
+
+    Function *enclosing = builder.GetInsertBlock()->getParent();
+    Function *func = Function::Create(
+        getContinuationFuncType(),
+        GlobalValue::LinkageTypes::InternalLinkage,
+        enclosing->getName() + ".k",
+        mod);
+    if(cg.debugInfo) {
+        cg.debugInfo->beginNestedFunction(builder, func, SourceLocation());
+    }
+    PredCoroutine coro = createCoroutine(func);
+    currentCoroutine = &coro;
+    handlers = func->getArg(1);
+
+    BasicBlock *body = lowerAlternative(coro, coro.finalSuspend, [&](BasicBlock *fail) {
+        // Recover the variables from the environment, which has an entry for
+        // each variable in the same order as the scope.
+        Type *i8ptr = Type::getInt8PtrTy(ctx);
+        Scope kScope;
+        unsigned i = 0;
+        for(const auto &[name, var] : scope) {
+            Value *slot = builder.CreateConstGEP1_32(i8ptr, func->getArg(0), i++);
+            Value *ptr = builder.CreateLoad(i8ptr, slot);
+            kScope.insert({ name, builder.CreatePointerCast(ptr, var->getType()) });
+        }
+
+        return lower(kScope, expr, fail);
+    });
+    finishCoroutine(coro, body);
+
+    handlers = enclosingHandlers;
+    currentCoroutine = enclosingCoroutine;
+    return func;
+}
+
+static Constant *createHandlerTable(
+    Module &mod,
+    const Twine &name,
+    std::vector<Constant*> ctors
+) {
+    Type *i8ptr = Type::getInt8PtrTy(mod.getContext());
+    ArrayType *tableType = ArrayType::get(i8ptr, ctors.size());
+    GlobalVariable *table = new GlobalVariable(
+        mod,
+        tableType,
+        true,
+        GlobalValue::LinkageTypes::PrivateLinkage,
+        ConstantArray::get(tableType, ctors),
+        name);
+    return ConstantExpr::getPointerCast(table, PointerType::get(i8ptr, 0));
+}
+
+void PredicateGenerator::pushHandler(
+    const Name<TypedAST::Effect> &effect,
+    Constant *ctors
+) {
+    StructType *handlerType = getHandlerIRType();
+    Value *handler = builder.CreateAlloca(handlerType, nullptr, "handler");
+    builder.CreateStore(
+        handlers,
+        builder.CreateStructGEP(handlerType, handler, 0));
+    builder.CreateStore(
+        ConstantInt::get(Type::getInt32Ty(ctx), getEffectID(effect)),
+        builder.CreateStructGEP(handlerType, handler, 1));
+    builder.CreateStore(
+        ctors,
+        builder.CreateStructGEP(handlerType, handler, 2));
+    handlers = handler;
+}
+
+Constant *PredicateGenerator::lower(
+    const TypedAST::UserPredicate &pred,
+    const TypedAST::Handler &handler
+) {
+    IRBuilderBase::InsertPointGuard guard(builder);
+    Value *enclosingHandlers = handlers;
+    Value *enclosingContinuation = continuation;
+    PredCoroutine *enclosingCoroutine = currentCoroutine;
+
+    const TypedAST::Effect &effect = ast.resolveEffectRef(handler.effect);
+    std::string prefix = mangledPredName(pred.declaration.name) +
+        ".handle." + handler.effect.string() + ".";
+
+    std::vector<Constant*> ctors;
+    for(const auto &eCtor : effect.constructors) {
+        Function *func = Function::Create(
+            getHandlerFuncType(eCtor),
+            GlobalValue::LinkageTypes::InternalLinkage,
+            prefix + eCtor.name.string(),
+            mod);
+        if(cg.debugInfo) {
+            cg.debugInfo->beginNestedFunction(builder, func, SourceLocation());
+        }
+        PredCoroutine coro = createCoroutine(func);
+        currentCoroutine = &coro;
+
+        size_t n = eCtor.parameters.size();
+        continuation = func->getArg(n);
+        handlers = func->getArg(n + 1);
 
-    coro.func = cast<Function>(
+        // As with predicates, iterate backwards so that the "next" basic block
+        // always exists already.
+        BasicBlock *nextBB = coro.finalSuspend;
+        for(auto hImpl = handler.implications.rbegin();
+                hImpl != handler.implications.rend(); hImpl++) {
+            if(hImpl->head.ctorName != eCtor.name) {
+                continue;
+            }
+
+            nextBB = lowerAlternative(coro, nextBB, [&](BasicBlock *fail) {
+                if(cg.debugInfo) {
+                    cg.debugInfo->setLocation(builder, hImpl->head.location);
+                }
+                Scope scope = allocateVariables(getVariables(ast, *hImpl));
+                unifyHead(scope, func, eCtor.parameters, hImpl->head.arguments, fail);
+                return lower(scope, hImpl->body, fail);
+            });
+        }
+        finishCoroutine(coro, nextBB);
+
+        ctors.push_back(ConstantExpr::getPointerCast(func, Type::getInt8PtrTy(ctx)));
+    }
+
+    handlers = enclosingHandlers;
+    continuation = enclosingContinuation;
+    currentCoroutine = enclosingCoroutine;
+    return createHandlerTable(mod, prefix + "table", ctors);
+}
+
+Constant *PredicateGenerator::lowerBuiltinIOHandler() {
+    IRBuilderBase::InsertPointGuard guard(builder);
+    Value *enclosingContinuation = continuation;
+    PredCoroutine *enclosingCoroutine = currentCoroutine;
+
+    const TypedAST::EffectCtor &print = ast.resolveEffectCtorRef("IO", "print");
+    Function *func = Function::Create(
+        getHandlerFuncType(print),
+        GlobalValue::LinkageTypes::InternalLinkage,
+        "__allium_handle.IO.print",
+        mod);
+    if(cg.debugInfo) {
+        cg.debugInfo->beginSyntheticFunction(builder, func);
+    }
+    PredCoroutine coro = createCoroutine(func);
+    currentCoroutine = &coro;
+    continuation = func->getArg(1);
+
+    BasicBlock *body = lowerAlternative(coro, coro.finalSuspend, [&](BasicBlock *fail) {
+        // The runtime library performs the effect, after which the handler
+        // proves its continuation exactly once.
+        FunctionCallee performPrint = mod.getOrInsertFunction(
+            "__allium_print",
+            FunctionType::get(
+                Type::getVoidTy(ctx),
+                { func->getArg(0)->getType() },
+                false));
+        builder.CreateCall(performPrint, { func->getArg(0) });
+        return lower({}, TypedAST::Continuation(), fail);
+    });
+    finishCoroutine(coro, body);
+
+    continuation = enclosingContinuation;
+    currentCoroutine = enclosingCoroutine;
+
+    return createHandlerTable(
+        mod,
+        "__allium_handle.IO.table",
+        { ConstantExpr::getPointerCast(func, Type::getInt8PtrTy(ctx)) });
+}
+
+Function *PredicateGenerator::getPredFunc(const TypedAST::PredicateDecl &pDecl) {
+    Function *func = cast<Function>(
         mod.getOrInsertFunction(
             mangledPredName(pDecl.name),
             getPredIRType(pDecl)
         ).getCallee());
-    coro.func->setLinkage(GlobalValue::LinkageTypes::ExternalLinkage);
+
+    // Semideterministic predicates use the tail calling convention, which
+    // allows a guaranteed tail call between functions with different
+    // parameters.
+    if(cg.semideterministicPredicates.contains(pDecl.name)) {
+        func->setCallingConv(CallingConv::Tail);
+    }
+    return func;
+}
+
+PredCoroutine PredicateGenerator::createPredicateCoroutine(const TypedAST::PredicateDecl &pDecl) {
+    Function *func = getPredFunc(pDecl);
+    func->setLinkage(GlobalValue::LinkageTypes::ExternalLinkage);
+
+    // The subprogram must exist before any code is generated, since calls to
+    // other predicates need a location within it.
+    if(cg.debugInfo) {
+        cg.debugInfo->beginPredicate(builder, func, pDecl);
+    }
+    return createCoroutine(func);
+}
+
+PredCoroutine PredicateGenerator::createCoroutine(Function *func) {
+    PredCoroutine coro;
+    coro.func = func;
     coro.func->addFnAttr("coroutine.presplit", "0");
 
     // This initializes coro's id and handle, so it must precede the other
@@ -114,6 +755,7 @@ PredCoroutine PredicateGenerator::createPredicateCoroutine(const TypedAST::Predi
 
     coro.finalSuspend = BasicBlock::Create(ctx, "final.suspend", coro.func);
     coro.cleanup = BasicBlock::Create(ctx, "cleanup", coro.func);
+    coro.freeFrame = BasicBlock::Create(ctx, "free.frame", coro.func);
     coro.end = BasicBlock::Create(ctx, "end", coro.func);
 
     addFinalSuspend(coro);
@@ -124,16 +766,28 @@ PredCoroutine PredicateGenerator::createPredicateCoroutine(const TypedAST::Predi
 }
 
 void PredicateGenerator::addCoroutineInitialization(PredCoroutine &coro) {
+    IntegerType *sizeType = mod.getDataLayout().getIntPtrType(ctx);
     Function *coroId = Intrinsic::getDeclaration(&mod, Intrinsic::coro_id);
-    Function *coroSize = Intrinsic::getDeclaration(&mod, Intrinsic::coro_size, { IntegerType::get(ctx, 32) });
+    Function *coroAlloc = Intrinsic::getDeclaration(&mod, Intrinsic::coro_alloc);
+    Function *coroSize = Intrinsic::getDeclaration(&mod, Intrinsic::coro_size, { sizeType });
     Function *coroBegin = Intrinsic::getDeclaration(&mod, Intrinsic::coro_begin);
-    
+
+    // Frames are allocated by the runtime library, unless LLVM is able to
+    // elide the allocation.
     // entry:
     //   %id = call token @llvm.coro.id(i32 0, i8* null, i8* null, i8* null)
-    //   %size = call i32 @llvm.coro.size.i32()
-    //   %alloc = call i8* @malloc(i32 %size)
-    //   %hdl = call i8* @llvm.coro.begin(token %id, i8* %alloc)
+    //   %need.alloc = call i1 @llvm.coro.alloc(token %id)
+    //   br i1 %need.alloc, label %alloc, label %begin
+    // alloc:
+    //   %size = call i64 @llvm.coro.size.i64()
+    //   %frame = call i8* @__allium_frame_alloc(i64 %size)
+    //   br label %begin
+    // begin:
+    //   %mem = phi i8* [ null, %entry ], [ %frame, %alloc ]
+    //   %hdl = call i8* @llvm.coro.begin(token %id, i8* %mem)
     BasicBlock *entry = BasicBlock::Create(ctx, "entry", coro.func);
+    BasicBlock *alloc = BasicBlock::Create(ctx, "alloc", coro.func);
+    coro.entry = BasicBlock::Create(ctx, "begin", coro.func);
     builder.SetInsertPoint(entry);
 
     PointerType *i8ptr = Type::getInt8PtrTy(ctx);
@@ -147,18 +801,29 @@ void PredicateGenerator::addCoroutineInitialization(PredCoroutine &coro) {
             ConstantPointerNull::get(i8ptr),
         },
         "id");
+    Value *needAlloc = builder.CreateCall(
+        coroAlloc->getFunctionType(),
+        coroAlloc,
+        { coro.id },
+        "need.alloc");
+    builder.CreateCondBr(needAlloc, alloc, coro.entry);
 
+    builder.SetInsertPoint(alloc);
     Value *size = builder.CreateCall(coroSize->getFunctionType(), coroSize, {}, "size");
+    FunctionCallee frameAlloc = mod.getOrInsertFunction(
+        "__allium_frame_alloc",
+        FunctionType::get(i8ptr, { sizeType }, false));
+    Value *frame = builder.CreateCall(frameAlloc, { size }, "frame");
+    builder.CreateBr(coro.entry);
 
-    FunctionCallee malloc = mod.getOrInsertFunction(
-        "malloc",
-        FunctionType::get(i8ptr, { IntegerType::get(ctx, 32) }, false));
-    Value *alloc = builder.CreateCall(malloc, { size }, "alloc");
-
+    builder.SetInsertPoint(coro.entry);
+    PHINode *mem = builder.CreatePHI(i8ptr, 2, "mem");
+    mem->addIncoming(ConstantPointerNull::get(i8ptr), entry);
+    mem->addIncoming(frame, alloc);
     coro.handle = builder.CreateCall(
         coroBegin->getFunctionType(),
         coroBegin,
-        { coro.id, alloc },
+        { coro.id, mem },
         "hdl");
 }
 
@@ -208,94 +873,585 @@ void PredicateGenerator::addExitPoint(PredCoroutine &coro) {
 void PredicateGenerator::addCleanup(PredCoroutine &coro) {
     Function *coroFree = Intrinsic::getDeclaration(&mod, Intrinsic::coro_free);
 
-    // cleanup:
+    // The cleanup block itself destroys the coroutines which this one called,
+    // which are only known once it has been lowered (see finishCoroutine).
+    // free.frame:
     //   %mem = call i8* @llvm.coro.free(token %id, i8* %hdl)
-    //   call void @free(i8* %mem)
+    //   %elided = icmp eq i8* %mem, null
+    //   br i1 %elided, label %end, label %free
+    // free:
+    //   call void @__allium_frame_free(i8* %mem)
     //   br label %end
-    builder.SetInsertPoint(coro.cleanup);
+    BasicBlock *free = BasicBlock::Create(ctx, "free", coro.func, coro.end);
+    builder.SetInsertPoint(coro.freeFrame);
     Value *mem = builder.CreateCall(coroFree, { coro.id, coro.handle }, "mem");
+    Value *elided = builder.CreateIsNull(mem, "elided");
+    builder.CreateCondBr(elided, coro.end, free);
+
+    builder.SetInsertPoint(free);
     FunctionType *freeTy = FunctionType::get(
         Type::getVoidTy(ctx),
         { Type::getInt8PtrTy(ctx) },
         false);
-    FunctionCallee free = mod.getOrInsertFunction("free", freeTy);
-    builder.CreateCall(free, { mem });
+    FunctionCallee frameFree = mod.getOrInsertFunction("__allium_frame_free", freeTy);
+    builder.CreateCall(frameFree, { mem });
     builder.CreateBr(coro.end);
 }
 
+void PredicateGenerator::addWitnessSuspend(PredCoroutine &coro, BasicBlock *next) {
+    Function *coroSuspend = Intrinsic::getDeclaration(&mod, Intrinsic::coro_suspend);
+    Value *suspendVal = builder.CreateCall(
+        coroSuspend->getFunctionType(),
+        coroSuspend,
+        { ConstantTokenNone::get(ctx), ConstantInt::getFalse(ctx) });
+    SwitchInst *si = builder.CreateSwitch(suspendVal, coro.end, 2);
+    si->addCase(ConstantInt::get(ctx, APInt(8, 0)), next);
+    si->addCase(ConstantInt::get(ctx, APInt(8, 1)), coro.cleanup);
+}
+
+Scope PredicateGenerator::allocateVariables(const TypedAST::Scope &variables) {
+    Scope scope;
+    for(const auto &variable : variables) {
+        const AlliumType &type = cg.loweredTypes.at(variable.second->declaration.name);
+        Value *var = builder.CreateAlloca(type.irType);
+        storeTag(builder, type, var, 0);
+        scope.insert({ variable.first, var });
+    }
+    return scope;
+}
+
+void PredicateGenerator::unifyHead(
+    const Scope &scope,
+    Function *func,
+    const std::vector<TypedAST::Parameter> &parameters,
+    const std::vector<TypedAST::Value> &head,
+    BasicBlock *fail,
+    MDNode *branchWeights
+) {
+    // The variables of the implication are all unbound until they first
+    // occur in the head.
+    std::set<Name<TypedAST::Variable>> boundVariables;
+    for(unsigned int i=0; i<parameters.size(); ++i) {
+        unify(
+            scope,
+            cg.loweredTypes.at(parameters[i].type),
+            head[i],
+            func->getArg(i),
+            boundVariables,
+            fail,
+            branchWeights);
+    }
+}
+
+void PredicateGenerator::unify(
+    const Scope &scope,
+    const AlliumType &type,
+    const TypedAST::Value &pattern,
+    Value *value,
+    std::set<Name<TypedAST::Variable>> &boundVariables,
+    BasicBlock *fail,
+    MDNode *branchWeights
+) {
+    Function *func = builder.GetInsertBlock()->getParent();
+
+    // Continues with a new block if `unified` is true, or with the fail block
+    // otherwise. The fail block undoes any bindings made by earlier
+    // arguments.
+    auto unifyNext = [&](Value *unified, MDNode *weights) {
+        BasicBlock *next = BasicBlock::Create(ctx, "", func, fail);
+        builder.CreateCondBr(unified, next, fail, weights);
+        builder.SetInsertPoint(next);
+    };
+
+    // Unifies `value` with `other` using the type's unify function.
+    auto callUnify = [&](Value *other) {
+        Function *unifyFunc = mod.getFunction(unifyFuncName(type.astType->declaration.name));
+        unifyNext(
+            builder.CreateCall(unifyFunc->getFunctionType(), unifyFunc, { value, other }),
+            branchWeights);
+    };
+
+    // Unifies `value` with a pattern whose tag is known. If `value` refers to
+    // an unbound variable, the variable is bound to a value built from the
+    // pattern. If it has the same tag, `matchPayload` unifies its payload
+    // with the pattern's.
+    auto unifyTag = [&](unsigned tag, std::function<void(Value*)> matchPayload) {
+        // %val = call i8* @__allium_get_value(i8* %value)
+        // %tag = load i8, i8* %val
+        // %is.ctor = icmp eq i8 %tag, <tag>
+        // br i1 %is.ctor, label %match, label %check.unbound
+        Value *val = loadValue(builder, mod, type, value);
+        Type *tagType = cast<StructType>(type.irType)->getElementType(getTagIndex());
+        Value *valTag = builder.CreateLoad(
+            tagType,
+            builder.CreateStructGEP(type.irType, val, getTagIndex()),
+            "tag");
+        BasicBlock *match = BasicBlock::Create(ctx, "match", func, fail);
+        BasicBlock *checkUnbound = BasicBlock::Create(ctx, "check.unbound", func, fail);
+        BasicBlock *bind = BasicBlock::Create(ctx, "bind", func, fail);
+        BasicBlock *next = BasicBlock::Create(ctx, "", func, fail);
+        builder.CreateCondBr(
+            builder.CreateICmpEQ(valTag, getTagConstant(type, tag), "is.ctor"),
+            match,
+            checkUnbound,
+            branchWeights);
+
+        // check.unbound:
+        //   %is.unbound = icmp eq i8 %tag, 0
+        //   br i1 %is.unbound, label %bind, label %fail
+        builder.SetInsertPoint(checkUnbound);
+        builder.CreateCondBr(
+            builder.CreateICmpEQ(valTag, getTagConstant(type, 0), "is.unbound"),
+            bind,
+            fail);
+
+        // bind:
+        //   call void @__allium_trail_push(i8* %val)
+        //   <bind %val to the pattern>
+        builder.SetInsertPoint(bind);
+        Value *bound = lower(scope, type, pattern);
+        Type *i8Ptr = builder.getInt8PtrTy();
+        FunctionCallee trailPush = mod.getOrInsertFunction(
+            "__allium_trail_push",
+            FunctionType::get(Type::getVoidTy(ctx), { i8Ptr }, false));
+        builder.CreateCall(trailPush, { builder.CreatePointerCast(val, i8Ptr) });
+        storePointer(builder, type, val, bound);
+        builder.CreateBr(next);
+
+        builder.SetInsertPoint(match);
+        matchPayload(val);
+        builder.CreateBr(next);
+        builder.SetInsertPoint(next);
+    };
+
+    // Returns a pointer to the payload of `val`, viewed as the given type.
+    auto payloadPtr = [&](Value *val, Type *payloadType) {
+        return builder.CreatePointerCast(
+            builder.CreateStructGEP(type.irType, val, getPayloadIndex()),
+            PointerType::get(payloadType, 0));
+    };
+
+    // Only the unify function knows that values of an uninhabited type can't
+    // be unified.
+    if(!inhabitableTypes.contains(type.astType->declaration.name)) {
+        callUnify(lower(scope, type, pattern));
+        return;
+    }
+
+    pattern.switchOver(
+    [](TypedAST::AnonymousVariable) {
+        // An anonymous variable unifies with anything, and is never referred
+        // to again.
+    },
+    [&](const TypedAST::Variable &var) {
+        // The first occurrence of a variable is still unbound, so it only
+        // needs to refer to the value.
+        if(boundVariables.insert(var.name).second) {
+            storePointer(builder, type, scope.at(var.name), value);
+        } else {
+            callUnify(scope.at(var.name));
+        }
+    },
+    [&](const TypedAST::ConstructorRef &cr) {
+        size_t index = getConstructorIndex(*type.astType, cr);
+        unifyTag(index + 2, [&](Value *val) {
+            if(cr.arguments.empty()) {
+                return;
+            }
+
+            // Descend into the arguments, which are stored in the payload as
+            // a struct. See docs/ABI.md.
+            StructType *payloadType = cast<StructType>(type.payloadTypes[index]);
+            Value *payload = payloadPtr(val, payloadType);
+            const auto &ctor = type.astType->constructors[index];
+            for(size_t i=0; i<cr.arguments.size(); ++i) {
+                const AlliumType &argType = cg.loweredTypes.at(ctor.parameters[i].type);
+                Value *field = builder.CreateStructGEP(payloadType, payload, i);
+
+                // Arguments of mutually recursive types are stored as pointers.
+                if(payloadType->getElementType(i)->isPointerTy()) {
+                    field = builder.CreateLoad(payloadType->getElementType(i), field);
+                }
+                unify(scope, argType, cr.arguments[i], field, boundVariables, fail);
+            }
+        });
+    },
+    [&](const TypedAST::StringLiteral &) {
+        // Strings are compared by the runtime library.
+        callUnify(lower(scope, type, pattern));
+    },
+    [&](TypedAST::IntegerLiteral x) {
+        // An int's payload is the int itself.
+        unifyTag(2, [&](Value *val) {
+            Value *payload = builder.CreateLoad(
+                builder.getInt64Ty(),
+                payloadPtr(val, builder.getInt64Ty()));
+            unifyNext(builder.CreateICmpEQ(payload, builder.getInt64(x.value)), nullptr);
+        });
+    });
+}
+
+bool PredicateGenerator::mayMatchFirstArgument(
+    const TypedAST::Implication &impl,
+    const TypedAST::Type &type,
+    size_t ctorIndex
+) {
+    return impl.head.arguments[0].match<bool>(
+    [](TypedAST::AnonymousVariable) { return true; },
+    [](const TypedAST::Variable &) { return true; },
+    [&](const TypedAST::ConstructorRef &cr) {
+        return getConstructorIndex(type, cr) == ctorIndex;
+    },
+    [](const TypedAST::StringLiteral &) { return true; },
+    [](TypedAST::IntegerLiteral) { return true; });
+}
+
+BasicBlock *PredicateGenerator::lowerFirstArgumentIndex(
+    const TypedAST::UserPredicate &pred,
+    Value *tag,
+    const std::vector<BasicBlock*> &starts,
+    size_t position
+) {
+    const AlliumType &type = cg.loweredTypes.at(pred.declaration.parameters[0].type);
+    const auto &ctors = type.astType->constructors;
+
+    // If the first argument is unbound, any implication may match it.
+    std::vector<BasicBlock*> targets;
+    bool isNeeded = false;
+    for(size_t c=0; c<ctors.size(); ++c) {
+        size_t i = position;
+        while(i < pred.implications.size() &&
+                !mayMatchFirstArgument(pred.implications[i], *type.astType, c)) {
+            ++i;
+        }
+        targets.push_back(starts[i]);
+        isNeeded = isNeeded || starts[i] != starts[position];
+    }
+    if(!isNeeded) {
+        return starts[position];
+    }
+
+    // index:
+    //   switch i8 %tag, label %impl.position [
+    //     i8 2, label %impl.i
+    //     ...
+    //   ]
+    BasicBlock *bb = BasicBlock::Create(ctx, "index", starts[position]->getParent(), starts[position]);
+    builder.SetInsertPoint(bb);
+    SwitchInst *si = builder.CreateSwitch(tag, starts[position], ctors.size());
+    for(size_t c=0; c<ctors.size(); ++c) {
+        if(targets[c] != starts[position]) {
+            si->addCase(getTagConstant(type, c + 2), targets[c]);
+        }
+    }
+    return bb;
+}
+
+Value *PredicateGenerator::loadFirstTag(
+    const TypedAST::UserPredicate &pred,
+    Function *func
+) {
+    // If any implication has a constructor as its first argument, the first
+    // argument's tag is used to skip the implications which can't match it.
+    bool isIndexed = std::any_of(
+        pred.implications.begin(),
+        pred.implications.end(),
+        [](const TypedAST::Implication &impl) {
+            return !impl.head.arguments.empty() &&
+                impl.head.arguments[0].is_a<TypedAST::ConstructorRef>();
+        });
+    if(!isIndexed) {
+        return nullptr;
+    }
+
+    const AlliumType &type = cg.loweredTypes.at(
+        pred.declaration.parameters[0].type);
+    return loadTag(builder, mod, type, func->getArg(0));
+}
+
+Scope PredicateGenerator::lowerImplicationHead(
+    const TypedAST::UserPredicate &pred,
+    size_t i,
+    Function *func,
+    ProfileInstrumentor &profiler,
+    BasicBlock *fail
+) {
+    const auto &impl = pred.implications[i];
+    if(cg.debugInfo) {
+        cg.debugInfo->setLocation(builder, impl.head.location);
+    }
+    if(cg.instrumentWithLogs) {
+        LogInstrumentor(cg).logImplication(pred.declaration, impl, i);
+    }
+    if(!cg.profileOutput.empty()) {
+        profiler.countAttempt(pred.declaration, i);
+    }
+    if(!cg.countOutput.empty()) {
+        CountInstrumentor(cg).countAttempt(pred, i);
+    }
+
+    // Allocate variables that are local to this implication.
+    Scope scope = allocateVariables(getVariables(ast, impl));
+
+    // Generate code for unifying arguments in the head. If unification
+    // fails, then continue with the next implication.
+    unifyHead(
+        scope,
+        func,
+        pred.declaration.parameters,
+        impl.head.arguments,
+        fail,
+        profiler.getMatchWeights(pred.declaration, i));
+    if(!cg.profileOutput.empty()) {
+        profiler.countMatch(pred.declaration, i);
+    }
+    if(!cg.countOutput.empty()) {
+        CountInstrumentor(cg).countHead(pred, i);
+    }
+    return scope;
+}
+
+/// Appends the goals of a conjunction to `goals`, in the order in which they
+/// are proven.
+static void flattenConjunction(
+    const TypedAST::Expression &expr,
+    std::vector<TypedAST::Expression> &goals
+) {
+    expr.switchOver(
+    [&](TypedAST::TruthLiteral &tl) { goals.push_back(TypedAST::Expression(tl)); },
+    [&](TypedAST::PredicateRef &pr) { goals.push_back(TypedAST::Expression(pr)); },
+    [&](TypedAST::EffectCtorRef &ecr) { goals.push_back(TypedAST::Expression(ecr)); },
+    [&](TypedAST::Conjunction &conj) {
+        flattenConjunction(conj.getLeft(), goals);
+        flattenConjunction(conj.getRight(), goals);
+    });
+}
+
+/// Appends the variables which occur in a value to `variables`.
+static void getVariables(
+    const TypedAST::Value &value,
+    std::set<Name<TypedAST::Variable>> &variables
+) {
+    value.switchOver(
+    [](TypedAST::AnonymousVariable) {},
+    [&](TypedAST::Variable &var) { variables.insert(var.name); },
+    [&](TypedAST::ConstructorRef &cr) {
+        for(const auto &arg : cr.arguments) {
+            getVariables(arg, variables);
+        }
+    },
+    [](TypedAST::StringLiteral &) {},
+    [](TypedAST::IntegerLiteral) {});
+}
+
+bool PredicateGenerator::isTailCall(
+    const TypedAST::Implication &impl,
+    const TypedAST::PredicateRef &pr
+) {
+    if(!cg.semideterministicPredicates.contains(pr.name)) {
+        return false;
+    }
+
+    // The callee's arguments must not refer to the caller's frame, which is
+    // gone by the time that the callee runs. Since the arguments of a
+    // semideterministic predicate are ground, the variables in the head are
+    // bound to parts of them by the time the body runs.
+    std::set<Name<TypedAST::Variable>> headVariables;
+    for(const auto &arg : impl.head.arguments) {
+        getVariables(arg, headVariables);
+    }
+    return std::all_of(
+        pr.arguments.begin(),
+        pr.arguments.end(),
+        [&](const TypedAST::Value &arg) {
+            return arg.match<bool>(
+            [](TypedAST::AnonymousVariable) { return false; },
+            [&](TypedAST::Variable &var) {
+                return headVariables.contains(var.name);
+            },
+            [](TypedAST::ConstructorRef &) { return false; },
+            [](TypedAST::StringLiteral &) { return false; },
+            [](TypedAST::IntegerLiteral) { return false; });
+        });
+}
+
+void PredicateGenerator::lowerSemideterministicBody(
+    const Scope &scope,
+    const TypedAST::Implication &impl,
+    Value *mark,
+    BasicBlock *success,
+    BasicBlock *fail
+) {
+    std::vector<TypedAST::Expression> goals;
+    flattenConjunction(impl.body, goals);
+
+    // If the last goal proves a semideterministic predicate, then the
+    // implication is proven exactly when that predicate is, so it becomes a
+    // tail call. This lets recursion run in constant stack space. With
+    // -fcount, it stays an ordinary call, so that the implication's witnesses
+    // are counted when the callee returns.
+    std::unique_ptr<TypedAST::PredicateRef> last;
+    goals.back().as_a<TypedAST::PredicateRef>().unwrapInto(last);
+    if(last && isTailCall(impl, *last) && cg.countOutput.empty()) {
+        goals.pop_back();
+    } else {
+        last = nullptr;
+    }
+
+    // Every goal has at most one witness, so there is nothing to retry.
+    for(const auto &goal : goals) {
+        lower(scope, goal, fail);
+    }
+    if(last) {
+        lowerTailCall(scope, *last, mark);
+    } else {
+        builder.CreateBr(success);
+    }
+}
+
 // Note: assumes all types have already been lowered.
 Function *PredicateGenerator::lower(const TypedAST::UserPredicate &pred) {
+    if(cg.semideterministicPredicates.contains(pred.declaration.name)) {
+        return lowerSemideterministic(pred);
+    }
+
     PredCoroutine coro = createPredicateCoroutine(pred.declaration);
+    currentCoroutine = &coro;
 
-    Function *coroSuspend = Intrinsic::getDeclaration(&mod, Intrinsic::coro_suspend);
+    // The predicate's handlers are in scope in all of its implications. They
+    // are pushed in order, so the last handler is the innermost.
+    handlers = coro.func->getArg(pred.declaration.parameters.size());
+    builder.SetInsertPoint(coro.entry);
+    for(const auto &handler : pred.handlers) {
+        pushHandler(handler.effect, lower(pred, handler));
+    }
+
+    ProfileInstrumentor profiler(cg);
+    if(!cg.profileOutput.empty()) {
+        profiler.countCall(pred.declaration);
+    }
+    if(!cg.countOutput.empty()) {
+        CountInstrumentor(cg).countCall(pred);
+    }
+    profiler.annotateCalls(coro.func, pred.declaration);
+    Value *firstTag = loadFirstTag(pred, coro.func);
 
     // Iterate backwards so that we have always already created the "next" basic
     // block before we need to create the switch statement at the end of an
     // implication.
+    std::vector<BasicBlock*> starts(pred.implications.size() + 1);
+    starts.back() = coro.finalSuspend;
     BasicBlock *nextBB = coro.finalSuspend;
-    for(auto impl = pred.implications.rbegin();
-            impl != pred.implications.rend(); impl++) {
-        BasicBlock *bb = BasicBlock::Create(ctx, "", coro.func, nextBB);
-        builder.SetInsertPoint(bb);
+    for(size_t i = pred.implications.size(); i-- > 0;) {
+        starts[i] = lowerAlternative(coro, nextBB, [&](BasicBlock *fail) {
+            Scope scope = lowerImplicationHead(pred, i, coro.func, profiler, fail);
 
-        if(cg.instrumentWithLogs) {
-            LogInstrumentor(cg).logImplication(*impl);
-        }
+            // Generate code for the implication body. On failure, continue
+            // with the next implication.
+            BasicBlock *retry = lower(scope, pred.implications[i].body, fail);
+            if(!cg.countOutput.empty()) {
+                CountInstrumentor counter(cg);
+                counter.countSolution(pred, i);
+                retry = counter.countBacktrack(pred, i, retry);
+            }
+            return retry;
+        });
+        nextBB = firstTag ?
+            lowerFirstArgumentIndex(pred, firstTag, starts, i) :
+            starts[i];
+    }
 
-        // Allocate variables that are local to this implication.
-        Scope scope;
-        const auto variables = getVariables(ast, *impl);
-        for(const auto &variable : variables) {
-            StructType *irType = getTypeIRType(variable.second->declaration.name);
-            Value *var = builder.CreateAlloca(irType);
-            Value *tagPtr = builder.CreateStructGEP(irType, var, getTagIndex());
-            builder.CreateStore(ConstantInt::get(ctx, APInt(8, 0)), tagPtr);
-            scope.insert({ variable.first, var });
-        }
+    // Fallthrough from the entry basic block to the first implication.
+    finishCoroutine(coro, nextBB);
+    currentCoroutine = nullptr;
 
-        // Generate code for unifying arguments in the head.
-        for(unsigned int i=0; i<pred.declaration.parameters.size(); ++i) {
-            const auto &param = pred.declaration.parameters[i];
-            Value *matcher = lower(
-                scope,
-                cg.loweredTypes.at(param.type),
-                impl->head.arguments[i]);
-            Function *unify = mod.getFunction(unifyFuncName(param.type));
-            Value *unified = builder.CreateCall(
-                unify->getFunctionType(),
-                unify,
-                { coro.func->getArg(i), matcher });
-
-            // If unification succeeded, try to unify the next argument. If not,
-            // then continue with the next implication.
-            // TODO: roll back any changes made during unification.
-            BasicBlock *unifyNext = BasicBlock::Create(ctx, "", coro.func, nextBB);
-            builder.CreateCondBr(unified, unifyNext, nextBB);
-            builder.SetInsertPoint(unifyNext);
+    return coro.func;
+}
+
+Function *PredicateGenerator::lowerSemideterministic(const TypedAST::UserPredicate &pred) {
+    Function *func = getPredFunc(pred.declaration);
+    func->setLinkage(GlobalValue::LinkageTypes::ExternalLinkage);
+    if(cg.debugInfo) {
+        cg.debugInfo->beginPredicate(builder, func, pred.declaration);
+    }
+
+    BasicBlock *entry = BasicBlock::Create(ctx, "entry", func);
+    BasicBlock *success = BasicBlock::Create(ctx, "success", func);
+    BasicBlock *failure = BasicBlock::Create(ctx, "failure", func);
+
+    // The predicate has no effects, so it never uses its handlers.
+    handlers = func->getArg(pred.declaration.parameters.size());
+    builder.SetInsertPoint(entry);
+
+    ProfileInstrumentor profiler(cg);
+    if(!cg.profileOutput.empty()) {
+        profiler.countCall(pred.declaration);
+    }
+    if(!cg.countOutput.empty()) {
+        CountInstrumentor(cg).countCall(pred);
+    }
+    profiler.annotateCalls(func, pred.declaration);
+    Value *firstTag = loadFirstTag(pred, func);
+
+    IntegerType *markType = mod.getDataLayout().getIntPtrType(ctx);
+    FunctionCallee trailMark = mod.getOrInsertFunction(
+        "__allium_trail_mark",
+        FunctionType::get(markType, {}, false));
+    FunctionCallee trailUndo = mod.getOrInsertFunction(
+        "__allium_trail_undo",
+        FunctionType::get(Type::getVoidTy(ctx), { markType }, false));
+    Value *mark = builder.CreateCall(trailMark, {}, "mark");
+
+    // The arguments are ground, so every binding which the predicate makes is
+    // to one of its own variables. Those bindings are undone before it
+    // returns, since its variables don't outlive the call.
+    // success:
+    //   call void @__allium_trail_undo(i64 %mark)
+    //   ret i1 true
+    // failure:
+    //   ret i1 false
+    builder.SetInsertPoint(success);
+    builder.CreateCall(trailUndo, { mark });
+    builder.CreateRet(builder.getTrue());
+    builder.SetInsertPoint(failure);
+    builder.CreateRet(builder.getFalse());
+
+    // As with coroutines, iterate backwards so that the "next" basic block
+    // always exists already. At most one implication can match, but the
+    // others are still tried unless the first argument rules them out. Once
+    // the head of an implication matches, the predicate is proven exactly when
+    // its body is.
+    std::vector<BasicBlock*> starts(pred.implications.size() + 1);
+    starts.back() = failure;
+    BasicBlock *nextBB = failure;
+    for(size_t i = pred.implications.size(); i-- > 0;) {
+        starts[i] = BasicBlock::Create(ctx, "", func, nextBB);
+        BasicBlock *unwind = BasicBlock::Create(ctx, "unwind", func, nextBB);
+
+        BasicBlock *solved = success;
+        if(!cg.countOutput.empty()) {
+            solved = BasicBlock::Create(ctx, "solved", func, nextBB);
+            builder.SetInsertPoint(solved);
+            CountInstrumentor(cg).countSolution(pred, i);
+            builder.CreateBr(success);
         }
 
-        // Generate code for the implication body. On failure, continue with
-        // the next implication.
-        lower(scope, impl->body, nextBB);
+        builder.SetInsertPoint(starts[i]);
+        Scope scope = lowerImplicationHead(pred, i, func, profiler, unwind);
+        lowerSemideterministicBody(scope, pred.implications[i], mark, solved, unwind);
 
-        // there should be one non-final suspend at the end of each implication,
-        // which is used if a witness is found for the implication's body.
-        Value *suspendVal = builder.CreateCall(
-            coroSuspend->getFunctionType(),
-            coroSuspend,
-            { ConstantTokenNone::get(ctx), ConstantInt::getFalse(ctx) });
-        SwitchInst *si = builder.CreateSwitch(suspendVal, coro.end, 2);
-        si->addCase(ConstantInt::get(ctx, APInt(8, 0)), nextBB);
-        si->addCase(ConstantInt::get(ctx, APInt(8, 1)), coro.cleanup);
+        builder.SetInsertPoint(unwind);
+        builder.CreateCall(trailUndo, { mark });
+        builder.CreateBr(nextBB);
 
-        nextBB = bb;
+        nextBB = firstTag ?
+            lowerFirstArgumentIndex(pred, firstTag, starts, i) :
+            starts[i];
     }
 
-    // Fallthrough from the entry basic block to the first implication.
-    builder.SetInsertPoint(&coro.func->getEntryBlock());
+    builder.SetInsertPoint(entry);
     builder.CreateBr(nextBB);
-
-    return coro.func;
+    return func;
 }
 
 Value *PredicateGenerator::lower(
@@ -303,48 +1459,127 @@ Value *PredicateGenerator::lower(
     AlliumType type,
     const TypedAST::Value &v
 ) {
-    return v.match<llvm::Value*>(
+    ::Optional<TypedAST::Variable> variable = v.as_a<TypedAST::Variable>();
+    TypedAST::Variable *var;
+    if(variable.unwrapInto(var)) {
+        return scope.at(var->name);
+    }
+    Value *alloc = builder.CreateAlloca(type.irType);
+    lowerInto(scope, type, v, alloc);
+    return alloc;
+}
+
+void PredicateGenerator::lowerInto(
+    const Scope &scope,
+    const AlliumType &type,
+    const TypedAST::Value &v,
+    Value *dest
+) {
+    // Returns a pointer to the payload of `dest`, viewed as the given type.
+    auto payloadPtr = [&](Type *payloadType) {
+        return builder.CreatePointerCast(
+            builder.CreateStructGEP(type.irType, dest, getPayloadIndex()),
+            PointerType::get(payloadType, 0));
+    };
+
+    v.switchOver(
     [&](TypedAST::AnonymousVariable av) {
-        assert(false && "anonymous variable lowering not implemented");
-        return nullptr;
+        // An anonymous variable is a fresh variable which is never referred
+        // to again.
+        storeTag(builder, type, dest, 0);
     },
-    [&](const TypedAST::Variable &v) {
-        return scope.at(v.name);
+    [&](const TypedAST::Variable &var) {
+        storePointer(builder, type, dest, scope.at(var.name));
     },
     [&](const TypedAST::ConstructorRef &cr) {
-        assert(cr.arguments.size() == 0 && "ctor argument lowering not implemented");
         // Tags of 0 and 1 are reserved for undefined and pointer values, so
         // constructors start from 2.
-        size_t tag = getConstructorIndex(*type.astType, cr) + 2;
-        Value *alloc = builder.CreateAlloca(type.irType);
-        Value *tagPtr = builder.CreateStructGEP(type.irType, alloc, getTagIndex());
-        builder.CreateStore(ConstantInt::get(ctx, APInt(8, tag)), tagPtr);
-        return alloc;
+        size_t index = getConstructorIndex(*type.astType, cr);
+        storeTag(builder, type, dest, index + 2);
+        if(cr.arguments.empty()) {
+            return;
+        }
+
+        // The arguments are stored in the payload as a struct. See
+        // docs/ABI.md.
+        StructType *payloadType = cast<StructType>(type.payloadTypes[index]);
+        Value *payload = payloadPtr(payloadType);
+        const auto &ctor = type.astType->constructors[index];
+        for(size_t i=0; i<cr.arguments.size(); ++i) {
+            const AlliumType &argType = cg.loweredTypes.at(ctor.parameters[i].type);
+            Value *field = builder.CreateStructGEP(payloadType, payload, i);
+
+            // Arguments of mutually recursive types are stored as pointers.
+            if(payloadType->getElementType(i)->isPointerTy()) {
+                builder.CreateStore(lower(scope, argType, cr.arguments[i]), field);
+            } else {
+                lowerInto(scope, argType, cr.arguments[i], field);
+            }
+        }
     },
     [&](const TypedAST::StringLiteral &str) {
-        assert(false && "string literal lowering not implemented");
-        return nullptr;
+        // A string's payload is a pointer to its text.
+        storeTag(builder, type, dest, 2);
+        builder.CreateStore(
+            getStringConstant(str.value),
+            payloadPtr(Type::getInt8PtrTy(ctx)));
     },
     [&](TypedAST::IntegerLiteral x) {
-        assert(false && "integer literal lowering not implemented");
-        return nullptr;
+        // An int's payload is the int itself.
+        storeTag(builder, type, dest, 2);
+        builder.CreateStore(
+            builder.getInt64(x.value),
+            payloadPtr(builder.getInt64Ty()));
     });
 }
 
+Constant *PredicateGenerator::getStringConstant(const std::string &text) {
+    auto existing = stringConstants.find(text);
+    if(existing != stringConstants.end()) {
+        return existing->second;
+    }
+    Constant *str = builder.CreateGlobalStringPtr(text, ".str", 0, &mod);
+    stringConstants.insert({ text, str });
+    return str;
+}
+
+void PredicateGenerator::initializeRuntime() {
+    FunctionType *initTy = FunctionType::get(Type::getVoidTy(ctx), {}, false);
+    FunctionCallee init = mod.getOrInsertFunction("allium_init", initTy);
+    builder.CreateCall(init, {});
+
+    // Each partition registers its instrumentation before the program does
+    // anything else.
+    if(cg.instrumentWithLogs || !cg.profileOutput.empty() ||
+            !cg.countOutput.empty()) {
+        FunctionType *registerTy = FunctionType::get(Type::getVoidTy(ctx), {}, false);
+        for(size_t i = 0; i < cg.partitionCount; ++i) {
+            builder.CreateCall(
+                mod.getOrInsertFunction(registrationFuncName(i), registerTy),
+                {});
+        }
+    }
+}
+
 Function *PredicateGenerator::createMain() {
     Function *main = Function::Create(
         FunctionType::get(IntegerType::get(ctx, 32), {}, false),
         Function::ExternalLinkage,
         "main",
         mod);
+    if(cg.debugInfo) {
+        cg.debugInfo->beginSyntheticFunction(builder, main);
+    }
 
     BasicBlock *entry = BasicBlock::Create(ctx, "entry", main);
     BasicBlock *failure = BasicBlock::Create(ctx, "failure", main);
     
     builder.SetInsertPoint(entry);
-    FunctionType *initTy = FunctionType::get(Type::getVoidTy(ctx), {}, false);
-    FunctionCallee init = mod.getOrInsertFunction("allium_init", initTy);
-    builder.CreateCall(init, {});
+    initializeRuntime();
+
+    // The builtin IO handler is the outermost handler of every program.
+    handlers = ConstantPointerNull::get(PointerType::get(getHandlerIRType(), 0));
+    pushHandler("IO", lowerBuiltinIOHandler());
     lower({}, TypedAST::PredicateRef("main", {}), failure);
 
     // This goes into the "success" block created by lower
@@ -356,6 +1591,217 @@ Function *PredicateGenerator::createMain() {
     return main;
 }
 
+Function *PredicateGenerator::createLibraryInit() {
+    // A shared library has no main, so the runtime library is initialized
+    // when the library is loaded.
+    Function *init = Function::Create(
+        FunctionType::get(Type::getVoidTy(ctx), {}, false),
+        Function::InternalLinkage,
+        "__allium_init_library",
+        mod);
+    if(cg.debugInfo) {
+        cg.debugInfo->beginSyntheticFunction(builder, init);
+    }
+    builder.SetInsertPoint(BasicBlock::Create(ctx, "entry", init));
+    initializeRuntime();
+    builder.CreateRetVoid();
+    appendToGlobalCtors(mod, init, 0);
+    return init;
+}
+
+Function *PredicateGenerator::createQuery(const TypedAST::UserPredicate &pred) {
+    const auto &pDecl = pred.declaration;
+    Function *pFunc = getPredFunc(pDecl);
+    Type *i1 = Type::getInt1Ty(ctx);
+    Type *i8Ptr = Type::getInt8PtrTy(ctx);
+    Type *i8PtrPtr = PointerType::get(i8Ptr, 0);
+    Type *i64 = Type::getInt64Ty(ctx);
+    Function *coroDone = Intrinsic::getDeclaration(&mod, Intrinsic::coro_done);
+    Function *coroResume = Intrinsic::getDeclaration(&mod, Intrinsic::coro_resume);
+    Function *coroDestroy = Intrinsic::getDeclaration(&mod, Intrinsic::coro_destroy);
+
+    // Queries are proven with only the builtin IO handler in scope. Since the
+    // handler outlives any query, it is a constant.
+    if(!queryHandlers) {
+        StructType *handlerType = getHandlerIRType();
+        queryHandlers = new GlobalVariable(
+            mod,
+            handlerType,
+            true,
+            GlobalValue::LinkageTypes::PrivateLinkage,
+            ConstantStruct::get(handlerType, {
+                ConstantPointerNull::get(PointerType::get(handlerType, 0)),
+                ConstantInt::get(Type::getInt32Ty(ctx), getEffectID("IO")),
+                lowerBuiltinIOHandler() }),
+            "__allium_handle.IO");
+    }
+
+    // The runtime library destroys the coroutine of a query which is freed
+    // before it has run out of witnesses.
+    // define internal void @__allium_destroy_coroutine(i8* %hdl) {
+    //   call void @llvm.coro.destroy(i8* %hdl)
+    //   ret void
+    // }
+    if(!destroyCoroutine) {
+        destroyCoroutine = Function::Create(
+            FunctionType::get(Type::getVoidTy(ctx), { i8Ptr }, false),
+            Function::InternalLinkage,
+            "__allium_destroy_coroutine",
+            mod);
+        if(cg.debugInfo) {
+            cg.debugInfo->beginSyntheticFunction(builder, destroyCoroutine);
+        }
+        builder.SetInsertPoint(BasicBlock::Create(ctx, "entry", destroyCoroutine));
+        builder.CreateCall(coroDestroy, { destroyCoroutine->getArg(0) });
+        builder.CreateRetVoid();
+    }
+
+    // i1 @__allium_prove.p(i8** %args, i8** %coroutine) proves the predicate,
+    // as described in the runtime library's allium_query.
+    Function *prove = Function::Create(
+        FunctionType::get(i1, { i8PtrPtr, i8PtrPtr }, false),
+        Function::InternalLinkage,
+        "__allium_prove." + pDecl.name.string(),
+        mod);
+    if(cg.debugInfo) {
+        cg.debugInfo->beginSyntheticFunction(builder, prove);
+    }
+    builder.SetInsertPoint(BasicBlock::Create(ctx, "entry", prove));
+    std::vector<Value*> arguments;
+    for(size_t i = 0; i < pDecl.parameters.size(); ++i) {
+        Value *argument = builder.CreateLoad(
+            i8Ptr,
+            builder.CreateConstGEP1_64(i8Ptr, prove->getArg(0), i));
+        arguments.push_back(builder.CreatePointerCast(
+            argument,
+            pFunc->getFunctionType()->getParamType(i)));
+    }
+    arguments.push_back(queryHandlers);
+
+    // A semideterministic predicate has at most one witness, which a single
+    // call finds.
+    if(cg.semideterministicPredicates.contains(pDecl.name)) {
+        CallInst *proven = builder.CreateCall(pFunc, arguments, "proven");
+        proven->setCallingConv(pFunc->getCallingConv());
+        builder.CreateRet(proven);
+    } else {
+        // entry:
+        //   %hdl.old = load i8*, i8** %coroutine
+        //   %is.new = icmp eq i8* %hdl.old, null
+        //   br i1 %is.new, label %start, label %resume
+        // start:
+        //   %hdl.new = call i8* @pred(...)
+        //   br label %check
+        // resume:
+        //   call void @llvm.coro.resume(i8* %hdl.old)
+        //   br label %check
+        // check:
+        //   %hdl = phi i8* [ %hdl.new, %start ], [ %hdl.old, %resume ]
+        //   %done = call i1 @llvm.coro.done(i8* %hdl)
+        //   br i1 %done, label %exhausted, label %proven
+        // exhausted:
+        //   call void @llvm.coro.destroy(i8* %hdl)
+        //   store i8* null, i8** %coroutine
+        //   ret i1 false
+        // proven:
+        //   store i8* %hdl, i8** %coroutine
+        //   ret i1 true
+        BasicBlock *start = BasicBlock::Create(ctx, "start", prove);
+        BasicBlock *resume = BasicBlock::Create(ctx, "resume", prove);
+        BasicBlock *check = BasicBlock::Create(ctx, "check", prove);
+        BasicBlock *exhausted = BasicBlock::Create(ctx, "exhausted", prove);
+        BasicBlock *proven = BasicBlock::Create(ctx, "proven", prove);
+        Value *coroutine = prove->getArg(1);
+        Value *oldHdl = builder.CreateLoad(i8Ptr, coroutine, "hdl.old");
+        builder.CreateCondBr(builder.CreateIsNull(oldHdl, "is.new"), start, resume);
+
+        builder.SetInsertPoint(start);
+        Value *newHdl = builder.CreateCall(pFunc, arguments, "hdl.new");
+        builder.CreateBr(check);
+
+        builder.SetInsertPoint(resume);
+        builder.CreateCall(coroResume, { oldHdl });
+        builder.CreateBr(check);
+
+        builder.SetInsertPoint(check);
+        PHINode *hdl = builder.CreatePHI(i8Ptr, 2, "hdl");
+        hdl->addIncoming(newHdl, start);
+        hdl->addIncoming(oldHdl, resume);
+        builder.CreateCondBr(builder.CreateCall(coroDone, { hdl }, "done"), exhausted, proven);
+
+        builder.SetInsertPoint(exhausted);
+        builder.CreateCall(coroDestroy, { hdl });
+        builder.CreateStore(ConstantPointerNull::get(cast<PointerType>(i8Ptr)), coroutine);
+        builder.CreateRet(ConstantInt::getFalse(ctx));
+
+        builder.SetInsertPoint(proven);
+        builder.CreateStore(hdl, coroutine);
+        builder.CreateRet(ConstantInt::getTrue(ctx));
+    }
+
+    // allium_query *allium_pred_p_query(allium_value *arg0, ...) creates a query
+    // with the predicate's arguments.
+    std::vector<Type*> parameters(
+        pFunc->getFunctionType()->param_begin(),
+        pFunc->getFunctionType()->param_end() - 1);
+    Function *query = Function::Create(
+        FunctionType::get(i8Ptr, parameters, false),
+        Function::ExternalLinkage,
+        queryFuncName(pDecl.name),
+        mod);
+    if(cg.debugInfo) {
+        cg.debugInfo->beginSyntheticFunction(builder, query);
+    }
+    builder.SetInsertPoint(BasicBlock::Create(ctx, "entry", query));
+    Value *argArray = builder.CreateAlloca(
+        i8Ptr,
+        builder.getInt64(std::max<size_t>(parameters.size(), 1)),
+        "args");
+    for(size_t i = 0; i < parameters.size(); ++i) {
+        builder.CreateStore(
+            builder.CreatePointerCast(query->getArg(i), i8Ptr),
+            builder.CreateConstGEP1_64(i8Ptr, argArray, i));
+    }
+    FunctionCallee newQuery = mod.getOrInsertFunction(
+        "__allium_query_new",
+        FunctionType::get(
+            i8Ptr,
+            { prove->getType(), destroyCoroutine->getType(), i8PtrPtr, i64 },
+            false));
+    builder.CreateRet(builder.CreateCall(
+        newQuery,
+        { prove, destroyCoroutine, argArray, builder.getInt64(parameters.size()) }));
+    return query;
+}
+
+Function *PredicateGenerator::createRegistration() {
+    // In the first partition, main has already declared the function.
+    Function *func = cast<Function>(
+        mod.getOrInsertFunction(
+            registrationFuncName(cg.partition),
+            FunctionType::get(Type::getVoidTy(ctx), {}, false)
+        ).getCallee());
+    if(cg.debugInfo) {
+        cg.debugInfo->beginSyntheticFunction(builder, func);
+    }
+    builder.SetInsertPoint(BasicBlock::Create(ctx, "entry", func));
+    if(cg.instrumentWithLogs) {
+        LogInstrumentor(cg).registerSites();
+    }
+    if(!cg.profileOutput.empty()) {
+        ProfileInstrumentor(cg).registerCounters();
+    }
+    if(!cg.countOutput.empty()) {
+        CountInstrumentor(cg).registerCounters();
+    }
+    builder.CreateRetVoid();
+    return func;
+}
+
+std::string registrationFuncName(size_t partition) {
+    return "__allium_register." + std::to_string(partition);
+}
+
 std::string mangledPredName(Name<TypedAST::Predicate> p) {
     return "_pred_" + p.string();
 }
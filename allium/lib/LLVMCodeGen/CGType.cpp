@@ -1,4 +1,8 @@
+#include <algorithm>
+
 #include "LLVMCodeGen/CGType.h"
+#include "LLVMCodeGen/LibraryAPI.h"
+#include "SemAna/Builtins.h"
 #include "SemAna/TypedAST.h"
 #include "SemAna/TypeRecursionAnalysis.h"
 
@@ -22,6 +26,11 @@ AlliumType TypeGenerator::getIRType(const TypedAST::Type &type) {
     StructType *llvmType = StructType::create(ctx, name);
     loweredType.irType = llvmType;
 
+    // Recursive types refer to themselves through their constructors'
+    // arguments, so the type must be known before they are lowered. Its
+    // arguments are stored as pointers, which only need the opaque struct.
+    cgctx.loweredTypes.insert({ type.declaration.name, loweredType });
+
     // If the value is a variable, then the payload is a pointer to the
     // variable's value.
     Type *ptr = PointerType::get(llvmType, 0);
@@ -57,6 +66,28 @@ AlliumType TypeGenerator::getIRType(const TypedAST::Type &type) {
         }
     }
 
+    // In the compact layout, a type whose constructors have no arguments only
+    // needs to distinguish its constructors from variables, which fits in a
+    // single word.
+    bool isEnum = std::all_of(
+        type.constructors.begin(),
+        type.constructors.end(),
+        [](const TypedAST::Constructor &ctor) { return ctor.parameters.empty(); });
+    if(cgctx.compactLayout && isEnum) {
+        llvmType->setBody({ mod.getDataLayout().getIntPtrType(ctx) });
+        loweredType.isTaggedWord = true;
+    } else {
+        setBody(llvmType, maxPayloadSize, maxPayloadAlignment);
+    }
+    cgctx.loweredTypes.insert_or_assign(type.declaration.name, loweredType);
+    return loweredType;
+}
+
+void TypeGenerator::setBody(
+    StructType *irType,
+    TypeSize payloadSize,
+    Align payloadAlignment
+) {
     // Putting the tag first means the tag is always at offset 0. This will
     // throw off the payload alignment for all types on most architectures
     // since the payload always at least fits a pointer, but it allows the tag
@@ -68,9 +99,92 @@ AlliumType TypeGenerator::getIRType(const TypedAST::Type &type) {
     // with an unused byte array member. This feels a bit hackish, since the
     // alignment of the whole structure will be 1 on most architectures.
     Type *i8 = Type::getInt8Ty(ctx);
-    Type *padding = ArrayType::get(i8, maxPayloadAlignment.value() - 1);
-    llvmType->setBody({ i8, padding, ArrayType::get(i8, maxPayloadSize) });
+    Type *padding = ArrayType::get(i8, payloadAlignment.value() - 1);
+    if(!cgctx.compactLayout) {
+        irType->setBody({ i8, padding, ArrayType::get(i8, payloadSize) });
+        return;
+    }
+
+    // In the compact layout, the payload is an array of integers with the
+    // payload's alignment, which gives the whole structure that alignment too.
+    // Values nested inside of payloads are then aligned without any padding
+    // beyond what C would add.
+    Type *unit = IntegerType::get(ctx, 8 * payloadAlignment.value());
+    uint64_t units = divideCeil(payloadSize.getFixedSize(), payloadAlignment.value());
+    irType->setBody({ i8, padding, ArrayType::get(unit, units) });
+}
+
+void storeTag(IRBuilderBase &builder, const AlliumType &type, Value *value, unsigned tag) {
+    assert(tag != 1 && "variables are bound by unification!");
+    Value *tagPtr = builder.CreateStructGEP(type.irType, value, getTagIndex());
+    builder.CreateStore(getTagConstant(type, tag), tagPtr);
+}
+
+ConstantInt *getTagConstant(const AlliumType &type, unsigned tag) {
+    Type *tagType = cast<StructType>(type.irType)->getElementType(getTagIndex());
+    if(type.isTaggedWord) {
+        // See "Compact Layout" in docs/ABI.md.
+        assert(tag != 1 && "a tagged word variable has no single tag!");
+        uint64_t tagged = tag == 0 ? 0 : (uint64_t(tag - 2) << 1) | 1;
+        return ConstantInt::get(cast<IntegerType>(tagType), tagged);
+    }
+    return ConstantInt::get(cast<IntegerType>(tagType), tag);
+}
+
+Value *loadValue(IRBuilderBase &builder, Module &mod, const AlliumType &type, Value *value) {
+    Type *i8Ptr = builder.getInt8PtrTy();
+    FunctionCallee getValueFunc = mod.getOrInsertFunction(
+        type.isTaggedWord ? "__allium_get_tagged_word_value" : "__allium_get_value",
+        FunctionType::get(i8Ptr, { i8Ptr }, false));
+    return builder.CreatePointerCast(
+        builder.CreateCall(getValueFunc, { builder.CreatePointerCast(value, i8Ptr) }),
+        PointerType::get(type.irType, 0));
+}
+
+Value *loadTag(IRBuilderBase &builder, Module &mod, const AlliumType &type, Value *value) {
+    Value *val = loadValue(builder, mod, type, value);
+    Type *tagType = cast<StructType>(type.irType)->getElementType(getTagIndex());
+    return builder.CreateLoad(
+        tagType,
+        builder.CreateStructGEP(type.irType, val, getTagIndex()),
+        "tag");
+}
+
+AlliumType TypeGenerator::lowerBuiltinType(const TypedAST::Type &type) {
+    // A value of a builtin type has the tag 2, as if it were the type's only
+    // constructor, and its payload is the value itself: an int64_t for Int,
+    // or a pointer to a NUL-terminated string for String.
+    Type *valueType = type.declaration.name == "Int" ?
+        (Type *) Type::getInt64Ty(ctx) :
+        (Type *) Type::getInt8PtrTy(ctx);
+
+    AlliumType loweredType;
+    loweredType.astType = &type;
+    StructType *llvmType = StructType::create(
+        ctx,
+        mangledTypeName(type.declaration.name));
+    loweredType.irType = llvmType;
+    loweredType.payloadTypes.push_back(valueType);
+
+    const DataLayout &layout = mod.getDataLayout();
+    Type *ptr = PointerType::get(llvmType, 0);
+    setBody(
+        llvmType,
+        std::max(layout.getTypeAllocSize(ptr), layout.getTypeAllocSize(valueType)),
+        std::max(layout.getPrefTypeAlign(ptr), layout.getPrefTypeAlign(valueType)));
     cgctx.loweredTypes.insert({ type.declaration.name, loweredType });
+
+    // Builtin types are unified by the runtime library.
+    Type *loweredTypePtr = PointerType::get(llvmType, 0);
+    Function::Create(
+        FunctionType::get(
+            Type::getInt1Ty(ctx),
+            { loweredTypePtr, loweredTypePtr },
+            false),
+        GlobalValue::LinkageTypes::ExternalLinkage,
+        unifyFuncName(type.declaration.name),
+        mod);
+
     return loweredType;
 }
 
@@ -78,17 +192,167 @@ std::string unifyFuncName(Name<TypedAST::Type> name) {
     return "unify" + mangledTypeName(name);
 }
 
+void storePointer(IRBuilderBase &builder, const AlliumType &type, Value *value, Value *target) {
+    Value *tagPtr = builder.CreateStructGEP(type.irType, value, getTagIndex());
+    if(type.isTaggedWord) {
+        // See "Compact Layout" in docs/ABI.md.
+        Type *word = cast<StructType>(type.irType)->getElementType(0);
+        builder.CreateStore(builder.CreatePtrToInt(target, word), tagPtr);
+        return;
+    }
+
+    builder.CreateStore(builder.getInt8(1), tagPtr);
+    Value *payloadPtr = builder.CreatePointerCast(
+        builder.CreateStructGEP(type.irType, value, getPayloadIndex()),
+        PointerType::get(target->getType(), 0));
+    builder.CreateStore(target, payloadPtr);
+}
+
+Function *TypeGenerator::createUnifyFunc(
+    const TypedAST::Type &type,
+    const AlliumType &loweredType
+) {
+    Type *loweredTypePtr = PointerType::get(loweredType.irType, 0);
+    Function *func = cast<Function>(
+        mod.getOrInsertFunction(
+            unifyFuncName(type.declaration.name),
+            FunctionType::get(
+                Type::getInt1Ty(ctx),
+                { loweredTypePtr, loweredTypePtr },
+                false)
+        ).getCallee());
+
+    // Every partition of the program defines its own unify functions.
+    func->setLinkage(GlobalValue::LinkageTypes::InternalLinkage);
+    return func;
+}
+
+Function *TypeGenerator::buildTaggedWordUnifyFunc(
+    const TypedAST::Type &type,
+    const AlliumType &loweredType
+) {
+    Type *i1 = Type::getInt1Ty(ctx);
+    Type *i8Ptr = Type::getInt8PtrTy(ctx);
+    Type *word = mod.getDataLayout().getIntPtrType(ctx);
+    Type *wordPtr = PointerType::get(word, 0);
+    Function *func = createUnifyFunc(type, loweredType);
+
+    Argument *x = func->getArg(0);
+    x->setName("x");
+    Argument *y = func->getArg(1);
+    y->setName("y");
+
+    BasicBlock *entry = BasicBlock::Create(ctx, "entry", func);
+    BasicBlock *checkY = BasicBlock::Create(ctx, "check.y", func);
+    BasicBlock *checkX = BasicBlock::Create(ctx, "check.x", func);
+    BasicBlock *asgX = BasicBlock::Create(ctx, "asg.x", func);
+    BasicBlock *asgY = BasicBlock::Create(ctx, "asg.y", func);
+    BasicBlock *compare = BasicBlock::Create(ctx, "compare", func);
+    BasicBlock *retTrue = BasicBlock::Create(ctx, "ret.true", func);
+
+    FunctionCallee getValueFunc = mod.getOrInsertFunction(
+        "__allium_get_tagged_word_value",
+        FunctionType::get(i8Ptr, { i8Ptr }, false));
+    FunctionCallee trailPushFunc = mod.getOrInsertFunction(
+        "__allium_trail_push",
+        FunctionType::get(Type::getVoidTy(ctx), { i8Ptr }, false));
+
+    // entry:
+    //   %x.val = call i8* @__allium_get_tagged_word_value(i8* %x)
+    //   %x.word = load i64, i64* %x.val
+    //   %y.val = call i8* @__allium_get_tagged_word_value(i8* %y)
+    //   %y.word = load i64, i64* %y.val
+    //   %same = icmp eq i8* %x.val, %y.val
+    //   br i1 %same, label %ret.true, label %check.y
+    builder.SetInsertPoint(entry);
+    Value *xVal = builder.CreateCall(
+        getValueFunc,
+        { builder.CreatePointerCast(x, i8Ptr) },
+        "x.val");
+    Value *xWordPtr = builder.CreatePointerCast(xVal, wordPtr, "x.word.ptr");
+    Value *xWord = builder.CreateLoad(word, xWordPtr, "x.word");
+    Value *yVal = builder.CreateCall(
+        getValueFunc,
+        { builder.CreatePointerCast(y, i8Ptr) },
+        "y.val");
+    Value *yWordPtr = builder.CreatePointerCast(yVal, wordPtr, "y.word.ptr");
+    Value *yWord = builder.CreateLoad(word, yWordPtr, "y.word");
+    builder.CreateCondBr(builder.CreateICmpEQ(xVal, yVal, "same"), retTrue, checkY);
+
+    // check.y:
+    //   %y.is.unbound = icmp eq i64 %y.word, 0
+    //   br i1 %y.is.unbound, label %asg.y, label %check.x
+    // check.x:
+    //   %x.is.unbound = icmp eq i64 %x.word, 0
+    //   br i1 %x.is.unbound, label %asg.x, label %compare
+    builder.SetInsertPoint(checkY);
+    Value *zero = ConstantInt::get(word, 0);
+    builder.CreateCondBr(builder.CreateICmpEQ(yWord, zero, "y.is.unbound"), asgY, checkX);
+    builder.SetInsertPoint(checkX);
+    builder.CreateCondBr(builder.CreateICmpEQ(xWord, zero, "x.is.unbound"), asgX, compare);
+
+    // A variable is bound by storing the address of its value, which has a low
+    // bit of 0.
+    // asg.x:
+    //   call void @__allium_trail_push(i8* %x.val)
+    //   %y.addr = ptrtoint i8* %y.val to i64
+    //   store i64 %y.addr, i64* %x.val
+    //   ret i1 true
+    builder.SetInsertPoint(asgX);
+    builder.CreateCall(trailPushFunc, { xVal });
+    builder.CreateStore(builder.CreatePtrToInt(yVal, word, "y.addr"), xWordPtr);
+    builder.CreateRet(ConstantInt::getTrue(i1));
+
+    // asg.y:
+    //   call void @__allium_trail_push(i8* %y.val)
+    //   %x.addr = ptrtoint i8* %x.val to i64
+    //   store i64 %x.addr, i64* %y.val
+    //   ret i1 true
+    builder.SetInsertPoint(asgY);
+    builder.CreateCall(trailPushFunc, { yVal });
+    builder.CreateStore(builder.CreatePtrToInt(xVal, word, "x.addr"), yWordPtr);
+    builder.CreateRet(ConstantInt::getTrue(i1));
+
+    // Both values are constructors, which are equal if their words are.
+    // compare:
+    //   %ctors.are.eq = icmp eq i64 %x.word, %y.word
+    //   ret i1 %ctors.are.eq
+    builder.SetInsertPoint(compare);
+    builder.CreateRet(builder.CreateICmpEQ(xWord, yWord, "ctors.are.eq"));
+
+    builder.SetInsertPoint(retTrue);
+    builder.CreateRet(ConstantInt::getTrue(i1));
+
+    return func;
+}
+
+Function *TypeGenerator::buildUninhabitedUnifyFunc(
+    const TypedAST::Type &type,
+    const AlliumType &loweredType
+) {
+    Type *i1 = Type::getInt1Ty(ctx);
+    Function *func = createUnifyFunc(type, loweredType);
+
+    // entry:
+    //   ret i1 false
+    builder.SetInsertPoint(BasicBlock::Create(ctx, "entry", func));
+    builder.CreateRet(ConstantInt::getFalse(i1));
+    return func;
+}
+
 Function *TypeGenerator::buildUnifyFunc(const TypedAST::Type &type, const AlliumType &loweredType) {
+    if(!inhabitableTypes.contains(type.declaration.name)) {
+        return buildUninhabitedUnifyFunc(type, loweredType);
+    }
+    if(loweredType.isTaggedWord) {
+        return buildTaggedWordUnifyFunc(type, loweredType);
+    }
+
     std::string name = mangledTypeName(type.declaration.name);
 
     Type *i1 = Type::getInt1Ty(ctx);
     Type *loweredTypePtr = PointerType::get(loweredType.irType, 0);
-    FunctionType *unifyType = FunctionType::get(i1, { loweredTypePtr, loweredTypePtr }, false);
-    Function *func = Function::Create(
-        unifyType,
-        GlobalValue::LinkageTypes::ExternalLinkage,
-        Twine("unify", name),
-        mod);
+    Function *func = createUnifyFunc(type, loweredType);
 
     Argument *x = func->getArg(0);
     x->setName("x");
@@ -96,6 +360,7 @@ Function *TypeGenerator::buildUnifyFunc(const TypedAST::Type &type, const Allium
     y->setName("y");
 
     BasicBlock *entry = BasicBlock::Create(ctx, "entry", func);
+
     BasicBlock *asgX = BasicBlock::Create(ctx, "asg.x", func);
     BasicBlock *asgY = BasicBlock::Create(ctx, "asg.y", func);
     BasicBlock *retTrue = BasicBlock::Create(ctx, "ret.true", func);
@@ -106,6 +371,9 @@ Function *TypeGenerator::buildUnifyFunc(const TypedAST::Type &type, const Allium
     Type *i8Ptr = Type::getInt8PtrTy(ctx);
     FunctionType *getValueFuncType = FunctionType::get(i8Ptr, { i8Ptr }, false);
     FunctionCallee getValueFunc = mod.getOrInsertFunction("__allium_get_value", getValueFuncType);
+    FunctionCallee trailPushFunc = mod.getOrInsertFunction(
+        "__allium_trail_push",
+        FunctionType::get(Type::getVoidTy(ctx), { i8Ptr }, false));
 
     // entry:
     //   %x.val = call T* @__allium_get_value(T* %x)
@@ -114,6 +382,9 @@ Function *TypeGenerator::buildUnifyFunc(const TypedAST::Type &type, const Allium
     //   %y.val = call T* @getValue(T* %y)
     //   %y.idx.ptr = getelementptr inbounds T, T* %y.val, i32 0, i32 0
     //   %y.idx = load i8, i8* %y.idx.ptr
+    //   %same = icmp eq T* %x.val, %y.val
+    //   br i1 %same, label %ret.true, label %check.y
+    // check.y:
     //   %y.idx.is.zero = icmp eq i8 %y.idx, 0
     //   br i1 %y.idx.is.zero, label %asg.y, label %switch
     // switch: 
@@ -136,6 +407,11 @@ Function *TypeGenerator::buildUnifyFunc(const TypedAST::Type &type, const Allium
     Value *yIdxPtr = builder.CreateStructGEP(loweredType.irType, yVal, getTagIndex(), "y.idx.ptr");
     Value *yIdx = builder.CreateLoad(i8, yIdxPtr, "y.idx");
 
+    // A value unifies with itself. Binding it would create a cycle.
+    BasicBlock *checkY = BasicBlock::Create(ctx, "check.y", func, asgX);
+    builder.CreateCondBr(builder.CreateICmpEQ(xVal, yVal, "same"), retTrue, checkY);
+
+    builder.SetInsertPoint(checkY);
     Value *yIdxIsZero = builder.CreateCmp(
         CmpInst::Predicate::ICMP_EQ,
         yIdx,
@@ -148,13 +424,16 @@ Function *TypeGenerator::buildUnifyFunc(const TypedAST::Type &type, const Allium
     SwitchInst *si = builder.CreateSwitch(xIdx, trap, type.constructors.size()+1);
     si->addCase(ConstantInt::get(i8, 0), asgX);
 
+    // Each binding is recorded on the trail, so that it can be undone when
+    // the proof backtracks.
     // asg.x:
-    //   ; call void @record(%Transaction* %t, T* %x.val)
+    //   call void @__allium_trail_push(i8* %x.val.i8)
     //   store i8 1, i8* %x.idx.ptr
     //   %x.payload.ptr = getelementptr inbounds T, T* %x.val, i32 0, i32 1
     //   store T* %y.val, T** %x.payload.ptr
     //   ret i1 1
     builder.SetInsertPoint(asgX);
+    builder.CreateCall(trailPushFunc, { xValI8 });
     builder.CreateStore(ConstantInt::get(i8, 1), xIdxPtr);
     Value *xPayloadPtrI8 = builder.CreateStructGEP(loweredType.irType, xVal, getPayloadIndex(), "x.payload.ptr");
     Value *xPayloadPtr = builder.CreatePointerCast(
@@ -165,12 +444,13 @@ Function *TypeGenerator::buildUnifyFunc(const TypedAST::Type &type, const Allium
     builder.CreateRet(ConstantInt::get(i1, 1));
 
     // asg.y:
-    //   ; call void @record(%Transaction* %t, T* %y.val)
+    //   call void @__allium_trail_push(i8* %y.val.i8)
     //   store i8 1, i8* %y.idx.ptr
     //   %y.payload.ptr = getelementptr inbounds T, T* %y.val, i32 0, i32 1
     //   store T* %x.val, T** %y.payload.ptr
     //   ret i1 1
     builder.SetInsertPoint(asgY);
+    builder.CreateCall(trailPushFunc, { yValI8 });
     builder.CreateStore(ConstantInt::get(i8, 1), yIdxPtr);
     Value *yPayloadPtrI8 = builder.CreateStructGEP(loweredType.irType, yVal, getPayloadIndex(), "y.payload.ptr");
     Value *yPayloadPtr = builder.CreatePointerCast(
@@ -203,33 +483,50 @@ Function *TypeGenerator::buildUnifyFunc(const TypedAST::Type &type, const Allium
 
         Value *ctorsAreEq = builder.CreateCmp(CmpInst::Predicate::ICMP_EQ, xIdx, yIdx, "ctors.are.eq");
 
-        if(type.constructors[i].parameters.size() > 0) {
-            bb = BasicBlock::Create(ctx, Twine(bbPrefix, ".0"), func, retTrue);
-            builder.CreateCondBr(ctorsAreEq, bb, retFalse);
+        const auto &parameters = type.constructors[i].parameters;
+        if(parameters.size() == 0) {
+            builder.CreateCondBr(ctorsAreEq, retTrue, retFalse);
+            continue;
+        }
+
+        bb = BasicBlock::Create(ctx, Twine(bbPrefix, ".0"), func, retTrue);
+        builder.CreateCondBr(ctorsAreEq, bb, retFalse);
+
+        // The arguments are unified in order, and unification fails as soon
+        // as any pair of them fails to unify.
+        for(int j=0; j<parameters.size(); ++j) {
+            // ctor.i.j:
+            //   %arg.x = getelementptr inbounds PayloadT, PayloadT* %x.payload.ptr, i32 0, i32 j
+            //   %arg.y = getelementptr inbounds PayloadT, PayloadT* %y.payload.ptr, i32 0, i32 j
+            //   %args.match = call i1 @unifyArgType(ArgT* %arg.x, ArgT* %arg.y)
+            //   br i1 %args.match, label %ctor.i.j+1, label %ret.false
+            builder.SetInsertPoint(bb);
+            Type *argType = cgctx.loweredTypes.at(parameters[j].type).irType;
+            Type *argTypePtr = PointerType::get(argType, 0);
+            Value *argX = builder.CreateStructGEP(payloadType, xPayloadPtr, j, "arg.x");
+            Value *argY = builder.CreateStructGEP(payloadType, yPayloadPtr, j, "arg.y");
+
+            // Arguments of mutually recursive types are stored as pointers.
+            if(payloadType->getStructElementType(j)->isPointerTy()) {
+                argX = builder.CreateLoad(argTypePtr, argX, "arg.x.ptr");
+                argY = builder.CreateLoad(argTypePtr, argY, "arg.y.ptr");
+            }
+
+            FunctionCallee argUnify = mod.getOrInsertFunction(
+                unifyFuncName(parameters[j].type),
+                FunctionType::get(i1, { argTypePtr, argTypePtr }, false));
+            Value *argsMatch = builder.CreateCall(argUnify, { argX, argY }, "args.match");
 
-            for(int j=0; j<type.constructors[i].parameters.size(); ++j) {
-                // ctors.i.j:
-                //   %arg.x = getelementptr inbounds PayloadT, PayloadT* %x.payload.ptr, i32 0, i32 j
-                //   %arg.y = getelementptr inbounds PayloadT, PayloadT* %y.payload.ptr, i32 0, i32 j
-                //   %args.match = call i1 @unifyArgType()
-                BasicBlock *argBB = BasicBlock::Create(
+            BasicBlock *next = retTrue;
+            if(j + 1 < parameters.size()) {
+                next = BasicBlock::Create(
                     ctx,
-                    bbPrefix + std::to_string(j),
+                    bbPrefix + "." + std::to_string(j + 1),
                     func, retTrue);
-                builder.SetInsertPoint(argBB);
-                Type *argType = payloadType->getStructElementType(j);
-                Type *argTypePtr = PointerType::get(argType, 0);
-                Value *argX = builder.CreateStructGEP(payloadType, xPayloadPtr, j, "arg.x");
-                Value *argY = builder.CreateStructGEP(payloadType, yPayloadPtr, j, "arg.y");
-                FunctionCallee argUnify = mod.getOrInsertFunction(
-                    unifyFuncName(type.constructors[i].parameters[j].type),
-                    FunctionType::get(i1, { argTypePtr, argTypePtr }, false));
-                builder.CreateCall(argUnify, { argX, argY }, "args.match");
             }
-        } else {
-            builder.CreateCondBr(ctorsAreEq, retTrue, retFalse);
+            builder.CreateCondBr(argsMatch, next, retFalse);
+            bb = next;
         }
-        // TODO: unify arguments
     }
 
     // ret.true:
@@ -253,9 +550,160 @@ Function *TypeGenerator::buildUnifyFunc(const TypedAST::Type &type, const Allium
     return func;
 }
 
+void TypeGenerator::buildValueAPI(
+    const TypedAST::Type &type,
+    const AlliumType &loweredType
+) {
+    const DataLayout &layout = mod.getDataLayout();
+    const auto &name = type.declaration.name;
+    IntegerType *i32 = Type::getInt32Ty(ctx);
+    Type *i8Ptr = Type::getInt8PtrTy(ctx);
+    Type *intPtr = layout.getIntPtrType(ctx);
+    Type *loweredTypePtr = PointerType::get(loweredType.irType, 0);
+    FunctionCallee mallocFunc = mod.getOrInsertFunction(
+        "malloc",
+        FunctionType::get(i8Ptr, { intPtr }, false));
+
+    // Values are allocated with malloc, so that allium_value_free can free a
+    // value of any type.
+    auto allocate = [&]() {
+        Value *memory = builder.CreateCall(
+            mallocFunc,
+            { ConstantInt::get(intPtr, layout.getTypeAllocSize(loweredType.irType)) },
+            "value");
+        return builder.CreatePointerCast(memory, loweredTypePtr);
+    };
+
+    // allium_value *allium_type_T_variable(void)
+    Function *variable = Function::Create(
+        FunctionType::get(loweredTypePtr, {}, false),
+        GlobalValue::LinkageTypes::ExternalLinkage,
+        variableFuncName(name),
+        mod);
+    builder.SetInsertPoint(BasicBlock::Create(ctx, "entry", variable));
+    Value *value = allocate();
+    storeTag(builder, loweredType, value, 0);
+    builder.CreateRet(value);
+
+    // allium_value *allium_type_T_ctor_C(allium_value *arg0, ...)
+    //
+    // Each argument of the constructor is a variable which refers to the
+    // corresponding value, or a pointer to it if it is stored as a pointer.
+    for(size_t i = 0; i < type.constructors.size(); ++i) {
+        const auto &ctor = type.constructors[i];
+        std::vector<Type*> parameters;
+        for(const auto &param : ctor.parameters) {
+            parameters.push_back(
+                PointerType::get(cgctx.loweredTypes.at(param.type).irType, 0));
+        }
+        Function *func = Function::Create(
+            FunctionType::get(loweredTypePtr, parameters, false),
+            GlobalValue::LinkageTypes::ExternalLinkage,
+            ctorFuncName(name, ctor.name),
+            mod);
+        builder.SetInsertPoint(BasicBlock::Create(ctx, "entry", func));
+        value = allocate();
+        storeTag(builder, loweredType, value, i + 2);
+        if(!parameters.empty()) {
+            StructType *payloadType = cast<StructType>(loweredType.payloadTypes[i]);
+            Value *payload = builder.CreatePointerCast(
+                builder.CreateStructGEP(loweredType.irType, value, getPayloadIndex()),
+                PointerType::get(payloadType, 0));
+            for(size_t j = 0; j < parameters.size(); ++j) {
+                Value *field = builder.CreateStructGEP(payloadType, payload, j);
+                if(payloadType->getElementType(j)->isPointerTy()) {
+                    builder.CreateStore(func->getArg(j), field);
+                } else {
+                    const AlliumType &argType =
+                        cgctx.loweredTypes.at(ctor.parameters[j].type);
+                    storePointer(builder, argType, field, func->getArg(j));
+                }
+            }
+        }
+        builder.CreateRet(value);
+    }
+
+    // int allium_type_T_constructor(const allium_value *value)
+    //
+    // Returns the index of the value's constructor, or -1 if it is unbound.
+    Function *ctorIndex = Function::Create(
+        FunctionType::get(i32, { loweredTypePtr }, false),
+        GlobalValue::LinkageTypes::ExternalLinkage,
+        ctorIndexFuncName(name),
+        mod);
+    builder.SetInsertPoint(BasicBlock::Create(ctx, "entry", ctorIndex));
+    Value *tag = loadTag(builder, mod, loweredType, ctorIndex->getArg(0));
+    Value *index = ConstantInt::get(i32, -1, true);
+    for(size_t i = 0; i < type.constructors.size(); ++i) {
+        index = builder.CreateSelect(
+            builder.CreateICmpEQ(tag, getTagConstant(loweredType, i + 2)),
+            ConstantInt::get(i32, i),
+            index);
+    }
+    builder.CreateRet(index);
+
+    // allium_value *allium_type_T_argument(const allium_value *value, unsigned index)
+    //
+    // Returns the given argument of the value's constructor, or null if there
+    // is no such argument.
+    Function *argument = Function::Create(
+        FunctionType::get(i8Ptr, { loweredTypePtr, i32 }, false),
+        GlobalValue::LinkageTypes::ExternalLinkage,
+        argumentFuncName(name),
+        mod);
+    BasicBlock *entry = BasicBlock::Create(ctx, "entry", argument);
+    BasicBlock *none = BasicBlock::Create(ctx, "none", argument);
+    builder.SetInsertPoint(none);
+    builder.CreateRet(ConstantPointerNull::get(cast<PointerType>(i8Ptr)));
+
+    builder.SetInsertPoint(entry);
+    value = loadValue(builder, mod, loweredType, argument->getArg(0));
+    tag = builder.CreateLoad(
+        cast<StructType>(loweredType.irType)->getElementType(getTagIndex()),
+        builder.CreateStructGEP(loweredType.irType, value, getTagIndex()),
+        "tag");
+    SwitchInst *ctorSwitch = builder.CreateSwitch(tag, none, type.constructors.size());
+    for(size_t i = 0; i < type.constructors.size(); ++i) {
+        size_t arity = type.constructors[i].parameters.size();
+        if(arity == 0) {
+            continue;
+        }
+        BasicBlock *ctorBB = BasicBlock::Create(ctx, "ctor", argument);
+        ctorSwitch->addCase(getTagConstant(loweredType, i + 2), ctorBB);
+        builder.SetInsertPoint(ctorBB);
+        StructType *payloadType = cast<StructType>(loweredType.payloadTypes[i]);
+        Value *payload = builder.CreatePointerCast(
+            builder.CreateStructGEP(loweredType.irType, value, getPayloadIndex()),
+            PointerType::get(payloadType, 0));
+        SwitchInst *argSwitch = builder.CreateSwitch(argument->getArg(1), none, arity);
+        for(size_t j = 0; j < arity; ++j) {
+            BasicBlock *argBB = BasicBlock::Create(ctx, "arg", argument);
+            argSwitch->addCase(ConstantInt::get(i32, j), argBB);
+            builder.SetInsertPoint(argBB);
+            Value *field = builder.CreateStructGEP(payloadType, payload, j);
+            if(payloadType->getElementType(j)->isPointerTy()) {
+                field = builder.CreateLoad(payloadType->getElementType(j), field);
+            }
+            builder.CreateRet(builder.CreatePointerCast(field, i8Ptr));
+        }
+    }
+}
+
 void TypeGenerator::lowerAllTypes() {
-    for(const auto &type : ast.types) {
+    for(const auto &type : TypedAST::builtinTypes) {
+        lowerBuiltinType(type);
+    }
+
+    for(const auto &type : ast.getTypes()) {
         AlliumType loweredType = getIRType(type);
         buildUnifyFunc(type, loweredType);
     }
+
+    // The first partition of a shared library has the program's part of the
+    // C API.
+    if(cgctx.sharedLibrary && cgctx.partition == 0) {
+        for(const auto &type : ast.getTypes()) {
+            buildValueAPI(type, cgctx.loweredTypes.at(type.declaration.name));
+        }
+    }
 }
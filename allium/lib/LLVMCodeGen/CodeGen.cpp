@@ -1,31 +1,83 @@
+#include <atomic>
 #include <cstdlib>
+#include <functional>
 #include <map>
 #include <set>
 #include <cstdio>
+#include <filesystem>
+#include <thread>
 #include <vector>
 
 #include <llvm/ADT/APInt.h>
 #include <llvm/Analysis/LoopAnalysisManager.h>
 #include <llvm/Analysis/CGSCCPassManager.h>
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/ExecutionEngine/Orc/ExecutionUtils.h>
+#include <llvm/ExecutionEngine/Orc/LLJIT.h>
+#include <llvm/Linker/Linker.h>
 #include <llvm/Transforms/Coroutines.h>
 #include <llvm/Transforms/IPO.h>
 #include <llvm/IR/LegacyPassManager.h>
 #include <llvm/IR/PassManager.h>
+#include <llvm/MC/SubtargetFeature.h>
 #include <llvm/Passes/PassBuilder.h>
+#include <llvm/Support/FileSystem.h>
 #include <llvm/Support/Host.h>
+#include <llvm/Support/Program.h>
 // #include <llvm/Support/TargetRegistry.h>
 #include <llvm/MC/TargetRegistry.h>
 #include <llvm/Support/TargetSelect.h>
 #include <llvm/Target/TargetOptions.h>
+#include <llvm/Transforms/IPO/Internalize.h>
 
 #include "LLVMCodeGen/CGType.h"
 #include "LLVMCodeGen/CGPred.h"
 #include "LLVMCodeGen/CodeGen.h"
+#include "LLVMCodeGen/LibraryAPI.h"
+#include "LLVMCodeGen/ObjectCache.h"
+#include "LLVMCodeGen/ProfileInstrumentor.h"
+#include "SemAna/DeterminismAnalysis.h"
+#include "SemAna/PredRecursionAnalysis.h"
 #include "SemAna/TypedAST.h"
 
 using namespace llvm;
 
-void lower(CGContext &cgctx) {
+// Defined by the runtime library, which is linked into the compiler for the
+// sake of --jit.
+extern "C" void allium_init();
+
+// The bitcode of libAllium.ll, which is embedded by the build.
+extern const unsigned char alliumRuntimeBitcode[];
+extern const size_t alliumRuntimeBitcodeSize;
+
+/// Links the always-inlined parts of the runtime library into the module.
+/// This must happen before optimization, so that they can be inlined.
+static void linkRuntime(CGContext &cgctx) {
+    MemoryBufferRef buffer(
+        StringRef(
+            reinterpret_cast<const char*>(alliumRuntimeBitcode),
+            alliumRuntimeBitcodeSize),
+        "libAllium.bc");
+    Expected<std::unique_ptr<Module>> runtime = parseBitcodeFile(buffer, cgctx.ctx);
+    if(!runtime) {
+        errs() << "Failed to load the runtime library: "
+               << toString(runtime.takeError()) << "\n";
+        exit(2);
+    }
+
+    (*runtime)->setDataLayout(cgctx.mod.getDataLayout());
+    (*runtime)->setTargetTriple(cgctx.mod.getTargetTriple());
+    if(Linker::linkModules(cgctx.mod, std::move(*runtime), Linker::LinkOnlyNeeded)) {
+        errs() << "Failed to link the runtime library.\n";
+        exit(2);
+    }
+}
+
+/// Lowers one partition of the program, made up of the given predicates, into
+/// `cgctx`'s module. Every partition has all of the program's types, and the
+/// first partition also has the program's entry point.
+void lower(CGContext &cgctx, const std::vector<const TypedAST::UserPredicate*> &predicates) {
     Constant *logLevel = cgctx.mod.getOrInsertGlobal("logLevel", Type::getInt32Ty(cgctx.ctx));
     cgctx.mod.getNamedGlobal("logLevel")->setLinkage(GlobalValue::ExternalLinkage);
 
@@ -33,20 +85,178 @@ void lower(CGContext &cgctx) {
     typeGenerator.lowerAllTypes();
 
     PredicateGenerator predGenerator(cgctx);
-    for(const auto &pred : cgctx.ast.predicates) {
-        predGenerator.lower(pred);
+    for(const auto *pred : predicates) {
+        predGenerator.lower(*pred);
+    }
+
+    // The first partition has the program's entry point: main, or the C API
+    // of a shared library.
+    if(cgctx.partition == 0 && cgctx.sharedLibrary) {
+        predGenerator.createLibraryInit();
+        for(const auto &pred : cgctx.ast.getPredicates()) {
+            if(isExported(pred)) {
+                predGenerator.createQuery(pred);
+            }
+        }
+    } else if(cgctx.partition == 0) {
+        predGenerator.createMain();
+    }
+    if(cgctx.instrumentWithLogs || !cgctx.profileOutput.empty() ||
+            !cgctx.countOutput.empty()) {
+        predGenerator.createRegistration();
+    }
+    ProfileInstrumentor(cgctx).addProfileSummary();
+    if(cgctx.debugInfo) {
+        cgctx.debugInfo->finalize();
+    }
+
+    linkRuntime(cgctx);
+
+    // A shared library exports only its C API. The rest of the program's
+    // external definitions are shared by its partitions, so they are hidden
+    // rather than internal.
+    if(cgctx.sharedLibrary) {
+        for(GlobalValue &gv : cgctx.mod.global_values()) {
+            if(!gv.isDeclaration() && !gv.hasLocalLinkage() &&
+                    !gv.getName().startswith("allium_")) {
+                gv.setVisibility(GlobalValue::HiddenVisibility);
+            }
+        }
     }
+}
 
-    predGenerator.createMain();
+/// Returns the number of threads which compile the program.
+static size_t getThreadCount(const compiler::Config &config) {
+    if(config.threads > 0) {
+        return config.threads;
+    }
+    return std::max(std::thread::hardware_concurrency(), 1u);
 }
 
-static TargetMachine *initLLVM() {
+/// Calls `task` with each index less than `count`, using up to `threadCount`
+/// threads.
+static void forEachConcurrently(
+    size_t count,
+    size_t threadCount,
+    const std::function<void(size_t)> &task
+) {
+    // Each worker repeatedly claims the next index. The calling thread is one
+    // of the workers, which avoids spawning any threads for a single task.
+    // Names created by the workers are interned in the caller's symbol table.
+    std::atomic<size_t> next = 0;
+    SymbolTable &symbols = SymbolTable::current();
+    auto worker = [&]() {
+        SymbolTable::Scope scope(symbols);
+        for(size_t i = next++; i < count; i = next++) {
+            task(i);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for(size_t i = 1; i < std::min(threadCount, count); ++i) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for(std::thread &thread : threads) {
+        thread.join();
+    }
+}
+
+/// Splits the program's predicates into at most `count` partitions of similar
+/// size. Mutually recursive predicates are always in the same partition, so
+/// that they can be optimized together. Within a partition, predicates are in
+/// the same order as in the AST.
+static std::vector<std::vector<const TypedAST::UserPredicate*>> partitionPredicates(
+    const TypedAST::AST &ast,
+    size_t count
+) {
+    std::vector<std::vector<Name<TypedAST::Predicate>>> components =
+        TypedAST::PredDependenceGraph(ast).getStronglyConnectedComponents(ast);
+    count = std::max<size_t>(std::min(count, components.size()), 1);
+
+    std::unordered_map<Name<TypedAST::Predicate>, size_t> weights;
+    for(const auto &pred : ast.getPredicates()) {
+        weights[pred.declaration.name] = 1 + pred.implications.size();
+    }
+    std::vector<size_t> componentWeights;
+    for(const auto &component : components) {
+        size_t weight = 0;
+        for(const auto &name : component) {
+            weight += weights.at(name);
+        }
+        componentWeights.push_back(weight);
+    }
+
+    // Each component, from the largest to the smallest, goes to the partition
+    // which is the smallest so far.
+    std::vector<size_t> order(components.size());
+    for(size_t i = 0; i < order.size(); ++i) {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return componentWeights[a] > componentWeights[b];
+    });
+    std::vector<size_t> partitionWeights(count);
+    std::unordered_map<Name<TypedAST::Predicate>, size_t> partitionOf;
+    for(size_t c : order) {
+        size_t smallest = std::min_element(
+            partitionWeights.begin(),
+            partitionWeights.end()) - partitionWeights.begin();
+        partitionWeights[smallest] += componentWeights[c];
+        for(const auto &name : components[c]) {
+            partitionOf[name] = smallest;
+        }
+    }
+
+    std::vector<std::vector<const TypedAST::UserPredicate*>> partitions(count);
+    for(const auto &pred : ast.getPredicates()) {
+        partitions[partitionOf.at(pred.declaration.name)].push_back(&pred);
+    }
+    return partitions;
+}
+
+static OptimizationLevel getOptimizationLevel(unsigned level) {
+    switch(level) {
+    case 0: return OptimizationLevel::O0;
+    case 1: return OptimizationLevel::O1;
+    case 2: return OptimizationLevel::O2;
+    default: return OptimizationLevel::O3;
+    }
+}
+
+static CodeGenOpt::Level getCodeGenOptLevel(unsigned level) {
+    switch(level) {
+    case 0: return CodeGenOpt::None;
+    case 1: return CodeGenOpt::Less;
+    case 2: return CodeGenOpt::Default;
+    default: return CodeGenOpt::Aggressive;
+    }
+}
+
+/// Returns the features of the host CPU in the form expected by
+/// `Target::createTargetMachine`.
+static std::string getHostCPUFeatures() {
+    StringMap<bool> hostFeatures;
+    SubtargetFeatures features;
+    if(sys::getHostCPUFeatures(hostFeatures)) {
+        for(const auto &feature : hostFeatures) {
+            features.AddFeature(feature.first(), feature.second);
+        }
+    }
+    return features.getString();
+}
+
+static void initLLVM() {
     InitializeAllTargetInfos();
     InitializeAllTargets();
     InitializeAllTargetMCs();
     InitializeAllAsmParsers();
     InitializeAllAsmPrinters();
+}
 
+/// Creates a target machine for `config`. Each partition of the program has a
+/// target machine of its own, since they aren't safe to share between threads.
+static std::unique_ptr<TargetMachine> createTargetMachine(const compiler::Config &config) {
     auto targetTriple = sys::getDefaultTargetTriple();
     std::string error;
     auto target = TargetRegistry::lookupTarget(targetTriple, error);
@@ -55,77 +265,403 @@ static TargetMachine *initLLVM() {
         return nullptr;
     }
 
+    std::string cpu = config.cpu;
+    std::string features;
+    if(cpu == "native") {
+        cpu = sys::getHostCPUName().str();
+        features = getHostCPUFeatures();
+    }
+
+    // Shared libraries need position-independent code.
     llvm::Optional<Reloc::Model> relocModel;
-    return target->createTargetMachine(
+    if(config.outputType == compiler::OutputType::SHARED_LIBRARY) {
+        relocModel = Reloc::PIC_;
+    }
+    return std::unique_ptr<TargetMachine>(target->createTargetMachine(
         targetTriple,
-        "generic",
-        "",
+        cpu,
+        features,
         {},
-        relocModel);
+        relocModel,
+        llvm::None,
+        getCodeGenOptLevel(config.optimizationLevel)));
+}
+
+/// Builds the optimization pipeline for the program. The default pipelines
+/// include coroutine lowering at every optimization level.
+static ModulePassManager buildPipeline(PassBuilder &pb, const compiler::Config &config) {
+    OptimizationLevel level = getOptimizationLevel(config.optimizationLevel);
+
+    if(!config.linkTimeOptimization) {
+        if(level == OptimizationLevel::O0) {
+            return pb.buildO0DefaultPipeline(level);
+        }
+        return pb.buildPerModuleDefaultPipeline(level);
+    }
+
+    ModulePassManager mpm = pb.buildLTOPreLinkDefaultPipeline(level);
+    if(config.outputType == compiler::OutputType::EXECUTABLE) {
+        // The module holds the whole program except for the runtime library's
+        // shared object, so everything but the entry point can be internalized
+        // before optimizing the program as a whole.
+        mpm.addPass(InternalizePass([](const GlobalValue &gv) {
+            return gv.getName() == "main";
+        }));
+        mpm.addPass(pb.buildLTODefaultPipeline(level, nullptr));
+    } else if(config.outputType == compiler::OutputType::SHARED_LIBRARY) {
+        // Likewise, a shared library only needs to export its C API.
+        mpm.addPass(InternalizePass([](const GlobalValue &gv) {
+            return gv.getName().startswith("allium_");
+        }));
+        mpm.addPass(pb.buildLTODefaultPipeline(level, nullptr));
+    }
+    return mpm;
 }
 
-void cgProgram(const TypedAST::AST &ast, compiler::Config config) {
-    TargetMachine *tm = initLLVM();
-    if(!tm) {
+/// A part of the program which is lowered, optimized and emitted in a module
+/// of its own, concurrently with the other partitions.
+struct Partition {
+    std::unique_ptr<TargetMachine> tm;
+    std::unique_ptr<CGContext> cgctx;
+
+    /// The predicates which are lowered into the partition.
+    std::vector<const TypedAST::UserPredicate*> predicates;
+
+    /// The partition's object file in the object cache, if there is one. Such
+    /// a partition is neither lowered nor emitted.
+    std::string cachedObject;
+};
+
+/// Splits the program into partitions, without lowering them. With link-time
+/// optimization, the program is a single partition, since it is optimized as a
+/// whole.
+static std::vector<Partition> createPartitions(
+    const TypedAST::AST &ast,
+    const compiler::Config &config
+) {
+    Profile profile;
+    if(!config.profileUse.empty() && !readProfile(config.profileUse, profile)) {
+        errs() << "Could not read profile " << config.profileUse << "\n";
         exit(1);
     }
 
-    CGContext cgctx(ast, tm);
-    cgctx.instrumentWithLogs = config.debug;
-    lower(cgctx);
+    size_t threadCount = getThreadCount(config);
+    auto predicates = partitionPredicates(
+        ast,
+        config.linkTimeOptimization ? 1 : threadCount);
 
-    if(config.printLLVMIR) {
-        cgctx.mod.print(llvm::outs(), nullptr);
+    auto semideterministicPredicates = TypedAST::getSemideterministicPredicates(ast);
+
+    std::vector<Partition> partitions(predicates.size());
+    for(size_t i = 0; i < partitions.size(); ++i) {
+        partitions[i].tm = createTargetMachine(config);
+        if(!partitions[i].tm) {
+            exit(1);
+        }
+        auto cgctx = std::make_unique<CGContext>(ast, partitions[i].tm.get());
+        cgctx->partition = i;
+        cgctx->partitionCount = partitions.size();
+        cgctx->instrumentWithLogs = config.debug;
+        cgctx->sharedLibrary = !config.jit &&
+            config.outputType == compiler::OutputType::SHARED_LIBRARY;
+        if(config.debug) {
+            cgctx->debugInfo = std::make_unique<DebugInfoGenerator>(
+                cgctx->mod,
+                config.sourceFiles,
+                config.predicateModules);
+        }
+        cgctx->compactLayout = config.compactLayout;
+        cgctx->profileOutput = config.profileGenerate;
+        cgctx->profile = profile;
+        cgctx->countOutput = config.countOutput;
+        cgctx->semideterministicPredicates = semideterministicPredicates;
+        partitions[i].cgctx = std::move(cgctx);
+        partitions[i].predicates = std::move(predicates[i]);
     }
+    return partitions;
+}
 
-    std::string objFileName;
-    if(config.outputType == compiler::OutputType::OBJECT) {
-        objFileName = config.outputFile;
-    } else {
-        char objTmpName[L_tmpnam];
-        if(!std::tmpnam(objTmpName)) {
-            std::cout << "Failed to create temporary object file!" << std::endl;
-            exit(2);
+/// Lowers each partition which isn't in the object cache, and prints their
+/// modules if requested.
+static void lowerPartitions(
+    std::vector<Partition> &partitions,
+    const compiler::Config &config
+) {
+    forEachConcurrently(partitions.size(), getThreadCount(config), [&](size_t i) {
+        if(partitions[i].cachedObject.empty()) {
+            lower(*partitions[i].cgctx, partitions[i].predicates);
         }
-        objFileName = std::string(objTmpName);
-    }   
+    });
 
-    std::error_code ec;
-    raw_fd_ostream dest(objFileName, ec);
-    if (ec) {
-        errs() << "Could not open file: " << ec.message();
-        return;
+    if(config.printLLVMIR) {
+        for(const Partition &partition : partitions) {
+            if(partition.cachedObject.empty()) {
+                partition.cgctx->mod.print(llvm::outs(), nullptr);
+            }
+        }
     }
+}
 
+/// Runs the optimization pipeline selected by `config` over the module.
+static void optimize(CGContext &cgctx, TargetMachine *tm, const compiler::Config &config) {
     LoopAnalysisManager lam;
     FunctionAnalysisManager fam;
     CGSCCAnalysisManager cgam;
     ModuleAnalysisManager mam;
 
-    PassBuilder pb;
+    PassBuilder pb(tm);
     pb.registerModuleAnalyses(mam);
     pb.registerCGSCCAnalyses(cgam);
     pb.registerFunctionAnalyses(fam);
     pb.registerLoopAnalyses(lam);
     pb.crossRegisterProxies(lam, fam, cgam, mam);
 
-    // The default pipeline includes coroutine lowering.
-    ModulePassManager mpm = pb.buildPerModuleDefaultPipeline(OptimizationLevel::O1);
-
+    ModulePassManager mpm = buildPipeline(pb, config);
     mpm.run(cgctx.mod, mam);
+}
+
+/// Optimizes a partition and writes it to an object file. Returns false if
+/// the object file can't be written.
+static bool emitPartition(
+    Partition &partition,
+    const std::string &objFileName,
+    const compiler::Config &config
+) {
+    std::error_code ec;
+    raw_fd_ostream dest(objFileName, ec);
+    if (ec) {
+        errs() << "Could not open file: " << ec.message();
+        return false;
+    }
+
+    optimize(*partition.cgctx, partition.tm.get(), config);
+
+    // With link-time optimization, an object file holds bitcode which is
+    // optimized again when it is linked.
+    if(config.linkTimeOptimization &&
+            config.outputType == compiler::OutputType::OBJECT) {
+        WriteBitcodeToFile(partition.cgctx->mod, dest);
+        dest.flush();
+        return true;
+    }
 
     // As of LLVM 14, backend code generation only works with the legacy pass
     // manager.
     legacy::PassManager pm;
-    if(tm->addPassesToEmitFile(pm, dest, nullptr, CGFT_ObjectFile)) {
+    if(partition.tm->addPassesToEmitFile(pm, dest, nullptr, CGFT_ObjectFile)) {
         errs() << "TheTargetMachine can't emit a file of this type";
-        return;
+        return false;
     }
-    pm.run(cgctx.mod);
+    pm.run(partition.cgctx->mod);
     dest.flush();
-    // TODO: this presumably only works on MacOS!
-    system(
-        (std::string("ld -o ") + config.outputFile + " " + std::string(objFileName) +
-        std::string(" -syslibroot /Library/Developer/CommandLineTools/SDKs/MacOSX12.sdk -lSystem"
-                    " -L /Users/jacobweightman/code/cpp/allium/build/allium -lAllium")).c_str());
+    return true;
+}
+
+/// Links object files by running the C compiler which built Allium with
+/// `arguments`. Returns whether linking succeeded.
+static bool link(const std::vector<std::string> &arguments) {
+    ErrorOr<std::string> linker = sys::findProgramByName(ALLIUM_LINKER);
+    if(!linker) {
+        errs() << "Could not find the linker " << ALLIUM_LINKER << ": "
+               << linker.getError().message() << "\n";
+        return false;
+    }
+
+    // The arguments are passed to the linker as they are, without a shell.
+    std::vector<StringRef> argv = { *linker };
+    argv.insert(argv.end(), arguments.begin(), arguments.end());
+    std::string error;
+    if(sys::ExecuteAndWait(*linker, argv, llvm::None, {}, 0, 0, &error) != 0) {
+        errs() << "Failed to link";
+        if(!error.empty()) {
+            errs() << ": " << error;
+        }
+        errs() << "\n";
+        return false;
+    }
+    return true;
+}
+
+bool cgProgram(const TypedAST::AST &ast, compiler::Config config) {
+    initLLVM();
+    std::vector<Partition> partitions = createPartitions(ast, config);
+
+    // Partitions whose object code is already in the object cache are reused.
+    // Printing LLVM IR needs every partition to be lowered, so it only stores
+    // objects in the cache.
+    bool useObjectCache = !config.objectCacheDirectory.empty();
+    std::vector<uint64_t> hashes(partitions.size());
+    if(useObjectCache) {
+        for(size_t i = 0; i < partitions.size(); ++i) {
+            hashes[i] = hashPartition(
+                *partitions[i].cgctx,
+                partitions[i].predicates,
+                *partitions[i].tm,
+                config);
+            if(!config.printLLVMIR) {
+                partitions[i].cachedObject = findCachedObject(
+                    config.objectCacheDirectory,
+                    hashes[i]);
+            }
+        }
+    }
+    lowerPartitions(partitions, config);
+
+    // An object file with a single partition is written directly. Otherwise,
+    // each partition is written to a temporary object file, and they are
+    // linked together. Cached objects are linked from the cache. Temporary
+    // object files are removed once the program is linked.
+    bool isSingleObject = config.outputType == compiler::OutputType::OBJECT &&
+        partitions.size() == 1;
+    std::vector<std::string> objFileNames;
+    std::vector<std::string> temporaries;
+    auto removeTemporaries = [&]() {
+        for(const std::string &temporary : temporaries) {
+            sys::fs::remove(temporary);
+        }
+    };
+    for(size_t i = 0; i < partitions.size(); ++i) {
+        if(isSingleObject) {
+            objFileNames.push_back(config.outputFile);
+        } else if(!partitions[i].cachedObject.empty()) {
+            objFileNames.push_back(partitions[i].cachedObject);
+        } else {
+            SmallString<128> path;
+            if(std::error_code ec = sys::fs::createTemporaryFile("allium", "o", path)) {
+                errs() << "Could not create a temporary object file: "
+                       << ec.message() << "\n";
+                removeTemporaries();
+                return false;
+            }
+            temporaries.push_back(path.str().str());
+            objFileNames.push_back(path.str().str());
+        }
+    }
+
+    std::atomic<bool> emitted = true;
+    forEachConcurrently(partitions.size(), getThreadCount(config), [&](size_t i) {
+        if(!partitions[i].cachedObject.empty()) {
+            if(isSingleObject) {
+                std::error_code ec;
+                std::filesystem::copy_file(
+                    partitions[i].cachedObject,
+                    objFileNames[i],
+                    std::filesystem::copy_options::overwrite_existing,
+                    ec);
+                if(ec) {
+                    errs() << "Could not write file: " << ec.message();
+                    emitted = false;
+                }
+            }
+            return;
+        }
+        if(!emitPartition(partitions[i], objFileNames[i], config)) {
+            emitted = false;
+        } else if(useObjectCache) {
+            storeCachedObject(config.objectCacheDirectory, hashes[i], objFileNames[i]);
+        }
+    });
+    if(!emitted) {
+        removeTemporaries();
+        return false;
+    }
+
+    std::vector<std::string> arguments;
+    switch(config.outputType) {
+    case compiler::OutputType::OBJECT:
+        if(partitions.size() == 1) {
+            return true;
+        }
+        arguments = { "-r", "-o", config.outputFile };
+        arguments.insert(arguments.end(), objFileNames.begin(), objFileNames.end());
+        break;
+    case compiler::OutputType::SHARED_LIBRARY:
+        if(!writeLibraryHeader(ast, config.headerFile)) {
+            errs() << "Could not write header " << config.headerFile << "\n";
+            removeTemporaries();
+            return false;
+        }
+        arguments = { "-shared", "-o", config.outputFile };
+        arguments.insert(arguments.end(), objFileNames.begin(), objFileNames.end());
+        arguments.push_back("-L" ALLIUM_RUNTIME_DIRECTORY);
+        arguments.push_back("-lAllium");
+        break;
+    case compiler::OutputType::EXECUTABLE:
+        // Executables are static, with the runtime library linked in, so they
+        // can be run anywhere without any shared objects.
+        arguments = { "-static", "-o", config.outputFile };
+        arguments.insert(arguments.end(), objFileNames.begin(), objFileNames.end());
+        arguments.push_back(ALLIUM_RUNTIME_LIBRARY);
+        break;
+    }
+
+    bool linked = link(arguments);
+    removeTemporaries();
+    return linked;
+}
+
+int jitProgram(const TypedAST::AST &ast, compiler::Config config) {
+    ExitOnError exitOnError("allium: ");
+
+    initLLVM();
+    std::vector<Partition> partitions = createPartitions(ast, config);
+    lowerPartitions(partitions, config);
+
+    // The JIT takes ownership of each module along with its context, but the
+    // modules belong to their CGContexts. They are moved into contexts of
+    // their own by round-tripping them through bitcode in memory.
+    size_t threadCount = getThreadCount(config);
+    std::vector<SmallVector<char, 0>> bitcode(partitions.size());
+    forEachConcurrently(partitions.size(), threadCount, [&](size_t i) {
+        optimize(*partitions[i].cgctx, partitions[i].tm.get(), config);
+        raw_svector_ostream bitcodeStream(bitcode[i]);
+        WriteBitcodeToFile(partitions[i].cgctx->mod, bitcodeStream);
+    });
+
+    // The JIT generates machine code for the partitions concurrently.
+    TargetMachine *tm = partitions[0].tm.get();
+    orc::JITTargetMachineBuilder jtmb(tm->getTargetTriple());
+    jtmb.setCPU(tm->getTargetCPU().str());
+    jtmb.getFeatures() = SubtargetFeatures(tm->getTargetFeatureString());
+    jtmb.setCodeGenOptLevel(getCodeGenOptLevel(config.optimizationLevel));
+    std::unique_ptr<orc::LLJIT> jit = exitOnError(
+        orc::LLJITBuilder()
+            .setJITTargetMachineBuilder(std::move(jtmb))
+            .setNumCompileThreads(partitions.size() > 1 ? threadCount : 0)
+            .create());
+
+    // Calls into the runtime library are resolved to the compiler's own copy.
+    // Its entry point is defined explicitly, which also keeps the linker from
+    // dropping the library from the compiler; the rest of it, and the C
+    // library, are found by searching the process.
+    orc::JITDylib &dylib = jit->getMainJITDylib();
+    exitOnError(dylib.define(orc::absoluteSymbols({
+        {
+            jit->mangleAndIntern("allium_init"),
+            JITEvaluatedSymbol::fromPointer(&allium_init)
+        }
+    })));
+    dylib.addGenerator(exitOnError(
+        orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(
+            jit->getDataLayout().getGlobalPrefix())));
+    for(const SmallVector<char, 0> &partitionBitcode : bitcode) {
+        auto jitCtx = std::make_unique<LLVMContext>();
+        std::unique_ptr<Module> jitMod = exitOnError(parseBitcodeFile(
+            MemoryBufferRef(
+                StringRef(partitionBitcode.data(), partitionBitcode.size()),
+                "allium"),
+            *jitCtx));
+        exitOnError(jit->addIRModule(
+            orc::ThreadSafeModule(std::move(jitMod), std::move(jitCtx))));
+    }
+
+    JITEvaluatedSymbol mainSymbol = exitOnError(jit->lookup("main"));
+    auto *main = reinterpret_cast<int (*)()>(mainSymbol.getAddress());
+    int exitCode = main();
+
+    // The program's exit handlers may still refer to its memory, such as the
+    // counters of -fprofile-generate and -fcount, so the JIT is kept alive
+    // until exit.
+    jit.release();
+    return exitCode;
 }
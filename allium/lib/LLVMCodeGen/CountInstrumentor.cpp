@@ -0,0 +1,141 @@
+#include "LibAllium/Counts.h"
+#include "LLVMCodeGen/CountInstrumentor.h"
+
+/// The name of the global which holds a predicate's counters.
+static std::string countersName(const TypedAST::UserPredicate &pred) {
+    return "__allium_counts." + pred.declaration.name.string();
+}
+
+GlobalVariable *CountInstrumentor::getCounters(const TypedAST::UserPredicate &pred) {
+    GlobalVariable *counters = cg.mod.getNamedGlobal(countersName(pred));
+    if(!counters) {
+        ArrayType *type = ArrayType::get(
+            cg.builder.getInt64Ty(),
+            1 + ALLIUM_COUNT_SIZE * pred.implications.size());
+        counters = new GlobalVariable(
+            cg.mod,
+            type,
+            false,
+            GlobalValue::InternalLinkage,
+            ConstantAggregateZero::get(type),
+            countersName(pred));
+    }
+    return counters;
+}
+
+void CountInstrumentor::count(const TypedAST::UserPredicate &pred, size_t index) {
+    // The counters may be written while the program runs, so they are
+    // incremented atomically. No ordering is needed, since each counter is
+    // independent of the others.
+    //
+    // atomicrmw add i64* %counter, i64 1 monotonic
+    GlobalVariable *counters = getCounters(pred);
+    Value *counter = cg.builder.CreateConstInBoundsGEP2_32(
+        counters->getValueType(),
+        counters,
+        0,
+        index,
+        "counter");
+    cg.builder.CreateAtomicRMW(
+        AtomicRMWInst::Add,
+        counter,
+        cg.builder.getInt64(1),
+        MaybeAlign(8),
+        AtomicOrdering::Monotonic);
+}
+
+void CountInstrumentor::count(
+    const TypedAST::UserPredicate &pred,
+    size_t impl,
+    unsigned counter
+) {
+    count(pred, 1 + ALLIUM_COUNT_SIZE * impl + counter);
+}
+
+void CountInstrumentor::countCall(const TypedAST::UserPredicate &pred) {
+    count(pred, 0);
+}
+
+void CountInstrumentor::countAttempt(const TypedAST::UserPredicate &pred, size_t impl) {
+    count(pred, impl, ALLIUM_COUNT_CALLS);
+}
+
+void CountInstrumentor::countHead(const TypedAST::UserPredicate &pred, size_t impl) {
+    count(pred, impl, ALLIUM_COUNT_HEADS);
+}
+
+void CountInstrumentor::countSolution(const TypedAST::UserPredicate &pred, size_t impl) {
+    count(pred, impl, ALLIUM_COUNT_SOLUTIONS);
+}
+
+BasicBlock *CountInstrumentor::countBacktrack(
+    const TypedAST::UserPredicate &pred,
+    size_t impl,
+    BasicBlock *retry
+) {
+    IRBuilderBase::InsertPointGuard guard(cg.builder);
+    BasicBlock *backtrack = BasicBlock::Create(
+        cg.ctx,
+        "backtrack",
+        retry->getParent(),
+        retry);
+    cg.builder.SetInsertPoint(backtrack);
+    count(pred, impl, ALLIUM_COUNT_BACKTRACKS);
+    cg.builder.CreateBr(retry);
+    return backtrack;
+}
+
+void CountInstrumentor::registerCounters() {
+    Type *i64 = cg.builder.getInt64Ty();
+    Type *i8Ptr = cg.builder.getInt8PtrTy();
+    StructType *predicateType = StructType::get(
+        cg.ctx,
+        { i8Ptr, i64, PointerType::get(i64, 0) });
+
+    // Each predicate's counters are in the partition which lowered it.
+    std::vector<Constant*> predicates;
+    for(const auto &pred : cg.ast.getPredicates()) {
+        GlobalVariable *counters = cg.mod.getNamedGlobal(countersName(pred));
+        if(!counters) {
+            continue;
+        }
+        predicates.push_back(ConstantStruct::get(predicateType, {
+            cg.builder.CreateGlobalStringPtr(
+                pred.declaration.name.string(),
+                ".pred.name",
+                0,
+                &cg.mod),
+            ConstantInt::get(i64, pred.implications.size()),
+            ConstantExpr::getInBoundsGetElementPtr(
+                counters->getValueType(),
+                counters,
+                ArrayRef<Constant*>({
+                    ConstantInt::get(i64, 0),
+                    ConstantInt::get(i64, 0),
+                })),
+        }));
+    }
+
+    ArrayType *predicatesType = ArrayType::get(predicateType, predicates.size());
+    GlobalVariable *predicatesTable = new GlobalVariable(
+        cg.mod,
+        predicatesType,
+        true,
+        GlobalValue::PrivateLinkage,
+        ConstantArray::get(predicatesType, predicates),
+        "__allium_count_predicates");
+
+    // call void @__allium_count_register(
+    //     %allium_count_predicate_t* predicates, i64 n, i8* path)
+    FunctionCallee registerFunc = cg.mod.getOrInsertFunction(
+        "__allium_count_register",
+        FunctionType::get(
+            cg.builder.getVoidTy(),
+            { PointerType::get(predicateType, 0), i64, i8Ptr },
+            false));
+    cg.builder.CreateCall(registerFunc, {
+        cg.builder.CreateConstInBoundsGEP2_32(predicatesType, predicatesTable, 0, 0),
+        cg.builder.getInt64(predicates.size()),
+        cg.builder.CreateGlobalStringPtr(cg.countOutput, ".counts.path", 0, &cg.mod),
+    });
+}
@@ -0,0 +1,11 @@
+# Generates a C++ source file which defines the contents of a bitcode file as a
+# byte array, so that the compiler does not need to find the file at run time.
+#
+# Usage: cmake -DINPUT=<file.bc> -DOUTPUT=<file.cpp> -DSYMBOL=<name> -P EmbedBitcode.cmake
+
+file(READ ${INPUT} contents HEX)
+string(REGEX REPLACE "([0-9a-f][0-9a-f])" "0x\\1," bytes "${contents}")
+file(WRITE ${OUTPUT}
+  "#include <cstddef>\n"
+  "extern const unsigned char ${SYMBOL}[] = { ${bytes} };\n"
+  "extern const size_t ${SYMBOL}Size = sizeof(${SYMBOL});\n")
@@ -0,0 +1,138 @@
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+
+#include "LLVMCodeGen/LibraryAPI.h"
+
+/// Escapes an identifier from the program for use in a C name. Underscores
+/// become "_0", so an underscore followed by a letter always separates the
+/// parts of a name.
+static std::string escape(const std::string &identifier) {
+    std::string escaped;
+    for(char c : identifier) {
+        escaped += c == '_' ? "_0" : std::string(1, c);
+    }
+    return escaped;
+}
+
+/// Returns the prefix of the names of a type's functions. Since `type` is a
+/// keyword, it can't collide with the runtime library's names or those of
+/// predicates.
+static std::string typePrefix(const Name<TypedAST::Type> &type) {
+    return "allium_type_" + escape(type.string());
+}
+
+std::string variableFuncName(const Name<TypedAST::Type> &type) {
+    return typePrefix(type) + "_variable";
+}
+
+std::string ctorFuncName(
+    const Name<TypedAST::Type> &type,
+    const Name<TypedAST::Constructor> &ctor
+) {
+    return typePrefix(type) + "_ctor_" + escape(ctor.string());
+}
+
+std::string ctorIndexFuncName(const Name<TypedAST::Type> &type) {
+    return typePrefix(type) + "_constructor";
+}
+
+std::string argumentFuncName(const Name<TypedAST::Type> &type) {
+    return typePrefix(type) + "_argument";
+}
+
+std::string queryFuncName(const Name<TypedAST::Predicate> &pred) {
+    return "allium_pred_" + escape(pred.string()) + "_query";
+}
+
+bool isExported(const TypedAST::UserPredicate &pred) {
+    const auto &effects = pred.declaration.effects;
+    return std::all_of(
+        effects.begin(),
+        effects.end(),
+        [](const TypedAST::EffectRef &effect) { return effect == "IO"; });
+}
+
+/// Returns the parameters of a C function which takes `count` values.
+static std::string valueParameters(size_t count) {
+    if(count == 0) {
+        return "void";
+    }
+    std::string parameters;
+    for(size_t i = 0; i < count; ++i) {
+        parameters += (i > 0 ? ", " : "") +
+            std::string("allium_value *arg") + std::to_string(i);
+    }
+    return parameters;
+}
+
+bool writeLibraryHeader(const TypedAST::AST &ast, const std::string &path) {
+    std::ofstream out(path);
+    if(!out) {
+        return false;
+    }
+
+    std::string guard = "ALLIUM_" +
+        std::filesystem::path(path).filename().string();
+    for(char &c : guard) {
+        c = std::isalnum(static_cast<unsigned char>(c)) ?
+            std::toupper(static_cast<unsigned char>(c)) : '_';
+    }
+
+    out << "// Generated by allium. Declares the C API of a program compiled with\n"
+        << "// -shared. See \"Shared Libraries\" in docs/ABI.md.\n"
+        << "#ifndef " << guard << "\n"
+        << "#define " << guard << "\n\n"
+        << "#include \"LibAllium/Allium.h\"\n\n"
+        << "#ifdef __cplusplus\n"
+        << "extern \"C\" {\n"
+        << "#endif\n";
+
+    for(const auto &type : ast.getTypes()) {
+        const auto &name = type.declaration.name;
+        out << "\n// type " << name << "\n";
+        if(!type.constructors.empty()) {
+            out << "enum {\n";
+            for(size_t i = 0; i < type.constructors.size(); ++i) {
+                out << "    ALLIUM_TYPE_" << escape(name.string()) << "_"
+                    << escape(type.constructors[i].name.string())
+                    << " = " << i << ",\n";
+            }
+            out << "};\n";
+        }
+        out << "allium_value *" << variableFuncName(name) << "(void);\n";
+        for(const auto &ctor : type.constructors) {
+            out << "allium_value *" << ctorFuncName(name, ctor.name) << "("
+                << valueParameters(ctor.parameters.size()) << ");\n";
+        }
+        out << "int " << ctorIndexFuncName(name)
+            << "(const allium_value *value);\n"
+            << "allium_value *" << argumentFuncName(name)
+            << "(const allium_value *value, unsigned index);\n";
+    }
+
+    for(const auto &pred : ast.getPredicates()) {
+        if(!isExported(pred)) {
+            continue;
+        }
+        const auto &params = pred.declaration.parameters;
+        out << "\n// pred " << pred.declaration.name;
+        if(!params.empty()) {
+            out << "(";
+            for(size_t i = 0; i < params.size(); ++i) {
+                out << (i > 0 ? ", " : "")
+                    << (params[i].isInputOnly ? "in " : "") << params[i].type;
+            }
+            out << ")";
+        }
+        out << "\nallium_query *" << queryFuncName(pred.declaration.name) << "("
+            << valueParameters(params.size()) << ");\n";
+    }
+
+    out << "\n#ifdef __cplusplus\n"
+        << "}\n"
+        << "#endif\n\n"
+        << "#endif // " << guard << "\n";
+    return static_cast<bool>(out);
+}
@@ -1,31 +1,76 @@
 #include <sstream>
+#include <llvm/IR/MDBuilder.h>
 #include <llvm/Transforms/Utils/BasicBlockUtils.h>
 
+#include "LibAllium/Trace.h"
 #include "LLVMCodeGen/LogInstrumentor.h"
 
-void LogInstrumentor::log(int minimumLogLevel, const std::string &message) {
+uint32_t LogInstrumentor::getPredicateID(const Name<TypedAST::Predicate> &name) {
+    const auto &predicates = cg.ast.getPredicates();
+    for(size_t i=0; i<predicates.size(); ++i) {
+        if(predicates[i].declaration.name == name) {
+            return i;
+        }
+    }
+    return ALLIUM_TRACE_NONE;
+}
+
+GlobalVariable *LogInstrumentor::getSiteBase() {
+    GlobalVariable *base = cg.mod.getNamedGlobal("__allium_trace_base");
+    if(!base) {
+        Type *i32 = cg.builder.getInt32Ty();
+        base = new GlobalVariable(
+            cg.mod,
+            i32,
+            false,
+            GlobalValue::InternalLinkage,
+            ConstantInt::get(i32, 0),
+            "__allium_trace_base");
+    }
+    return base;
+}
+
+void LogInstrumentor::log(
+    uint32_t event,
+    const std::string &message,
+    uint32_t predicate,
+    uint32_t implication
+) {
     BasicBlock *bb = cg.builder.GetInsertBlock();
     Function *f = bb->getParent();
     BasicBlock *logBB = BasicBlock::Create(cg.ctx, "log.impl", f, bb->getNextNode());
     BasicBlock *next = BasicBlock::Create(cg.ctx, "", f, bb->getNextNode());
 
+    // Tracing is usually disabled, so this branch is marked as unlikely.
     GlobalVariable *logLevelPtr = cg.mod.getNamedGlobal("logLevel");
     assert(logLevelPtr && "couldn't find global variable logLevel");
     Value *logLevel = cg.builder.CreateLoad(Type::getInt32Ty(cg.ctx), logLevelPtr, "log.level");
-    Constant *threshold = ConstantInt::get(Type::getInt32Ty(cg.ctx), minimumLogLevel);
+    Constant *threshold = ConstantInt::get(Type::getInt32Ty(cg.ctx), event);
     Value *cmp = cg.builder.CreateCmp(CmpInst::Predicate::ICMP_SGE, logLevel, threshold);
-    cg.builder.CreateCondBr(cmp, logBB, next);
+    cg.builder.CreateCondBr(
+        cmp,
+        logBB,
+        next,
+        MDBuilder(cg.ctx).createBranchWeights(1, 2000));
 
+    // Sites are numbered within a partition, and the runtime library numbers
+    // each partition's first site when it is registered.
+    //
+    // call void @__allium_trace(i32 event, i32 site, i32 predicate, i32 implication)
     cg.builder.SetInsertPoint(logBB);
-    llvm::FunctionCallee printf = cg.mod.getOrInsertFunction(
-        "printf",
-        llvm::FunctionType::get(
-            llvm::IntegerType::get(cg.ctx, 32),
-            { PointerType::getInt8PtrTy(cg.ctx) },
-            true));
-    llvm::Value *msgValue = cg.builder.CreateGlobalStringPtr(message);
-    cg.builder.CreateCall(printf, { msgValue });
+    Type *i32 = cg.builder.getInt32Ty();
+    Value *base = cg.builder.CreateLoad(i32, getSiteBase(), "site.base");
+    FunctionCallee trace = cg.mod.getOrInsertFunction(
+        "__allium_trace",
+        FunctionType::get(cg.builder.getVoidTy(), { i32, i32, i32, i32 }, false));
+    cg.builder.CreateCall(trace, {
+        cg.builder.getInt32(event),
+        cg.builder.CreateAdd(base, cg.builder.getInt32(cg.traceSites.size()), "site"),
+        cg.builder.getInt32(predicate),
+        cg.builder.getInt32(implication),
+    });
     cg.builder.CreateBr(next);
+    cg.traceSites.push_back(message);
 
     cg.builder.SetInsertPoint(next);
 }
@@ -33,17 +78,48 @@ void LogInstrumentor::log(int minimumLogLevel, const std::string &message) {
 void LogInstrumentor::logEffect(const TypedAST::EffectCtorRef &ec) {
     std::ostringstream message;
     message << "handle effect: " << ec.effectName << "." << ec.ctorName << "\n";
-    log(1, message.str());
+    log(ALLIUM_TRACE_EFFECT, message.str(), ALLIUM_TRACE_NONE, ALLIUM_TRACE_NONE);
 }
 
 void LogInstrumentor::logSubproof(const TypedAST::PredicateRef &pr) {
     std::stringstream message;
     message << "prove: " << pr << "\n";
-    log(2, message.str());
+    log(ALLIUM_TRACE_SUBPROOF, message.str(), getPredicateID(pr.name), ALLIUM_TRACE_NONE);
 }
 
-void LogInstrumentor::logImplication(const TypedAST::Implication &impl) {
+void LogInstrumentor::logImplication(
+    const TypedAST::PredicateDecl &pred,
+    const TypedAST::Implication &impl,
+    size_t index
+) {
     std::stringstream message;
     message << "  try implication: " << impl << std::endl;
-    log(3, message.str());
+    log(ALLIUM_TRACE_IMPLICATION, message.str(), getPredicateID(pred.name), index);
+}
+
+void LogInstrumentor::registerSites() {
+    Type *i8Ptr = cg.builder.getInt8PtrTy();
+    std::vector<Constant*> sites;
+    for(const std::string &site : cg.traceSites) {
+        sites.push_back(cg.builder.CreateGlobalStringPtr(site, ".site", 0, &cg.mod));
+    }
+    ArrayType *sitesType = ArrayType::get(i8Ptr, sites.size());
+    GlobalVariable *sitesTable = new GlobalVariable(
+        cg.mod,
+        sitesType,
+        true,
+        GlobalValue::PrivateLinkage,
+        ConstantArray::get(sitesType, sites),
+        "__allium_trace_sites");
+
+    // %base = call i32 @__allium_trace_register(i8** sites, i32 count)
+    Type *i32 = cg.builder.getInt32Ty();
+    FunctionCallee registerFunc = cg.mod.getOrInsertFunction(
+        "__allium_trace_register",
+        FunctionType::get(i32, { PointerType::get(i8Ptr, 0), i32 }, false));
+    Value *base = cg.builder.CreateCall(registerFunc, {
+        cg.builder.CreateConstInBoundsGEP2_32(sitesType, sitesTable, 0, 0),
+        cg.builder.getInt32(sites.size()),
+    }, "site.base");
+    cg.builder.CreateStore(base, getSiteBase());
 }
@@ -0,0 +1,227 @@
+#include <algorithm>
+#include <filesystem>
+#include <random>
+#include <sstream>
+#include <llvm/Config/llvm-config.h>
+
+#include "LLVMCodeGen/ObjectCache.h"
+#include "SemAna/ASTPrinter.h"
+
+static const char *alliumVersion = ALLIUM_VERSION;
+static const char *alliumBuildId = ALLIUM_BUILD_ID;
+
+// The bitcode of libAllium.ll, which is linked into every partition.
+extern const unsigned char alliumRuntimeBitcode[];
+extern const size_t alliumRuntimeBitcodeSize;
+
+namespace {
+
+/// Accumulates a 64-bit FNV-1a hash.
+class Hasher {
+public:
+    void add(std::string_view bytes) {
+        // Include the size of each field, so that moving text from the end of
+        // one field to the start of the next changes the hash.
+        uint64_t size = bytes.size();
+        addBytes(std::string_view((const char *) &size, sizeof(size)));
+        addBytes(bytes);
+    }
+
+    void add(uint64_t value) {
+        addBytes(std::string_view((const char *) &value, sizeof(value)));
+    }
+
+    uint64_t get() const { return hash; }
+
+private:
+    void addBytes(std::string_view bytes) {
+        for(unsigned char c : bytes) {
+            hash ^= c;
+            hash *= 0x100000001b3;
+        }
+    }
+
+    uint64_t hash = 0xcbf29ce484222325;
+};
+
+void addLocation(Hasher &hasher, SourceLocation location) {
+    hasher.add((uint64_t) location.lineNumber);
+    hasher.add((uint64_t) location.columnNumber);
+}
+
+/// Adds the locations of the subgoals of an expression, which debug info
+/// refers to but the AST printer leaves out.
+void addLocations(Hasher &hasher, const TypedAST::Expression &expr) {
+    expr.switchOver(
+    [](TypedAST::TruthLiteral &) {},
+    [&](TypedAST::PredicateRef &pr) { addLocation(hasher, pr.location); },
+    [&](TypedAST::EffectCtorRef &ecr) {
+        addLocation(hasher, ecr.location);
+        addLocations(hasher, ecr.getContinuation());
+    },
+    [&](TypedAST::Conjunction &conj) {
+        addLocations(hasher, conj.getLeft());
+        addLocations(hasher, conj.getRight());
+    });
+}
+
+void addLocations(Hasher &hasher, const TypedAST::HandlerExpression &hExpr) {
+    hExpr.switchOver(
+    [](TypedAST::TruthLiteral &) {},
+    [](TypedAST::Continuation &) {},
+    [&](TypedAST::PredicateRef &pr) { addLocation(hasher, pr.location); },
+    [&](TypedAST::EffectCtorRef &ecr) {
+        addLocation(hasher, ecr.location);
+        addLocations(hasher, ecr.getContinuation());
+    },
+    [&](TypedAST::HandlerConjunction &hConj) {
+        addLocations(hasher, hConj.getLeft());
+        addLocations(hasher, hConj.getRight());
+    });
+}
+
+uint64_t runtimeBitcodeHash() {
+    static const uint64_t hash = []() {
+        Hasher hasher;
+        hasher.add(std::string_view(
+            reinterpret_cast<const char*>(alliumRuntimeBitcode),
+            alliumRuntimeBitcodeSize));
+        return hasher.get();
+    }();
+    return hash;
+}
+
+} // namespace
+
+uint64_t hashPartition(
+    const CGContext &cgctx,
+    const std::vector<const TypedAST::UserPredicate*> &predicates,
+    const TargetMachine &tm,
+    const compiler::Config &config
+) {
+    Hasher hasher;
+    hasher.add(alliumVersion);
+    hasher.add(alliumBuildId);
+    hasher.add(LLVM_VERSION_STRING);
+    hasher.add(runtimeBitcodeHash());
+
+    hasher.add(tm.getTargetTriple().str());
+    hasher.add(tm.getTargetCPU());
+    hasher.add(tm.getTargetFeatureString());
+    hasher.add(config.optimizationLevel);
+    hasher.add(config.linkTimeOptimization);
+    hasher.add(cgctx.instrumentWithLogs);
+    hasher.add(cgctx.sharedLibrary);
+    hasher.add(cgctx.compactLayout);
+    hasher.add(cgctx.profileOutput);
+    hasher.add(cgctx.countOutput);
+
+    // The first partition has the program's entry point, which registers the
+    // instrumentation of every partition.
+    hasher.add(cgctx.partition);
+    hasher.add(cgctx.partitionCount);
+
+    // Every partition has a summary of the whole profile.
+    std::vector<std::pair<std::string, uint64_t>> profile(
+        cgctx.profile.begin(),
+        cgctx.profile.end());
+    std::sort(profile.begin(), profile.end());
+    for(const auto &[counter, count] : profile) {
+        hasher.add(counter);
+        hasher.add(count);
+    }
+
+    // Semideterministic predicates are called differently, and whether a
+    // predicate is semideterministic depends on its implications, which may be
+    // in another partition.
+    for(const auto &name : cgctx.semideterministicPredicates) {
+        hasher.add(name.string());
+    }
+
+    // Every partition lowers all of the program's types and effects. The
+    // signatures of all predicates are included, rather than only those which
+    // the partition calls, since traces identify predicates by their position
+    // among all of the program's predicates.
+    std::ostringstream program;
+    TypedAST::ASTPrinter printer(program);
+    for(const auto &type : cgctx.ast.getTypes()) {
+        printer.visit(type);
+    }
+    for(const auto &effect : cgctx.ast.getEffects()) {
+        printer.visit(effect);
+    }
+    for(const auto &pred : cgctx.ast.getPredicates()) {
+        printer.visit(pred.declaration);
+    }
+    for(const auto *pred : predicates) {
+        printer.visit(*pred);
+    }
+    hasher.add(program.str());
+
+    // Debug info also depends on where each predicate is in the source.
+    if(cgctx.debugInfo) {
+        for(const std::string &path : config.sourceFiles) {
+            hasher.add(path);
+        }
+        for(const auto *pred : predicates) {
+            auto module = config.predicateModules.find(pred->declaration.name.string());
+            hasher.add(module != config.predicateModules.end() ? module->second : 0);
+            addLocation(hasher, pred->declaration.location);
+            for(const auto &impl : pred->implications) {
+                addLocation(hasher, impl.head.location);
+                addLocations(hasher, impl.body);
+            }
+            for(const auto &handler : pred->handlers) {
+                for(const auto &hImpl : handler.implications) {
+                    addLocation(hasher, hImpl.head.location);
+                    addLocations(hasher, hImpl.body);
+                }
+            }
+        }
+    }
+
+    return hasher.get();
+}
+
+static std::filesystem::path objectPath(
+    const std::string &cacheDirectory,
+    uint64_t hash
+) {
+    std::ostringstream name;
+    name << std::hex << hash << ".o";
+    return std::filesystem::path(cacheDirectory) / name.str();
+}
+
+std::string findCachedObject(const std::string &cacheDirectory, uint64_t hash) {
+    std::filesystem::path path = objectPath(cacheDirectory, hash);
+    std::error_code error;
+    if(!std::filesystem::is_regular_file(path, error) ||
+            std::filesystem::file_size(path, error) == 0 ||
+            error) {
+        return "";
+    }
+    return path.string();
+}
+
+void storeCachedObject(
+    const std::string &cacheDirectory,
+    uint64_t hash,
+    const std::string &objFileName
+) {
+    std::error_code error;
+    std::filesystem::create_directories(cacheDirectory, error);
+    if(error) return;
+
+    std::filesystem::path path = objectPath(cacheDirectory, hash);
+    std::filesystem::path temporaryPath = path;
+    temporaryPath += "." + std::to_string(std::random_device()()) + ".tmp";
+
+    std::filesystem::copy_file(objFileName, temporaryPath, error);
+    if(error) {
+        std::filesystem::remove(temporaryPath, error);
+        return;
+    }
+
+    std::filesystem::rename(temporaryPath, path, error);
+    if(error) std::filesystem::remove(temporaryPath, error);
+}
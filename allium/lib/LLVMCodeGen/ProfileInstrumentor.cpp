@@ -0,0 +1,175 @@
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <llvm/IR/MDBuilder.h>
+#include <llvm/ProfileData/InstrProf.h>
+#include <llvm/ProfileData/ProfileCommon.h>
+
+#include "LLVMCodeGen/ProfileInstrumentor.h"
+
+bool readProfile(const std::string &path, Profile &profile) {
+    std::ifstream file(path);
+    if(!file) {
+        return false;
+    }
+
+    // Each line holds the name of a counter and its count. Lines which begin
+    // with '#' are comments.
+    std::string line;
+    while(std::getline(file, line)) {
+        if(line.empty() || line[0] == '#') {
+            continue;
+        }
+        std::istringstream fields(line);
+        std::string counter;
+        uint64_t count;
+        if(!(fields >> counter >> count)) {
+            return false;
+        }
+        profile[counter] += count;
+    }
+    return true;
+}
+
+std::string ProfileInstrumentor::callCounter(const TypedAST::PredicateDecl &pred) {
+    return mangledPredName(pred.name) + ".calls";
+}
+
+std::string ProfileInstrumentor::attemptCounter(
+    const TypedAST::PredicateDecl &pred,
+    size_t impl
+) {
+    return mangledPredName(pred.name) + "." + std::to_string(impl) + ".attempts";
+}
+
+std::string ProfileInstrumentor::matchCounter(
+    const TypedAST::PredicateDecl &pred,
+    size_t impl
+) {
+    return mangledPredName(pred.name) + "." + std::to_string(impl) + ".matches";
+}
+
+void ProfileInstrumentor::count(const std::string &counter) {
+    // Compiled programs are single threaded, so the counters are not atomic.
+    Type *i64 = cg.builder.getInt64Ty();
+    GlobalVariable *global = new GlobalVariable(
+        cg.mod,
+        i64,
+        false,
+        GlobalValue::InternalLinkage,
+        ConstantInt::get(i64, 0),
+        "__allium_count");
+    cg.profileCounters.push_back({ counter, global });
+
+    Value *value = cg.builder.CreateLoad(i64, global, "count");
+    cg.builder.CreateStore(cg.builder.CreateAdd(value, cg.builder.getInt64(1)), global);
+}
+
+void ProfileInstrumentor::countCall(const TypedAST::PredicateDecl &pred) {
+    count(callCounter(pred));
+}
+
+void ProfileInstrumentor::countAttempt(const TypedAST::PredicateDecl &pred, size_t impl) {
+    count(attemptCounter(pred, impl));
+}
+
+void ProfileInstrumentor::countMatch(const TypedAST::PredicateDecl &pred, size_t impl) {
+    count(matchCounter(pred, impl));
+}
+
+void ProfileInstrumentor::registerCounters() {
+    Type *i64 = cg.builder.getInt64Ty();
+    Type *i8Ptr = cg.builder.getInt8PtrTy();
+    Type *counterPtr = PointerType::get(i64, 0);
+
+    std::vector<Constant*> counters;
+    std::vector<Constant*> names;
+    for(const auto &[name, global] : cg.profileCounters) {
+        counters.push_back(global);
+        names.push_back(cg.builder.CreateGlobalStringPtr(name, ".counter.name", 0, &cg.mod));
+    }
+
+    ArrayType *countersType = ArrayType::get(counterPtr, counters.size());
+    GlobalVariable *countersTable = new GlobalVariable(
+        cg.mod,
+        countersType,
+        true,
+        GlobalValue::PrivateLinkage,
+        ConstantArray::get(countersType, counters),
+        "__allium_counters");
+    ArrayType *namesType = ArrayType::get(i8Ptr, names.size());
+    GlobalVariable *namesTable = new GlobalVariable(
+        cg.mod,
+        namesType,
+        true,
+        GlobalValue::PrivateLinkage,
+        ConstantArray::get(namesType, names),
+        "__allium_counter_names");
+
+    // call void @__allium_profile_register(i64** counters, i8** names, i64 n, i8* path)
+    FunctionCallee registerFunc = cg.mod.getOrInsertFunction(
+        "__allium_profile_register",
+        FunctionType::get(
+            cg.builder.getVoidTy(),
+            { PointerType::get(counterPtr, 0), PointerType::get(i8Ptr, 0), i64, i8Ptr },
+            false));
+    cg.builder.CreateCall(registerFunc, {
+        cg.builder.CreateConstInBoundsGEP2_32(countersType, countersTable, 0, 0),
+        cg.builder.CreateConstInBoundsGEP2_32(namesType, namesTable, 0, 0),
+        cg.builder.getInt64(counters.size()),
+        cg.builder.CreateGlobalStringPtr(cg.profileOutput, ".profile.path", 0, &cg.mod),
+    });
+}
+
+void ProfileInstrumentor::annotateCalls(Function *func, const TypedAST::PredicateDecl &pred) {
+    auto calls = cg.profile.find(callCounter(pred));
+    if(calls != cg.profile.end()) {
+        func->setEntryCount(calls->second);
+    }
+}
+
+MDNode *ProfileInstrumentor::getMatchWeights(const TypedAST::PredicateDecl &pred, size_t impl) {
+    auto attempts = cg.profile.find(attemptCounter(pred, impl));
+    auto matches = cg.profile.find(matchCounter(pred, impl));
+    if(attempts == cg.profile.end() || matches == cg.profile.end()) {
+        return nullptr;
+    }
+
+    // Branch weights are 32 bits, so large counts are scaled down together.
+    uint64_t match = matches->second;
+    uint64_t mismatch = attempts->second - std::min(match, attempts->second);
+    while(match > UINT32_MAX || mismatch > UINT32_MAX) {
+        match /= 2;
+        mismatch /= 2;
+    }
+    return MDBuilder(cg.ctx).createBranchWeights(match, mismatch);
+}
+
+void ProfileInstrumentor::addProfileSummary() {
+    if(cg.profile.empty()) {
+        return;
+    }
+
+    // The summary is built from one record per predicate, whose first count
+    // is the number of calls.
+    std::map<std::string, InstrProfRecord> records;
+    for(const auto &[counter, count] : cg.profile) {
+        std::vector<uint64_t> &counts = records[counter.substr(0, counter.find('.'))].Counts;
+        if(counts.empty()) {
+            counts.push_back(0);
+        }
+        if(counter.ends_with(".calls")) {
+            counts[0] = count;
+        } else {
+            counts.push_back(count);
+        }
+    }
+
+    InstrProfSummaryBuilder summary(ProfileSummaryBuilder::DefaultCutoffs);
+    for(const auto &[pred, record] : records) {
+        summary.addRecord(record);
+    }
+    cg.mod.setProfileSummary(
+        summary.getSummary()->getMD(cg.ctx),
+        ProfileSummary::PSK_Instr);
+}
@@ -0,0 +1,114 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "LibAllium/Trace.h"
+
+// Renders a binary trace written by a compiled program as the text trace which
+// it would have printed. See LibAllium/Trace.h and docs/Debugging.md.
+
+static void usage(const char *program) {
+    fprintf(
+        stderr,
+        "usage: %s [--log-level=N] [--timestamps] TRACE\n"
+        "\n"
+        "  --log-level=N  Only print events up to log level N (default 3).\n"
+        "  --timestamps   Prefix each event with nanoseconds since the first.\n",
+        program);
+}
+
+static bool readU32(FILE *file, uint32_t *value) {
+    return fread(value, sizeof(uint32_t), 1, file) == 1;
+}
+
+int main(int argc, char **argv) {
+    int logLevel = ALLIUM_TRACE_IMPLICATION;
+    bool timestamps = false;
+    const char *path = NULL;
+
+    for(int i = 1; i < argc; ++i) {
+        if(strncmp(argv[i], "--log-level=", 12) == 0) {
+            logLevel = atoi(argv[i] + 12);
+        } else if(strcmp(argv[i], "--timestamps") == 0) {
+            timestamps = true;
+        } else if(argv[i][0] != '-' && !path) {
+            path = argv[i];
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if(!path) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    FILE *file = fopen(path, "rb");
+    if(!file) {
+        fprintf(stderr, "allium-trace: could not read %s\n", path);
+        return 1;
+    }
+
+    char magic[8];
+    uint32_t version, siteCount;
+    if(fread(magic, 1, 8, file) != 8 ||
+        memcmp(magic, ALLIUM_TRACE_MAGIC, 8) != 0 ||
+        !readU32(file, &version) ||
+        !readU32(file, &siteCount)
+    ) {
+        fprintf(stderr, "allium-trace: %s is not an Allium trace\n", path);
+        return 1;
+    }
+    if(version != ALLIUM_TRACE_VERSION) {
+        fprintf(
+            stderr,
+            "allium-trace: %s has version %u, but only version %u is supported\n",
+            path,
+            version,
+            ALLIUM_TRACE_VERSION);
+        return 1;
+    }
+
+    char **sites = calloc(siteCount, sizeof(char*));
+    for(uint32_t i = 0; i < siteCount; ++i) {
+        uint32_t length;
+        if(!readU32(file, &length) ||
+            !(sites[i] = malloc(length + 1)) ||
+            fread(sites[i], 1, length, file) != length
+        ) {
+            fprintf(stderr, "allium-trace: %s is truncated\n", path);
+            return 1;
+        }
+        sites[i][length] = '\0';
+    }
+
+    allium_trace_record_t record;
+    uint64_t start = 0;
+    bool first = true;
+    while(fread(&record, sizeof(record), 1, file) == 1) {
+        if(first) {
+            start = record.timestamp;
+            first = false;
+        }
+        if(record.site >= siteCount) {
+            fprintf(stderr, "allium-trace: %s has an unknown trace site\n", path);
+            return 1;
+        }
+        if((int) record.event > logLevel) {
+            continue;
+        }
+        if(timestamps) {
+            printf("%12llu ", (unsigned long long) (record.timestamp - start));
+        }
+        fputs(sites[record.site], stdout);
+    }
+
+    for(uint32_t i = 0; i < siteCount; ++i) {
+        free(sites[i]);
+    }
+    free(sites);
+    fclose(file);
+    return 0;
+}
@@ -1,8 +1,26 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
 
+#include "LibAllium/Allium.h"
+#include "LibAllium/Counts.h"
+#include "LibAllium/Trace.h"
+
+// Programs built with -g report events to `__allium_trace` if their level is
+// at most logLevel. See LibAllium/Trace.h.
 int logLevel;
 
+// The binary trace, if ALLIUM_TRACE_FILE is set.
+static FILE *traceFile;
+static void closeTrace();
+
 // Programs which contain a `main` predicate will call this function before any
 // other code is run.
 void allium_init() {
@@ -10,27 +28,691 @@ void allium_init() {
     if(s) {
         logLevel = atoi(s);
     }
+
+    // A binary trace records every event, and can be filtered when it is
+    // rendered.
+    const char *tracePath = getenv("ALLIUM_TRACE_FILE");
+    if(tracePath) {
+        traceFile = fopen(tracePath, "wb");
+        if(!traceFile) {
+            fprintf(stderr, "Allium: could not write trace %s\n", tracePath);
+        } else {
+            logLevel = ALLIUM_TRACE_IMPLICATION;
+            atexit(closeTrace);
+        }
+    }
+}
+
+// Records are buffered, and written when the buffer is full or the program
+// exits. The header is written with the first records, once every partition of
+// the program has registered its sites.
+#define TRACE_BUFFER_SIZE 4096
+
+static const char **traceSites;
+static uint32_t traceSiteCount;
+static bool traceHeaderWritten;
+static allium_trace_record_t traceBuffer[TRACE_BUFFER_SIZE];
+static size_t traceBufferSize;
+
+static void writeTraceHeader() {
+    fwrite(ALLIUM_TRACE_MAGIC, 1, 8, traceFile);
+    uint32_t header[2] = { ALLIUM_TRACE_VERSION, traceSiteCount };
+    fwrite(header, sizeof(uint32_t), 2, traceFile);
+    for(uint32_t i = 0; i < traceSiteCount; ++i) {
+        uint32_t length = strlen(traceSites[i]);
+        fwrite(&length, sizeof(uint32_t), 1, traceFile);
+        fwrite(traceSites[i], 1, length, traceFile);
+    }
+    traceHeaderWritten = true;
+}
+
+static void flushTrace() {
+    if(!traceHeaderWritten) {
+        writeTraceHeader();
+    }
+    fwrite(traceBuffer, sizeof(allium_trace_record_t), traceBufferSize, traceFile);
+    traceBufferSize = 0;
+}
+
+static void closeTrace() {
+    flushTrace();
+    fclose(traceFile);
+}
+
+// Called by each partition of a program built with -g before any events are
+// reported. Returns the number of the partition's first site among all of the
+// program's sites.
+uint32_t __allium_trace_register(const char **sites, uint32_t count) {
+    uint32_t base = traceSiteCount;
+    traceSites = realloc(traceSites, (base + count) * sizeof(const char *));
+    memcpy(traceSites + base, sites, count * sizeof(const char *));
+    traceSiteCount += count;
+    return base;
+}
+
+void __allium_trace(
+    uint32_t event,
+    uint32_t site,
+    uint32_t predicate,
+    uint32_t implication
+) {
+    if(!traceFile) {
+        fputs(traceSites[site], stdout);
+        return;
+    }
+
+    if(traceBufferSize == TRACE_BUFFER_SIZE) {
+        flushTrace();
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    allium_trace_record_t *record = &traceBuffer[traceBufferSize++];
+    record->timestamp = (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+    record->event = event;
+    record->site = site;
+    record->predicate = predicate;
+    record->implication = implication;
 }
 
 #define UNBOUND 0
 #define VARIABLE 1
 
+// The tag of a value of a builtin type (Int or String) which is not a variable.
+#define BUILTIN_VALUE 2
+
 typedef struct value_t {
     char tag;
 
-    // This sufficies to model variables for the sake of __allium_get_value,
-    // but is not a good model of Allium values in general.
-    struct value_t *ptr;
+    // This suffices to model variables and builtin values, but is not a good
+    // model of Allium values in general.
+    union {
+        struct value_t *ptr;
+        const char *string;
+        int64_t integer;
+    } payload;
 } value_t;
 
-// TODO: this should eventually go into a bitcode library and always get
-// inlined. For the sake of functional correctness, putting it into the runtime
-// library is adequate.
+// Compiled programs use the always-inlined copy of this function in
+// libAllium.ll. This copy is used by the rest of the runtime library.
 value_t *__allium_get_value(value_t *value) {
     // Assume that all variables have non-null pointers. If a "user variable"
     // has no value, it should have the UNDEFINED tag.
     while(value->tag == VARIABLE) {
-        value = value->ptr;
+        value = value->payload.ptr;
+    }
+    return value;
+}
+
+// The trail records every value which is bound during a proof, so that the
+// bindings can be undone when the proof backtracks. Compiled code takes a mark
+// before trying an implication, and undoes the bindings back to the mark when
+// the implication fails or has no more witnesses.
+//
+// The trail is exported because compiled programs push onto it and take marks
+// with the always-inlined functions in libAllium.ll.
+value_t **__allium_trail;
+size_t __allium_trail_size;
+size_t __allium_trail_capacity;
+
+void __allium_trail_grow() {
+    __allium_trail_capacity = __allium_trail_capacity ?
+        2 * __allium_trail_capacity : 1024;
+    __allium_trail = realloc(
+        __allium_trail,
+        __allium_trail_capacity * sizeof(value_t *));
+    if(!__allium_trail) {
+        fputs("Allium: out of memory\n", stderr);
+        abort();
+    }
+}
+
+void __allium_trail_push(value_t *value) {
+    if(__allium_trail_size == __allium_trail_capacity) {
+        __allium_trail_grow();
+    }
+    __allium_trail[__allium_trail_size++] = value;
+}
+
+size_t __allium_trail_mark() {
+    return __allium_trail_size;
+}
+
+void __allium_trail_undo(size_t mark) {
+    // Every value begins with a pointer-sized word which holds its tag and, in
+    // the default layout, padding. Clearing that word makes the value unbound
+    // in either layout.
+    while(__allium_trail_size > mark) {
+        memset(__allium_trail[--__allium_trail_size], 0, sizeof(void *));
+    }
+}
+
+// In the compact layout, a value of a type whose constructors have no arguments
+// is a single word, which is 0 if the value is unbound, the address of another
+// value if it is a variable, or odd if it is a constructor. See docs/ABI.md.
+void *__allium_get_tagged_word_value(void *value) {
+    uintptr_t word;
+    while((word = *(uintptr_t *) value) != 0 && !(word & 1)) {
+        value = (void *) word;
+    }
+    return value;
+}
+
+// If either value is unbound, binds it to the other and returns true.
+// Otherwise, returns false without modifying either value.
+static bool bindUnbound(value_t *x, value_t *y) {
+    if(x == y) {
+        return true;
+    } else if(y->tag == UNBOUND) {
+        __allium_trail_push(y);
+        y->tag = VARIABLE;
+        y->payload.ptr = x;
+        return true;
+    } else if(x->tag == UNBOUND) {
+        __allium_trail_push(x);
+        x->tag = VARIABLE;
+        x->payload.ptr = y;
+        return true;
+    }
+    return false;
+}
+
+// Unification of the builtin types. The compiler generates the unification
+// functions for user-defined types, and calls these for builtin types.
+bool unifyString(value_t *x, value_t *y) {
+    x = __allium_get_value(x);
+    y = __allium_get_value(y);
+    return bindUnbound(x, y) ||
+        strcmp(x->payload.string, y->payload.string) == 0;
+}
+
+bool unifyInt(value_t *x, value_t *y) {
+    x = __allium_get_value(x);
+    y = __allium_get_value(y);
+    return bindUnbound(x, y) || x->payload.integer == y->payload.integer;
+}
+
+// Builtin predicates are called directly by compiled programs, and return
+// whether they were proven. They have at most one witness.
+
+bool __allium_concat(value_t *a, value_t *b, value_t *c) {
+    // Semantic analysis ensures that a and b are ground.
+    const char *aStr = __allium_get_value(a)->payload.string;
+    const char *bStr = __allium_get_value(b)->payload.string;
+    size_t aLength = strlen(aStr);
+    size_t bLength = strlen(bStr);
+
+    c = __allium_get_value(c);
+    if(c->tag != UNBOUND) {
+        const char *cStr = c->payload.string;
+        return strncmp(cStr, aStr, aLength) == 0 &&
+            strcmp(cStr + aLength, bStr) == 0;
+    }
+
+    // The result lives in the same allocation as its text.
+    // TODO: these are never freed.
+    value_t *result = malloc(sizeof(value_t) + aLength + bLength + 1);
+    if(!result) {
+        fputs("Allium: out of memory\n", stderr);
+        abort();
+    }
+    char *text = (char *) (result + 1);
+    memcpy(text, aStr, aLength);
+    memcpy(text + aLength, bStr, bLength + 1);
+    result->tag = BUILTIN_VALUE;
+    result->payload.string = text;
+    return unifyString(c, result);
+}
+
+// A handler on the stack of handlers which are in scope during a proof. Each
+// effect constructor's implementation is a coroutine generated by the compiler;
+// see docs/ABI.md.
+typedef struct handler_t {
+    struct handler_t *next;
+    unsigned effect;
+    void **ctors;
+} handler_t;
+
+// Returns the innermost handler of the given effect. Semantic analysis ensures
+// that every effect is handled, so this always finds one.
+handler_t *__allium_find_handler(handler_t *handlers, unsigned effect) {
+    while(handlers->effect != effect) {
+        handlers = handlers->next;
+    }
+    return handlers;
+}
+
+// Coroutine frames are allocated from a stack of chunks. Since the proof
+// search is depth-first, frames are nearly always freed in the reverse order of
+// their allocation, so allocating and freeing a frame is usually just moving
+// the top of the stack. A frame which is freed out of order is only marked as
+// dead, and its memory is reclaimed once every frame above it is freed.
+//
+// Compiled programs are single threaded, so the allocator has no locking.
+
+#define FRAME_ALIGNMENT 16
+#define CHUNK_SIZE (1 << 20)
+
+typedef struct frame_t {
+    // The frame below this one in the same chunk, or null.
+    struct frame_t *prev;
+    bool live;
+} frame_t;
+
+typedef struct chunk_t {
+    struct chunk_t *prev;
+    frame_t *top;
+    size_t used;
+    size_t capacity;
+} chunk_t;
+
+// Frame headers and chunk headers are padded so that frames are aligned.
+#define ALIGN(n) (((n) + FRAME_ALIGNMENT - 1) & ~(size_t) (FRAME_ALIGNMENT - 1))
+#define FRAME_HEADER_SIZE ALIGN(sizeof(frame_t))
+#define CHUNK_HEADER_SIZE ALIGN(sizeof(chunk_t))
+
+static char *chunkData(chunk_t *chunk) {
+    return (char *) chunk + CHUNK_HEADER_SIZE;
+}
+
+static chunk_t *currentChunk;
+
+// The most recently emptied chunk is kept, so that a proof which repeatedly
+// crosses a chunk boundary does not call malloc each time.
+static chunk_t *spareChunk;
+
+static chunk_t *pushChunk(size_t size) {
+    chunk_t *chunk;
+    if(spareChunk && spareChunk->capacity >= size) {
+        chunk = spareChunk;
+        spareChunk = NULL;
+    } else {
+        size_t capacity = size > CHUNK_SIZE ? size : CHUNK_SIZE;
+        chunk = malloc(CHUNK_HEADER_SIZE + capacity);
+        if(!chunk) {
+            fputs("Allium: out of memory\n", stderr);
+            abort();
+        }
+        chunk->capacity = capacity;
+    }
+    chunk->prev = currentChunk;
+    chunk->top = NULL;
+    chunk->used = 0;
+    currentChunk = chunk;
+    return chunk;
+}
+
+static void popChunk() {
+    chunk_t *chunk = currentChunk;
+    currentChunk = chunk->prev;
+    if(spareChunk) {
+        if(spareChunk->capacity >= chunk->capacity) {
+            free(chunk);
+            return;
+        }
+        free(spareChunk);
+    }
+    spareChunk = chunk;
+}
+
+void *__allium_frame_alloc(size_t size) {
+    size = FRAME_HEADER_SIZE + ALIGN(size);
+    chunk_t *chunk = currentChunk;
+    if(!chunk || chunk->capacity - chunk->used < size) {
+        chunk = pushChunk(size);
+    }
+
+    frame_t *frame = (frame_t *) (chunkData(chunk) + chunk->used);
+    frame->prev = chunk->top;
+    frame->live = true;
+    chunk->top = frame;
+    chunk->used += size;
+    return (char *) frame + FRAME_HEADER_SIZE;
+}
+
+void __allium_frame_free(void *memory) {
+    frame_t *frame = (frame_t *) ((char *) memory - FRAME_HEADER_SIZE);
+    frame->live = false;
+
+    // Reclaim every dead frame at the top of the stack.
+    while(currentChunk) {
+        chunk_t *chunk = currentChunk;
+        while(chunk->top && !chunk->top->live) {
+            chunk->used = (char *) chunk->top - chunkData(chunk);
+            chunk->top = chunk->top->prev;
+        }
+        if(chunk->top) {
+            break;
+        }
+        popChunk();
+    }
+}
+
+// Each partition of a program built with -fprofile-generate registers its
+// counters before the program runs, and the counters are written to the
+// profile when the program exits. The ALLIUM_PROFILE_FILE environment variable
+// overrides the profile's path.
+static uint64_t **profileCounters;
+static const char **profileCounterNames;
+static size_t profileCounterCount;
+static const char *profilePath;
+
+static void writeProfile() {
+    FILE *file = fopen(profilePath, "w");
+    if(!file) {
+        fprintf(stderr, "Allium: could not write profile %s\n", profilePath);
+        return;
+    }
+    fputs("# Allium profile\n", file);
+    for(size_t i = 0; i < profileCounterCount; ++i) {
+        fprintf(
+            file,
+            "%s %llu\n",
+            profileCounterNames[i],
+            (unsigned long long) *profileCounters[i]);
+    }
+    fclose(file);
+}
+
+void __allium_profile_register(
+    uint64_t **counters,
+    const char **names,
+    size_t count,
+    const char *path
+) {
+    size_t total = profileCounterCount + count;
+    profileCounters = realloc(profileCounters, total * sizeof(uint64_t *));
+    profileCounterNames = realloc(profileCounterNames, total * sizeof(const char *));
+    memcpy(profileCounters + profileCounterCount, counters, count * sizeof(uint64_t *));
+    memcpy(profileCounterNames + profileCounterCount, names, count * sizeof(const char *));
+    profileCounterCount = total;
+
+    if(!profilePath) {
+        const char *override = getenv("ALLIUM_PROFILE_FILE");
+        profilePath = override ? override : path;
+        atexit(writeProfile);
+    }
+}
+
+// Each partition of a program built with -fcount registers the counters of its
+// predicates before the program runs. The counts are written as JSON when the
+// program exits, and whenever it receives SIGUSR1. Since the signal can
+// interrupt the program anywhere, writing them only uses async-signal-safe
+// functions. The ALLIUM_COUNT_FILE environment variable overrides the file.
+static allium_count_predicate_t *countPredicates;
+static size_t countPredicateCount;
+static const char *countPath;
+
+// Text is written through a fixed buffer, since a signal handler can't
+// allocate memory or use stdio.
+typedef struct {
+    int fd;
+    size_t size;
+    char buffer[4096];
+} count_writer_t;
+
+static void flushCounts(count_writer_t *writer) {
+    size_t written = 0;
+    while(written < writer->size) {
+        ssize_t n = write(writer->fd, writer->buffer + written, writer->size - written);
+        if(n < 0 && errno == EINTR) {
+            continue;
+        } else if(n <= 0) {
+            break;
+        }
+        written += n;
+    }
+    writer->size = 0;
+}
+
+static void writeCountText(count_writer_t *writer, const char *text) {
+    for(; *text; ++text) {
+        if(writer->size == sizeof(writer->buffer)) {
+            flushCounts(writer);
+        }
+        writer->buffer[writer->size++] = *text;
+    }
+}
+
+static void writeCountNumber(count_writer_t *writer, uint64_t n) {
+    char digits[21];
+    char *first = digits + sizeof(digits) - 1;
+    *first = '\0';
+    do {
+        *--first = '0' + n % 10;
+        n /= 10;
+    } while(n > 0);
+    writeCountText(writer, first);
+}
+
+// Writes the fields of a predicate or implication, which has the counters
+// described in LibAllium/Counts.h.
+static void writeCountFields(count_writer_t *writer, const uint64_t *counts) {
+    static const char *fields[ALLIUM_COUNT_SIZE] = {
+        [ALLIUM_COUNT_CALLS] = "\"calls\": ",
+        [ALLIUM_COUNT_HEADS] = ", \"heads\": ",
+        [ALLIUM_COUNT_SOLUTIONS] = ", \"solutions\": ",
+        [ALLIUM_COUNT_BACKTRACKS] = ", \"backtracks\": ",
+    };
+    for(int i = 0; i < ALLIUM_COUNT_SIZE; ++i) {
+        writeCountText(writer, fields[i]);
+        writeCountNumber(writer, counts[i]);
+    }
+}
+
+static void writeCounts() {
+    int fd = open(countPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0) {
+        static const char message[] = "Allium: could not write counts\n";
+        write(STDERR_FILENO, message, sizeof(message) - 1);
+        return;
+    }
+
+    // Predicate names are identifiers, so they don't need to be escaped.
+    count_writer_t writer = { .fd = fd, .size = 0 };
+    writeCountText(&writer, "{\"predicates\": [");
+    for(size_t i = 0; i < countPredicateCount; ++i) {
+        const allium_count_predicate_t *pred = &countPredicates[i];
+        uint64_t totals[ALLIUM_COUNT_SIZE] = {
+            __atomic_load_n(&pred->counters[0], __ATOMIC_RELAXED)
+        };
+        for(uint64_t j = 0; j < pred->implicationCount; ++j) {
+            for(int k = ALLIUM_COUNT_HEADS; k < ALLIUM_COUNT_SIZE; ++k) {
+                totals[k] += __atomic_load_n(
+                    &pred->counters[1 + ALLIUM_COUNT_SIZE * j + k],
+                    __ATOMIC_RELAXED);
+            }
+        }
+
+        writeCountText(&writer, i == 0 ? "\n  {\"name\": \"" : ",\n  {\"name\": \"");
+        writeCountText(&writer, pred->name);
+        writeCountText(&writer, "\", ");
+        writeCountFields(&writer, totals);
+        writeCountText(&writer, ", \"implications\": [");
+        for(uint64_t j = 0; j < pred->implicationCount; ++j) {
+            uint64_t counts[ALLIUM_COUNT_SIZE];
+            for(int k = 0; k < ALLIUM_COUNT_SIZE; ++k) {
+                counts[k] = __atomic_load_n(
+                    &pred->counters[1 + ALLIUM_COUNT_SIZE * j + k],
+                    __ATOMIC_RELAXED);
+            }
+            writeCountText(&writer, j == 0 ? "\n    {" : ",\n    {");
+            writeCountFields(&writer, counts);
+            writeCountText(&writer, "}");
+        }
+        writeCountText(&writer, pred->implicationCount > 0 ? "\n  ]}" : "]}");
+    }
+    writeCountText(&writer, "\n]}\n");
+    flushCounts(&writer);
+    close(fd);
+}
+
+static void writeCountsOnSignal(int signum) {
+    int savedErrno = errno;
+    writeCounts();
+    errno = savedErrno;
+}
+
+// SIGUSR1 is blocked while the counts are written at exit, so that the signal
+// handler doesn't truncate the file while it is being written.
+static void writeCountsAtExit() {
+    sigset_t usr1, previous;
+    sigemptyset(&usr1);
+    sigaddset(&usr1, SIGUSR1);
+    sigprocmask(SIG_BLOCK, &usr1, &previous);
+    writeCounts();
+    sigprocmask(SIG_SETMASK, &previous, NULL);
+}
+
+void __allium_count_register(
+    const allium_count_predicate_t *predicates,
+    uint64_t count,
+    const char *path
+) {
+    // The handler mustn't run while the table is being reallocated.
+    sigset_t usr1, previous;
+    sigemptyset(&usr1);
+    sigaddset(&usr1, SIGUSR1);
+    sigprocmask(SIG_BLOCK, &usr1, &previous);
+
+    size_t total = countPredicateCount + count;
+    countPredicates = realloc(countPredicates, total * sizeof(allium_count_predicate_t));
+    memcpy(
+        countPredicates + countPredicateCount,
+        predicates,
+        count * sizeof(allium_count_predicate_t));
+    countPredicateCount = total;
+
+    if(!countPath) {
+        const char *override = getenv("ALLIUM_COUNT_FILE");
+        countPath = override ? override : path;
+        atexit(writeCountsAtExit);
+
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = writeCountsOnSignal;
+        action.sa_flags = SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGUSR1, &action, NULL);
+    }
+
+    sigprocmask(SIG_SETMASK, &previous, NULL);
+}
+
+// Performs the builtin IO.print effect.
+void __allium_print(value_t *string) {
+    puts(__allium_get_value(string)->payload.string);
+}
+
+// The C API of programs compiled into shared libraries. See LibAllium/Allium.h.
+
+static void *allocate(size_t size) {
+    void *value = malloc(size);
+    if(!value) {
+        fputs("Allium: out of memory\n", stderr);
+        abort();
     }
     return value;
 }
+
+allium_value *allium_int_new(int64_t integer) {
+    value_t *value = allocate(sizeof(value_t));
+    value->tag = BUILTIN_VALUE;
+    value->payload.integer = integer;
+    return (allium_value *) value;
+}
+
+allium_value *allium_string_new(const char *string) {
+    // As with concat, the value lives in the same allocation as its text.
+    size_t length = strlen(string);
+    value_t *value = allocate(sizeof(value_t) + length + 1);
+    char *text = (char *) (value + 1);
+    memcpy(text, string, length + 1);
+    value->tag = BUILTIN_VALUE;
+    value->payload.string = text;
+    return (allium_value *) value;
+}
+
+allium_value *allium_int_variable(void) {
+    value_t *value = allocate(sizeof(value_t));
+    value->tag = UNBOUND;
+    return (allium_value *) value;
+}
+
+allium_value *allium_string_variable(void) {
+    return allium_int_variable();
+}
+
+bool allium_int_get(const allium_value *value, int64_t *result) {
+    value_t *v = __allium_get_value((value_t *) value);
+    if(v->tag == UNBOUND) {
+        return false;
+    }
+    *result = v->payload.integer;
+    return true;
+}
+
+const char *allium_string_get(const allium_value *value) {
+    value_t *v = __allium_get_value((value_t *) value);
+    return v->tag == UNBOUND ? NULL : v->payload.string;
+}
+
+void allium_value_free(allium_value *value) {
+    free(value);
+}
+
+struct allium_query {
+    // Generated by the compiler for each predicate. If `*coroutine` is null,
+    // `prove` starts a proof of the predicate. Otherwise, it resumes the
+    // coroutine of a nondeterministic predicate to find the next witness. It
+    // returns whether it found a witness, and leaves the coroutine of the
+    // proof in `*coroutine` if the proof may have more witnesses.
+    bool (*prove)(allium_value **arguments, void **coroutine);
+    void (*destroy)(void *coroutine);
+    void *coroutine;
+
+    // The bindings made by the query are undone back to this mark when it is
+    // freed.
+    size_t mark;
+    bool started;
+
+    size_t argumentCount;
+    allium_value *arguments[];
+};
+
+// Called by the functions which the compiler generates for each predicate.
+allium_query *__allium_query_new(
+    bool (*prove)(allium_value **, void **),
+    void (*destroy)(void *),
+    allium_value **arguments,
+    size_t argumentCount
+) {
+    allium_query *query = allocate(
+        sizeof(allium_query) + argumentCount * sizeof(allium_value *));
+    query->prove = prove;
+    query->destroy = destroy;
+    query->coroutine = NULL;
+    query->started = false;
+    query->argumentCount = argumentCount;
+    memcpy(query->arguments, arguments, argumentCount * sizeof(allium_value *));
+    return query;
+}
+
+bool allium_query_next(allium_query *query) {
+    if(!query->started) {
+        query->mark = __allium_trail_mark();
+        query->started = true;
+    } else if(!query->coroutine) {
+        return false;
+    }
+    return query->prove(query->arguments, &query->coroutine);
+}
+
+void allium_query_free(allium_query *query) {
+    if(query->coroutine) {
+        query->destroy(query->coroutine);
+    }
+    if(query->started) {
+        __allium_trail_undo(query->mark);
+    }
+    free(query);
+}
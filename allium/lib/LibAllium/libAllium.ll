@@ -0,0 +1,93 @@
+; Runtime helpers which are called on the hot paths of compiled programs, such
+; as unification. The compiler links this module into every program before
+; optimizing it, so that these helpers are always inlined. They must behave
+; exactly like their out-of-line versions in libAllium.c, which remain
+; available to the rest of the runtime library. TestRuntimeBitcode in the unit
+; tests runs both versions against the same values and trail.
+;
+; The helpers are written in LLVM IR rather than compiled from C, so that
+; building them only needs llvm-as. Like libAllium.c, they assume an LP64
+; target.
+
+%value_t = type { i8, i8* }
+
+@__allium_trail = external global i8**
+@__allium_trail_size = external global i64
+@__allium_trail_capacity = external global i64
+
+declare void @__allium_trail_grow()
+
+; Follows a chain of variables to the value at the end of it.
+define available_externally i8* @__allium_get_value(i8* %value) #0 {
+entry:
+  br label %loop
+
+loop:
+  %v = phi i8* [ %value, %entry ], [ %next, %follow ]
+  %tag = load i8, i8* %v
+  %is.variable = icmp eq i8 %tag, 1
+  br i1 %is.variable, label %follow, label %done
+
+follow:
+  %v.value = bitcast i8* %v to %value_t*
+  %payload.ptr = getelementptr inbounds %value_t, %value_t* %v.value, i32 0, i32 1
+  %next = load i8*, i8** %payload.ptr
+  br label %loop
+
+done:
+  ret i8* %v
+}
+
+; Like __allium_get_value, for values which are a single tagged word.
+define available_externally i8* @__allium_get_tagged_word_value(i8* %value) #0 {
+entry:
+  br label %loop
+
+loop:
+  %v = phi i8* [ %value, %entry ], [ %next, %follow ]
+  %word.ptr = bitcast i8* %v to i64*
+  %word = load i64, i64* %word.ptr
+  %low.bit = and i64 %word, 1
+  %is.constructor = icmp ne i64 %low.bit, 0
+  %is.unbound = icmp eq i64 %word, 0
+  %is.value = or i1 %is.constructor, %is.unbound
+  br i1 %is.value, label %done, label %follow
+
+follow:
+  %next = inttoptr i64 %word to i8*
+  br label %loop
+
+done:
+  ret i8* %v
+}
+
+; Records a binding on the trail.
+define available_externally void @__allium_trail_push(i8* %value) #0 {
+entry:
+  %size = load i64, i64* @__allium_trail_size
+  %capacity = load i64, i64* @__allium_trail_capacity
+  %is.full = icmp eq i64 %size, %capacity
+  br i1 %is.full, label %grow, label %push, !prof !0
+
+grow:
+  call void @__allium_trail_grow()
+  br label %push
+
+push:
+  %trail = load i8**, i8*** @__allium_trail
+  %slot = getelementptr inbounds i8*, i8** %trail, i64 %size
+  store i8* %value, i8** %slot
+  %new.size = add i64 %size, 1
+  store i64 %new.size, i64* @__allium_trail_size
+  ret void
+}
+
+define available_externally i64 @__allium_trail_mark() #0 {
+entry:
+  %size = load i64, i64* @__allium_trail_size
+  ret i64 %size
+}
+
+attributes #0 = { alwaysinline nounwind }
+
+!0 = !{!"branch_weights", i32 1, i32 2000}
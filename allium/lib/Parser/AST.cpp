@@ -96,7 +96,7 @@ std::ostream& operator<<(std::ostream &out, const EffectImplHead &eih) {
 }
 
 EffectCtorRef::EffectCtorRef(
-    std::string name,
+    std::string_view name,
     std::vector<Value> arguments,
     const Expression &continuation,
     SourceLocation location
@@ -134,7 +134,7 @@ std::ostream& operator<<(std::ostream &out, const EffectCtorRef &p) {
 }
 
 Conjunction::Conjunction(Expression left, Expression right):
-    _left(new auto(left)), _right(new auto(right)) {}
+    _left(new auto(std::move(left))), _right(new auto(std::move(right))) {}
 
 Conjunction::Conjunction(const Conjunction &other):
     _left(new auto(*other._left)), _right(new auto(*other._right)) {}
@@ -284,41 +284,51 @@ std::ostream& operator<<(std::ostream &out, const Type &type) {
     return out;
 }
 
+AST::AST(
+    std::vector<Type> types,
+    std::vector<Effect> effects,
+    std::vector<Predicate> predicates
+):  types(std::move(types)),
+    effects(std::move(effects)),
+    predicates(std::move(predicates)) {
+
+    // Redefinitions are diagnosed by semantic analysis, which expects them to
+    // resolve to the first definition.
+    for(size_t i = 0; i < this->types.size(); ++i)
+        typeIndices.emplace(this->types[i].declaration.name, i);
+    for(size_t i = 0; i < this->effects.size(); ++i)
+        effectIndices.emplace(this->effects[i].declaration.name, i);
+    for(size_t i = 0; i < this->predicates.size(); ++i)
+        predicateIndices.emplace(this->predicates[i].name.name, i);
+}
+
 Optional<Type> AST::resolveTypeRef(const Name<Type> &tr) const {
     // TODO: this works well for literal types, but won't work well
     // for builtin types with constructors.
     if(nameIsBuiltinType(tr))
         return Type(TypeDecl(tr.string(), SourceLocation()), {});
 
-    const auto &x = std::find_if(
-        types.begin(),
-        types.end(),
-        [&](const Type &type) { return type.declaration.name == tr; });
-
-    if(x == types.end()) {
+    const auto index = typeIndices.find(tr);
+    if(index == typeIndices.end()) {
         return Optional<Type>();
     } else {
-        return *x;
+        return types[index->second];
     }
 }
 
 Optional<const Effect*> AST::resolveEffectRef(const EffectRef &er) const {
-    auto x = std::find_if(
-        effects.begin(),
-        effects.end(),
+    const auto index = effectIndices.find(er.name);
+    if(index != effectIndices.end()) {
+        return &effects[index->second];
+    }
+
+    const auto x = std::find_if(
+        builtinEffects.begin(),
+        builtinEffects.end(),
         [&](const Effect &e) { return e.declaration.name == er.name; });
 
-    if(x == effects.end()) {
-        x = std::find_if(
-            builtinEffects.begin(),
-            builtinEffects.end(),
-            [&](const Effect &e) { return e.declaration.name == er.name; });
-        
-        if(x == builtinEffects.end()) {
-            return Optional<const Effect*>();
-        } else {
-            return &*x;
-        }
+    if(x == builtinEffects.end()) {
+        return Optional<const Effect*>();
     } else {
         return &*x;
     }
@@ -351,13 +361,9 @@ AST::resolveEffectCtorRef(const EffectCtorRef &ecr) const {
 }
 
 Optional<PredicateDecl> AST::resolvePredicateRef(const PredicateRef &pr) const {
-    const auto &x = std::find_if(
-        predicates.begin(),
-        predicates.end(),
-        [&](const Predicate &p) { return p.name.name == pr.name; });
-    
-    if(x != predicates.end()) {
-        return x->name;
+    const auto index = predicateIndices.find(pr.name);
+    if(index != predicateIndices.end()) {
+        return predicates[index->second].name;
     }
 
     const auto &y = std::find_if(
@@ -468,7 +474,7 @@ std::ostream& operator<<(std::ostream &out, const EffectImplication &ei) {
 }
 
 bool operator==(const AST &lhs, const AST &rhs) {
-    return lhs.types == rhs.types && lhs.predicates == rhs.predicates;
+    return lhs.getTypes() == rhs.getTypes() && lhs.getPredicates() == rhs.getPredicates();
 }
 
 bool operator!=(const AST &lhs, const AST &rhs) {
@@ -476,11 +482,11 @@ bool operator!=(const AST &lhs, const AST &rhs) {
 }
 
 std::ostream& operator<<(std::ostream &out, const AST &ast) {
-    for(const auto &predicate : ast.predicates) {
+    for(const auto &predicate : ast.getPredicates()) {
         out << predicate << "\n";
     }
 
-    for(const auto &type : ast.types) {
+    for(const auto &type : ast.getTypes()) {
         out << type << "\n";
     }
 
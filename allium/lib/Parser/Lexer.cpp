@@ -1,6 +1,13 @@
+#include <algorithm>
 #include <assert.h>
+#include <bit>
+#include <cstring>
 #include <iostream>
-#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define LEXER_USE_SSE2
+#include <emmintrin.h>
+#endif
 
 #include "Parser/Lexer.h"
 
@@ -36,6 +43,7 @@ std::ostream& operator<<(std::ostream& out, const Token::Type value) {
     case Token::Type::paren_r: return out << "Type::paren_r";
     case Token::Type::string_literal: return out << "Type::string_literal";
     case Token::Type::true_literal: return out << "Type::true_literal";
+    case Token::Type::unknown: return out << "Type::unknown";
     }
     // The preceding switch should be exhaustive. Add this to support VC++.
     printf("Error - unhandled case: %d\n", (int) value);
@@ -43,194 +51,291 @@ std::ostream& operator<<(std::ostream& out, const Token::Type value) {
     return out;
 }
 
-Token Lexer::peek_next() {
-    Token result = take_next();
-    rewind(result);
-    return result;
+static std::string readAll(std::istream &f) {
+    std::string contents;
+    char chunk[1 << 16];
+    while(f.read(chunk, sizeof(chunk)) || f.gcount() > 0) {
+        contents.append(chunk, f.gcount());
+    }
+    return contents;
 }
 
-Token Lexer::take_next() {
-    skipWhitespace();
-    std::streampos startPos = file.tellg();
-
-    while(file.peek() == '/') {
-        char start[2];
-        file.read(start, 2);
-
-        if(start[1] == '/') {
-            skipComment();
-            skipWhitespace();
-        } else {
-            file.clear();
-            file.seekg(startPos);
-        }
-    }
+static bool isWhitespace(char c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
 
-    if(file.peek() == '"') {
-        return takeStringLiteral();
-    }
+static bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+}
 
-    if(isdigit(file.peek())) {
-        return takeIntegerLiteral();
-    }
+static bool isIdentifierChar(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || isDigit(c) ||
+        c == '_';
+}
 
-    startPos = file.tellg();
+#ifdef LEXER_USE_SSE2
+/// Returns a mask of the bytes in `chunk` which lie in the range [lo, hi].
+///
+/// Note: SSE2 only has signed byte comparisons, so this only works for ASCII
+/// ranges. Bytes outside of ASCII are negative and never match.
+static __m128i inRange(__m128i chunk, char lo, char hi) {
+    return _mm_and_si128(
+        _mm_cmpgt_epi8(chunk, _mm_set1_epi8(lo - 1)),
+        _mm_cmplt_epi8(chunk, _mm_set1_epi8(hi + 1)));
+}
+#endif
+
+/// Returns the length of the longest run of identifier characters in `source`
+/// starting at `start`.
+static size_t scanIdentifier(std::string_view source, size_t start) {
+    size_t i = start;
+#ifdef LEXER_USE_SSE2
+    while(i + 16 <= source.size()) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *) (source.data() + i));
+        __m128i matches = _mm_or_si128(
+            _mm_or_si128(inRange(chunk, 'a', 'z'), inRange(chunk, 'A', 'Z')),
+            _mm_or_si128(
+                inRange(chunk, '0', '9'),
+                _mm_cmpeq_epi8(chunk, _mm_set1_epi8('_'))));
+        unsigned mismatches = ~_mm_movemask_epi8(matches) & 0xFFFF;
+        if(mismatches) {
+            return i + std::countr_zero(mismatches) - start;
+        }
+        i += 16;
+    }
+#endif
+    while(i < source.size() && isIdentifierChar(source[i])) ++i;
+    return i - start;
+}
 
-    std::string word;
-    file >> word;
+Lexer::Lexer(std::istream &f, int module):
+    buffer(readAll(f)), source(buffer), module(module), cursor{ 0, 1, 0 } {
+    tokenize();
+}
 
-    // peel off tokens from the front of the word that might not be
-    // separated by whitespace.
-    if( word.size() > 2 && !word.compare(0, 2, "<-")) {
-        file.seekg(startPos);
-        file.ignore(std::numeric_limits<std::streamsize>::max(), word.at(1));
-        word = word.substr(0, 2);
-    }
+Lexer::Lexer(std::string_view source):
+    source(source), cursor{ 0, 1, 0 } {
+    tokenize();
+}
 
-    if( word.size() > 1 &&
-        (word.front() == '{' || word.front() == '}' ||
-         word.front() == '(' || word.front() == ')' ||
-         word.front() == '_')) {
-            file.seekg(startPos);
-            file.ignore(std::numeric_limits<std::streamsize>::max(), word.front());
-            word = word.substr(0, 1);
-    }
+void Lexer::tokenize() {
+    Token token;
+    do {
+        token = lex();
+        tokens.push_back(token);
+    } while(token.type != Token::Type::end_of_file);
+}
 
-    // peel off tokens that "stick" to the back of the word.
-    while(word.size() > 1 &&
-        (word.back() == ';' || word.back() == ',' ||
-         word.back() == ':' ||
-         word.back() == '{' || word.back() == '}' ||
-         word.back() == '(' || word.back() == ')')) {
-            file.unget();
-            word.pop_back();
-    }
+Token Lexer::peek_next() {
+    return tokens[position];
+}
 
-    // For brevity, partially apply common arguments in the Token constructor.
-    auto makeToken = [&](Token::Type type, std::string text) {
-        SourceLocation location(lineNumber, columnNumber);
-        columnNumber += (int) text.size();
-        return Token(type, text, location, startPos);
-    };
+Token Lexer::peek_ahead(size_t distance) {
+    return tokens[std::min(position + distance, tokens.size() - 1)];
+}
 
-    if(word == "handle") return makeToken(Token::Type::kw_handle, word);
-    if(word == "let") return makeToken(Token::Type::kw_let, word);
-    if(word == "pred") return makeToken(Token::Type::kw_pred, word);
-    if(word == "type") return makeToken(Token::Type::kw_type, word);
-    if(word == "do") return makeToken(Token::Type::kw_do, word);
-    if(word == "continue") return makeToken(Token::Type::kw_continue, word);
-    if(word == "ctor") return makeToken(Token::Type::kw_ctor, word);
-    if(word == "effect") return makeToken(Token::Type::kw_effect, word);
-    if(word == "in") return makeToken(Token::Type::kw_in, word);
-    if(word == "true") return makeToken(Token::Type::true_literal, word);
-    else if(word == "false") return makeToken(Token::Type::false_literal, word);
-    else if(word == "<-") return makeToken(Token::Type::implied_by, word);
-    else if(word == ";") return makeToken(Token::Type::end_of_statement, word);
-    else if(word == ",") return makeToken(Token::Type::comma, word);
-    else if(word == ":") return makeToken(Token::Type::colon, word);
-    else if(word == "{") return makeToken(Token::Type::brace_l, word);
-    else if(word == "}") return makeToken(Token::Type::brace_r, word);
-    else if(word == "(") return makeToken(Token::Type::paren_l, word);
-    else if(word == ")") return makeToken(Token::Type::paren_r, word);
-    else if(!word.empty()) return makeToken(Token::Type::identifier, takeIdentifier(word));
-    else {
-        return makeToken(Token::Type::end_of_file, word);
-    }
+Token Lexer::take_next() {
+    Token next = tokens[position];
+    // The end of file token is never consumed.
+    if(position + 1 < tokens.size()) ++position;
+    return next;
 }
 
 bool Lexer::take(Token::Type type) {
-    Token next = take_next();
-    if(next.type == type) {
+    if(peek_next().type == type) {
+        take_next();
         return true;
     } else {
-        rewind(next);
         return false;
     }
 }
 
 Optional<Token> Lexer::take_token(Token::Type type) {
-    Token next = take_next();
+    Token next = peek_next();
     if(next.type == type) {
+        take_next();
         return next;
     } else {
-        rewind(next);
         return Optional<Token>();
     }
 }
 
 void Lexer::rewind(Token tok) {
-    file.clear();
-    file.seekg(tok.sourceLocation);
-    lineNumber = tok.location.lineNumber;
-    columnNumber = tok.location.columnNumber;
+    // Tokens are stored in order of their offsets.
+    auto it = std::lower_bound(
+        tokens.begin(), tokens.end(), tok.offset,
+        [](const Token &t, size_t offset) { return t.offset < offset; });
+    assert(it != tokens.end() && it->offset == tok.offset);
+    position = it - tokens.begin();
 }
 
-void Lexer::skipWhitespace() {
-    while(isspace(file.peek())) {
-        ++columnNumber;
-        if(file.get() == '\n') {
-            ++lineNumber;
-            columnNumber = 0;
-        }
+Token Lexer::lex() {
+    skipWhitespaceAndComments();
+
+    size_t start = cursor.offset;
+    SourceLocation location(
+        cursor.lineNumber,
+        (int) (start - cursor.lineStart),
+        module);
+
+    if(start >= source.size()) {
+        return Token(Token::Type::end_of_file, "", location, start);
     }
-}
 
-std::string Lexer::takeIdentifier(const std::string str) {
-    size_t i = 0;
-    for(char c : str) {
-        if(!isalnum(c) && c != '_') break;
-        ++i;
+    // For brevity, partially apply common arguments in the Token constructor.
+    auto makeToken = [&](Token::Type type, size_t length) {
+        cursor.offset += length;
+        return Token(type, source.substr(start, length), location, start);
+    };
+
+    char c = source[start];
+    switch(c) {
+    case '"': return takeStringLiteral(location);
+    case ';': return makeToken(Token::Type::end_of_statement, 1);
+    case ',': return makeToken(Token::Type::comma, 1);
+    case ':': return makeToken(Token::Type::colon, 1);
+    case '{': return makeToken(Token::Type::brace_l, 1);
+    case '}': return makeToken(Token::Type::brace_r, 1);
+    case '(': return makeToken(Token::Type::paren_l, 1);
+    case ')': return makeToken(Token::Type::paren_r, 1);
+    // An underscore is always a token by itself, even if it is immediately
+    // followed by other identifier characters.
+    case '_': return makeToken(Token::Type::identifier, 1);
+    case '<':
+        if(start + 1 < source.size() && source[start + 1] == '-')
+            return makeToken(Token::Type::implied_by, 2);
+        break;
+    default:
+        break;
     }
-    // if the string doesn't start with an identifier, we probably should have
-    // peeled off a different token.
-    assert(i > 0);
-    file.seekg(i - str.length(), std::ios_base::cur);
-    return str.substr(0, i);
-}
 
-Token Lexer::takeStringLiteral() {
-    SourceLocation location(lineNumber, columnNumber);
-    std::streampos startPos = file.tellg();
+    if(isDigit(c)) {
+        return takeIntegerLiteral(location);
+    }
 
-    char c;
-    c = file.get();
-    assert(c == '"');
+    if(isIdentifierChar(c)) {
+        return takeWord(location);
+    }
 
-    std::string text;
-    while(c = file.get(), !file.eof() && c != '\n' && c != '"') {
-        text.push_back(c);
+    return makeToken(Token::Type::unknown, 1);
+}
+
+void Lexer::skipWhitespaceAndComments() {
+    skipWhitespace();
+    while(source.substr(cursor.offset, 2) == "//") {
+        // memchr is vectorized by the C library, which makes skipping long
+        // comments cheap.
+        const char *begin = source.data() + cursor.offset;
+        const void *newline = memchr(begin, '\n', source.size() - cursor.offset);
+        cursor.offset = newline ?
+            (const char *) newline - source.data() :
+            source.size();
+        skipWhitespace();
     }
+}
 
-    if(file.eof() || c == '\n') {
-        file.seekg(startPos);
-        return Token(Token::Type::end_of_file, "", location, startPos);
+void Lexer::skipWhitespace() {
+    size_t i = cursor.offset;
+#ifdef LEXER_USE_SSE2
+    while(i + 16 <= source.size()) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *) (source.data() + i));
+        __m128i whitespace = _mm_or_si128(
+            inRange(chunk, '\t', '\r'),
+            _mm_cmpeq_epi8(chunk, _mm_set1_epi8(' ')));
+        unsigned newlines = _mm_movemask_epi8(
+            _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\n')));
+        unsigned others = ~_mm_movemask_epi8(whitespace) & 0xFFFF;
+
+        unsigned length = others ? std::countr_zero(others) : 16;
+        unsigned skippedNewlines = newlines & ((1u << length) - 1);
+        if(skippedNewlines) {
+            cursor.lineNumber += std::popcount(skippedNewlines);
+            cursor.lineStart = i + std::bit_width(skippedNewlines);
+        }
+
+        i += length;
+        if(length < 16) {
+            cursor.offset = i;
+            return;
+        }
     }
+#endif
+    for(; i < source.size() && isWhitespace(source[i]); ++i) {
+        if(source[i] == '\n') {
+            ++cursor.lineNumber;
+            cursor.lineStart = i + 1;
+        }
+    }
+    cursor.offset = i;
+}
 
-    columnNumber += text.size() + 2;
-    return Token(Token::Type::string_literal, text, location, startPos);
+Token Lexer::takeWord(SourceLocation location) {
+    static const std::pair<std::string_view, Token::Type> keywords[] = {
+        { "handle", Token::Type::kw_handle },
+        { "let", Token::Type::kw_let },
+        { "pred", Token::Type::kw_pred },
+        { "type", Token::Type::kw_type },
+        { "do", Token::Type::kw_do },
+        { "continue", Token::Type::kw_continue },
+        { "ctor", Token::Type::kw_ctor },
+        { "effect", Token::Type::kw_effect },
+        { "in", Token::Type::kw_in },
+        { "true", Token::Type::true_literal },
+        { "false", Token::Type::false_literal },
+    };
+
+    size_t start = cursor.offset;
+    size_t length = scanIdentifier(source, start);
+    assert(length > 0);
+    std::string_view word = source.substr(start, length);
+    cursor.offset += length;
+
+    // A keyword which is immediately followed by an argument list is treated
+    // as an identifier. This allows e.g. a predicate named `in`.
+    bool hasArguments = cursor.offset < source.size() &&
+        source[cursor.offset] == '(';
+
+    if(!hasArguments) {
+        for(const auto &[keyword, type] : keywords) {
+            if(word == keyword) return Token(type, word, location, start);
+        }
+    }
+    return Token(Token::Type::identifier, word, location, start);
 }
 
-Token Lexer::takeIntegerLiteral() {
-    SourceLocation location(lineNumber, columnNumber);
-    std::streampos startPos = file.tellg();
+Token Lexer::takeStringLiteral(SourceLocation location) {
+    size_t start = cursor.offset;
+    assert(source[start] == '"');
+
+    size_t textStart = start + 1;
+    const char *begin = source.data() + textStart;
+    const char *quote = (const char *) memchr(begin, '"', source.size() - textStart);
+    size_t textLength = quote ? quote - begin : source.size() - textStart;
 
-    char c;
-    std::string text;
-    while(c = file.get(), !file.eof() && isdigit(c)) {
-        text.push_back(c);
+    // String literals may not span multiple lines.
+    if(!quote || memchr(begin, '\n', textLength)) {
+        return Token(Token::Type::end_of_file, "", location, start);
     }
 
-    file.unget();
-    columnNumber += text.size();
-    return Token(Token::Type::integer_literal, text, location, startPos);
+    cursor.offset = textStart + textLength + 1;
+    return Token(
+        Token::Type::string_literal,
+        source.substr(textStart, textLength),
+        location,
+        start);
 }
 
-void Lexer::skipComment() {
-    char c;
-    while(c = file.get(), !file.eof() && c != '\n');
-    if(c == '\n')
-        ++lineNumber;
-        columnNumber = 0;
+Token Lexer::takeIntegerLiteral(SourceLocation location) {
+    size_t start = cursor.offset;
+    size_t i = start;
+    while(i < source.size() && isDigit(source[i])) ++i;
+
+    cursor.offset = i;
+    return Token(
+        Token::Type::integer_literal,
+        source.substr(start, i - start),
+        location,
+        start);
 }
 
 } // namespace parser
@@ -0,0 +1,117 @@
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <map>
+#include <thread>
+
+#include "Parser/Modules.h"
+
+namespace parser {
+
+std::vector<ParserResult<AST>> parseModules(const std::vector<std::string> &filePaths) {
+    std::vector<ParserResult<AST>> results(filePaths.size());
+
+    // Each worker repeatedly claims the next unparsed file. Modules share
+    // nothing while parsing but the caller's symbol table, in which every
+    // worker interns its names.
+    std::atomic<size_t> next = 0;
+    SymbolTable &symbols = SymbolTable::current();
+    auto worker = [&]() {
+        SymbolTable::Scope scope(symbols);
+        for(size_t i = next++; i < filePaths.size(); i = next++) {
+            std::ifstream file(filePaths[i]);
+            results[i] = Parser(file, (int) i).parseAST();
+        }
+    };
+
+    size_t threadCount = std::min<size_t>(
+        std::max(std::thread::hardware_concurrency(), 1u),
+        filePaths.size());
+
+    // The calling thread is one of the workers, which avoids spawning any
+    // threads for single-file programs.
+    std::vector<std::thread> threads;
+    for(size_t i = 1; i < threadCount; ++i) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for(std::thread &thread : threads) {
+        thread.join();
+    }
+
+    return results;
+}
+
+/// Records the module which first defines each name of some kind, and reports
+/// definitions of the same name by any other module.
+class DefinitionTable {
+public:
+    DefinitionTable(
+        const char *kind,
+        const std::vector<std::string> &paths,
+        std::vector<LinkError> &errors
+    ): kind(kind), paths(paths), errors(errors) {}
+
+    void define(const std::string &name, size_t module, SourceLocation location) {
+        auto [original, inserted] = definitions.insert({ name, { module, location } });
+        if(!inserted && original->second.first != module) {
+            errors.push_back(LinkError(
+                std::string(kind) + " \"" + name + "\" was already defined in " +
+                    paths[original->second.first] + " at " +
+                    original->second.second.toString() + " and cannot be redefined.",
+                paths[module],
+                location));
+        }
+    }
+
+private:
+    const char *kind;
+    const std::vector<std::string> &paths;
+    std::vector<LinkError> &errors;
+    std::map<std::string, std::pair<size_t, SourceLocation>> definitions;
+};
+
+AST link(
+    const std::vector<AST> &modules,
+    const std::vector<std::string> &paths,
+    std::vector<LinkError> &errors
+) {
+    DefinitionTable types("Type", paths, errors);
+    DefinitionTable effects("Effect", paths, errors);
+    DefinitionTable predicates("Predicate", paths, errors);
+
+    std::vector<Type> programTypes;
+    std::vector<Effect> programEffects;
+    std::vector<Predicate> programPredicates;
+    for(size_t i = 0; i < modules.size(); ++i) {
+        const AST &module = modules[i];
+        for(const Type &type : module.getTypes()) {
+            types.define(
+                type.declaration.name.string(), i, type.declaration.location);
+        }
+        for(const Effect &effect : module.getEffects()) {
+            effects.define(
+                effect.declaration.name.string(), i, effect.declaration.location);
+        }
+        for(const Predicate &predicate : module.getPredicates()) {
+            predicates.define(
+                predicate.name.name.string(), i, predicate.name.location);
+        }
+
+        programTypes.insert(
+            programTypes.end(),
+            module.getTypes().begin(), module.getTypes().end());
+        programEffects.insert(
+            programEffects.end(),
+            module.getEffects().begin(), module.getEffects().end());
+        programPredicates.insert(
+            programPredicates.end(),
+            module.getPredicates().begin(), module.getPredicates().end());
+    }
+    return AST(
+        std::move(programTypes),
+        std::move(programEffects),
+        std::move(programPredicates));
+}
+
+} // namespace parser
@@ -1,3 +1,5 @@
+#include <charconv>
+
 #include "Utils/Optional.h"
 #include "Parser/Parser.h"
 
@@ -6,23 +8,24 @@ namespace parser {
 /// Consumes a truth literal token from the lexer, and produces an AST node to
 /// match.
 ///
-/// Note: rewinds the lexer on failure.
+/// Note: does not consume anything on failure.
 ParserResult<TruthLiteral> Parser::parseTruthLiteral() {
-    Token next = lexer.take_next();
+    Token next = lexer.peek_next();
     switch(next.type) {
         case Token::Type::true_literal:
+            lexer.take_next();
             return TruthLiteral(true, next.location);
         case Token::Type::false_literal:
+            lexer.take_next();
             return TruthLiteral(false, next.location);
         default:
-            lexer.rewind(next);
             return ParserResult<TruthLiteral>();
     }
 }
 
 /// Consumes a "continue" token from the lexer, and produces an AST node to match.
 ///
-/// Note: rewinds the lexer on failure.
+/// Note: does not consume anything on failure.
 ParserResult<Continuation> Parser::parseContinuation() {
     Token token;
     if(lexer.take_token(Token::Type::kw_continue).unwrapGuard(token)) {
@@ -35,7 +38,7 @@ ParserResult<Continuation> Parser::parseContinuation() {
 ///
 /// Note: rewinds the lexer on failure.
 ParserResult<PredicateDecl> Parser::parsePredicateDecl() {
-    Token identifier = lexer.take_next();
+    Token identifier = lexer.peek_next();
     std::vector<SyntaxError> errors;
 
     auto rewindAndReturn = [&]() {
@@ -43,13 +46,12 @@ ParserResult<PredicateDecl> Parser::parsePredicateDecl() {
         return ParserResult<PredicateDecl>(errors);
     };
 
-    if(identifier.type != Token::Type::identifier) {
-        errors.push_back(SyntaxError("Expected predicate name in predicate definition.", lexer.peek_next().location));
-        lexer.rewind(identifier);
+    if(identifier.type == Token::Type::identifier) {
+        lexer.take_next();
+    } else {
+        errors.push_back(SyntaxError("Expected predicate name in predicate definition.", lexer.peek_ahead(1).location));
     }
 
-    Token next = lexer.peek_next();
-
     // <predicate-name> := identifier "(" <comma-separated-parameters> ")" <effect-list>
     if(lexer.take(Token::Type::paren_l)) {
         std::vector<Parameter> parameters;
@@ -82,8 +84,6 @@ ParserResult<PredicateDecl> Parser::parsePredicateDecl() {
     }
 
     // <predicate-name> := identifier <effect-list>
-    lexer.rewind(next);
-
     std::vector<EffectRef> effects;
     if(parseEffectList().unwrapResultGuard(effects, errors)) {
         rewindAndReturn();
@@ -94,7 +94,6 @@ ParserResult<PredicateDecl> Parser::parsePredicateDecl() {
 }
 
 ParserResult<NamedValue> Parser::parseNamedValue() {
-    Token next = lexer.peek_next();
     std::vector<SyntaxError> errors;
     Token identifier;
 
@@ -110,9 +109,7 @@ ParserResult<NamedValue> Parser::parseNamedValue() {
 
     // <value> := <identifier> "(" <list of values> ")"
     // <value> := <identifier>
-    lexer.rewind(next);
     if(lexer.take_token(Token::Type::identifier).unwrapGuard(identifier)) {
-        lexer.rewind(next);
         return ParserResult<NamedValue>();
     }
 
@@ -153,7 +150,7 @@ ParserResult<StringLiteral> Parser::parseStringLiteral() {
 
     // <string-literal> := <string-literal-token>
     if(lexer.take_token(Token::Type::string_literal).unwrapInto(token)) {
-        return StringLiteral(token.text, token.location);
+        return StringLiteral(std::string(token.text), token.location);
     } else {
         return ParserResult<StringLiteral>();
     }
@@ -164,7 +161,8 @@ ParserResult<IntegerLiteral> Parser::parseIntegerLiteral() {
 
     // <integer-literal> := <integer-literal-token>
     if(lexer.take_token(Token::Type::integer_literal).unwrapInto(token)) {
-        int64_t i = atoll(token.text.c_str());
+        int64_t i = 0;
+        std::from_chars(token.text.data(), token.text.data() + token.text.size(), i);
         return IntegerLiteral(i, token.location);
     } else {
         return ParserResult<IntegerLiteral>();
@@ -193,13 +191,11 @@ ParserResult<Value> Parser::parseValue() {
 
 /// Consumes an identifier from the lexer, and produces an AST node to match.
 ///
-/// Note: rewinds the lexer on failure.
+/// Note: does not consume anything on failure.
 ParserResult<PredicateRef> Parser::parsePredicateRef() {
     std::vector<SyntaxError> errors;
-    Token identifier = lexer.take_next();
-    if(identifier.type == Token::Type::identifier) {
-        Token next = lexer.peek_next();
-
+    Token identifier;
+    if(lexer.take_token(Token::Type::identifier).unwrapInto(identifier)) {
         // <predicate-name> := identifier "(" <comma-separated-arguments> ")"
         if(lexer.take(Token::Type::paren_l)) {
             std::vector<Value> arguments;
@@ -230,27 +226,19 @@ ParserResult<PredicateRef> Parser::parsePredicateRef() {
         }
 
         // <predicate-name> := identifier
-        lexer.rewind(next);
         return PredicateRef(identifier.text, identifier.location);
     } else {
-        lexer.rewind(identifier);
         return ParserResult<PredicateRef>();
     }
 }
 
 ParserResult<EffectImplHead> Parser::parseEffectImplHead() {
     std::vector<SyntaxError> errors;
-    Token first = lexer.take_next();
-
-    auto rewindAndReturn = [&]() {
-        lexer.rewind(first);
-        return ParserResult<EffectImplHead>(errors);
-    };
 
     // <effect-impl-head> := "do" <identifier>
     // <effect-impl-head> := "do" <identifier" "(" <comma-separated-arguments> ")"
-    if(first.type != Token::Type::kw_do) {
-        return rewindAndReturn();
+    if(!lexer.take(Token::Type::kw_do)) {
+        return ParserResult<EffectImplHead>();
     }
 
     Token identifier = lexer.take_next();
@@ -290,7 +278,7 @@ ParserResult<EffectImplHead> Parser::parseEffectImplHead() {
 
 ParserResult<EffectCtorRef> Parser::parseEffectCtorRef() {
     std::vector<SyntaxError> errors;
-    Token first = lexer.take_next();
+    Token first = lexer.peek_next();
 
     auto rewindAndReturn = [&]() {
         lexer.rewind(first);
@@ -301,8 +289,8 @@ ParserResult<EffectCtorRef> Parser::parseEffectCtorRef() {
     // <effect-ctor-ref> := "do" <identifier> "," <expression>
     // <effect-ctor-ref> := "do" <identifier> "(" <comma-separated-arguments> ")"
     // <effect-ctor-ref> := "do" <identifier> "(" <comma-separated-arguments> ")" "," <expression>
-    if(first.type != Token::Type::kw_do) {
-        return rewindAndReturn();
+    if(!lexer.take(Token::Type::kw_do)) {
+        return ParserResult<EffectCtorRef>();
     }
 
     Token identifier = lexer.take_next();
@@ -334,8 +322,7 @@ ParserResult<EffectCtorRef> Parser::parseEffectCtorRef() {
         }
     }
 
-    Token next = lexer.take_next();
-    if(next.type == Token::Type::comma) {
+    if(lexer.take(Token::Type::comma)) {
         Expression continuation;
         if(parseExpression().unwrapResultInto(continuation, errors)) {
             return ParserResult<EffectCtorRef>(
@@ -346,10 +333,9 @@ ParserResult<EffectCtorRef> Parser::parseEffectCtorRef() {
                     identifier.location),
                 errors);
         }
-    } else if(next.type == Token::Type::end_of_statement) {
+    } else if(lexer.peek_next().type == Token::Type::end_of_statement) {
         // If an expression ends by doing an effect, then the continuation is
         // implied to be the expression "true."
-        lexer.rewind(next);
         return ParserResult<EffectCtorRef>(
             EffectCtorRef(
                 identifier.text,
@@ -358,7 +344,7 @@ ParserResult<EffectCtorRef> Parser::parseEffectCtorRef() {
                 identifier.location),
             errors);
     } else {
-        errors.push_back(SyntaxError("Expected a \",\" or \";\" after an effect constructor.", next.location));
+        errors.push_back(SyntaxError("Expected a \",\" or \";\" after an effect constructor.", lexer.peek_next().location));
     }
 
     return rewindAndReturn();
@@ -367,16 +353,10 @@ ParserResult<EffectCtorRef> Parser::parseEffectCtorRef() {
 /// Parses an effect handler declaration
 ParserResult<Handler> Parser::parseHandler() {
     std::vector<SyntaxError> errors;
-    Token first = lexer.peek_next();
-
-    auto rewindAndReturn = [&]() {
-        lexer.rewind(first);
-        return ParserResult<Handler>(errors);
-    };
 
     // <handler> := "handle" <effect-ref> "{" <0-or-more-effect-implications> "}"
     if(!lexer.take(Token::Type::kw_handle)) {
-        return rewindAndReturn();
+        return ParserResult<Handler>();
     }
 
     Token effectRef;
@@ -407,13 +387,6 @@ ParserResult<Handler> Parser::parseHandler() {
 /// Parses an effect implication within an effect handler
 ParserResult<EffectImplication> Parser::parseEffectImplication() {
     std::vector<SyntaxError> errors;
-    Token first = lexer.peek_next();
-
-    auto rewindAndReturn = [&]() {
-        lexer.rewind(first);
-        return ParserResult<EffectImplication>(errors);
-    };
-
     EffectImplHead eih;
 
     // <effect-implication> := <effect-ctor-ref> "<-" <expression> ";"
@@ -483,7 +456,9 @@ ParserResult<Expression> Parser::parseExpression() {
         // <expression> := <expression> "," <atom>
         while(lexer.take(Token::Type::comma)) {
             if(parseAtom().unwrapResultInto(r, errors)) {
-                e = Expression(Conjunction(e, r));
+                // Move the expression parsed so far into the conjunction, since
+                // copying it would make long conjunctions quadratic.
+                e = Expression(Conjunction(std::move(e), std::move(r)));
             } else {
                 lexer.rewind(first);
                 return ParserResult<Expression>();
@@ -498,14 +473,7 @@ ParserResult<Expression> Parser::parseExpression() {
 }
 
 ParserResult<Implication> Parser::parseImplication() {
-    Token first = lexer.peek_next();
     std::vector<SyntaxError> errors;
-
-    auto rewindAndReturn = [&]() {
-        lexer.rewind(first);
-        return ParserResult<Implication>();
-    };
-
     PredicateRef p;
 
     // <implication> :=
@@ -527,7 +495,7 @@ ParserResult<Implication> Parser::parseImplication() {
             return ParserResult<Implication>(errors);
         }
     } else {
-        return rewindAndReturn();
+        return ParserResult<Implication>();
     }
 }
 
@@ -547,7 +515,7 @@ ParserResult<Predicate> Parser::parsePredicate() {
     // <predicate> :=
     //     "pred" <predicate-name> "{" <0-or-more-implications> <0-or-more-effect-handlers> "}"
     if(!lexer.take(Token::Type::kw_pred)) {
-        return rewindAndReturn();
+        return ParserResult<Predicate>();
     }
 
     if (parsePredicateDecl().unwrapResultGuard(decl, errors)) {
@@ -579,11 +547,10 @@ ParserResult<Predicate> Parser::parsePredicate() {
 }
 
 ParserResult<TypeDecl> Parser::parseTypeDecl() {
-    Token next = lexer.take_next();
-    if(next.type == Token::Type::identifier) {
+    Token next;
+    if(lexer.take_token(Token::Type::identifier).unwrapInto(next)) {
         return ParserResult<TypeDecl>(TypeDecl(next.text, next.location));
     } else {
-        lexer.rewind(next);
         return ParserResult<TypeDecl>();
     }
 }
@@ -591,17 +558,14 @@ ParserResult<TypeDecl> Parser::parseTypeDecl() {
 ParserResult<Parameter> Parser::parseParameter() {
     // <parameter> := <type-name>
     // <parameter> := "in" <type-name>
-    Token next = lexer.take_next();
+    Token next = lexer.peek_next();
     std::vector<SyntaxError> errors;
 
-    auto rewindAndReturn = [&]() {
-        lexer.rewind(next);
-        return ParserResult<Parameter>();
-    };
-
     if(next.type == Token::Type::identifier) {
+        lexer.take_next();
         return Parameter(next.text, false, next.location);
     } else if(next.type == Token::Type::kw_in) {
+        lexer.take_next();
         Token identifier;
         if(lexer.take_token(Token::Type::identifier).unwrapInto(identifier)) {
             return Parameter(identifier.text, true, next.location);
@@ -611,29 +575,21 @@ ParserResult<Parameter> Parser::parseParameter() {
         }
     }
 
-    return rewindAndReturn();
+    return ParserResult<Parameter>();
 }
 
 ParserResult<CtorParameter> Parser::parseCtorParameter() {
     // <ctor-parameter> := <type-name>
-    Token next = lexer.take_next();
-    if(next.type == Token::Type::identifier) {
+    Token next;
+    if(lexer.take_token(Token::Type::identifier).unwrapInto(next)) {
         return CtorParameter(next.text, next.location);
     } else {
-        lexer.rewind(next);
         return ParserResult<CtorParameter>();
     }
 }
 
 ParserResult<Constructor> Parser::parseConstructor() {
     std::vector<SyntaxError> errors;
-    Token next = lexer.peek_next();
-
-    auto rewindAndReturn = [&]() {
-        lexer.rewind(next);
-        return ParserResult<Constructor>();
-    };
-
     Token identifier;
 
     // <constructor> :=
@@ -641,7 +597,6 @@ ParserResult<Constructor> Parser::parseConstructor() {
     //  -- or --
     // <constructor> :=
     //     "ctor" <identifier> "(" <comma-separated-ctor-parameters> ")" ";"
-    lexer.rewind(next);
     if (lexer.take(Token::Type::kw_ctor)) {
         if (lexer.take_token(Token::Type::identifier).unwrapInto(identifier)) {
             if (lexer.take(Token::Type::end_of_statement)) {
@@ -680,28 +635,17 @@ ParserResult<Constructor> Parser::parseConstructor() {
         }
     }
 
-    if (errors.empty()) {
-        return rewindAndReturn();
-    } else {
-        return ParserResult<Constructor>(errors);
-    }
+    return ParserResult<Constructor>(errors);
 }
 
 ParserResult<Type> Parser::parseType() {
     std::vector<SyntaxError> errors;
-    Token first = lexer.peek_next();
-
-    auto rewindAndReturn = [&]() {
-        lexer.rewind(first);
-        return ParserResult<Type>(errors);
-    };
-
     TypeDecl declaration;
 
     // <type> :=
     //     "type" <type-name> "{" "}"
     if(!lexer.take(Token::Type::kw_type)) {
-        return rewindAndReturn();
+        return ParserResult<Type>();
     }
 
     if(parseTypeDecl().unwrapResultGuard(declaration, errors)) {
@@ -729,15 +673,12 @@ ParserResult<Type> Parser::parseType() {
 }
 
 ParserResult<std::vector<EffectRef>> Parser::parseEffectList() {
-    Token first = lexer.take_next();
     std::vector<SyntaxError> errors;
-
     std::vector<EffectRef> effects;
 
     // <effect-list> := ""
     // <effect-list> := ":" <comma-separated-effect-refs>
-    if(first.type != Token::Type::colon) {
-        lexer.rewind(first);
+    if(!lexer.take(Token::Type::colon)) {
         return effects;
     }
 
@@ -757,35 +698,36 @@ ParserResult<std::vector<EffectRef>> Parser::parseEffectList() {
 }
 
 ParserResult<EffectDecl> Parser::parseEffectDecl() {
-    Token next = lexer.take_next();
-    if(next.type == Token::Type::identifier) {
+    Token next;
+    if(lexer.take_token(Token::Type::identifier).unwrapInto(next)) {
         return EffectDecl(next.text, next.location);
     } else {
-        lexer.rewind(next);
         return ParserResult<EffectDecl>();
     }
 }
 
 ParserResult<EffectConstructor> Parser::parseEffectConstructor() {
-    Token next = lexer.peek_next();
     std::vector<SyntaxError> errors;
 
-    Token identifier;
+    // Both forms begin with "ctor" <identifier>, so the third token decides
+    // which one to parse.
+    if( lexer.peek_ahead(0).type != Token::Type::kw_ctor ||
+        lexer.peek_ahead(1).type != Token::Type::identifier) {
+        return ParserResult<EffectConstructor>();
+    }
+
+    Token next = lexer.take_next();
+    Token identifier = lexer.take_next();
 
     // <effect-constructor> :=
     //     "ctor" <identifier> ";"
-    if( lexer.take(Token::Type::kw_ctor) &&
-        lexer.take_token(Token::Type::identifier).unwrapInto(identifier) &&
-        lexer.take(Token::Type::end_of_statement)) {
-            return EffectConstructor(identifier.text, {}, identifier.location);
+    if(lexer.take(Token::Type::end_of_statement)) {
+        return EffectConstructor(identifier.text, {}, identifier.location);
     }
 
     // <effect-constructor> :=
     //     "ctor" <identifier> "(" <comma-separated-parameters> ")" ";"
-    lexer.rewind(next);
-    if( lexer.take(Token::Type::kw_ctor) &&
-        lexer.take_token(Token::Type::identifier).unwrapInto(identifier) &&
-        lexer.take(Token::Type::paren_l)) {
+    if(lexer.take(Token::Type::paren_l)) {
 
         std::vector<Parameter> parameters;
         Parameter param;
@@ -866,7 +808,7 @@ ParserResult<AST> Parser::parseAST() {
         } else {
             Token unexpectedToken = lexer.peek_next();
             if(unexpectedToken.type != Token::Type::end_of_file) {
-                errors.push_back(SyntaxError("Unexpected token \"" + unexpectedToken.text + "\".", unexpectedToken.location));
+                errors.push_back(SyntaxError("Unexpected token \"" + std::string(unexpectedToken.text) + "\".", unexpectedToken.location));
             }
             reached_eof = true;
         }
@@ -0,0 +1,98 @@
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+
+#include "Utils/ParserValues.h"
+
+namespace {
+
+SymbolTable &processTable() {
+    // Names are created during static initialization (e.g. for builtins), so
+    // the table must be constructed on first use.
+    static SymbolTable *table = new SymbolTable();
+    return *table;
+}
+
+thread_local SymbolTable *currentTable = nullptr;
+
+/// The symbols which a thread has already found in a table. Its keys view the
+/// table's own copies of the symbols, so they are only valid while `generation`
+/// is that of the table in which they were found.
+struct ThreadCache {
+    uint64_t generation = 0;
+    std::unordered_map<std::string_view, const std::string*> symbols;
+};
+
+thread_local ThreadCache threadCache;
+
+uint64_t nextGeneration() {
+    static std::atomic<uint64_t> generation = 1;
+    return generation++;
+}
+
+} // namespace
+
+SymbolTable::SymbolTable(): generation(nextGeneration()) {}
+
+SymbolTable::~SymbolTable() {
+    if(threadCache.generation == generation) {
+        threadCache.generation = 0;
+        threadCache.symbols.clear();
+    }
+}
+
+const std::string *SymbolTable::find(std::string_view text) {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    auto symbol = symbols.find(text);
+    return symbol == symbols.end() ? nullptr : &*symbol;
+}
+
+const std::string *SymbolTable::intern(std::string_view text) {
+    if(text.empty()) {
+        return emptySymbol();
+    }
+
+    if(threadCache.generation != generation) {
+        threadCache.generation = generation;
+        threadCache.symbols.clear();
+    }
+    auto cached = threadCache.symbols.find(text);
+    if(cached != threadCache.symbols.end()) {
+        return cached->second;
+    }
+
+    // A compilation's own symbols are searched first, so that its names stay
+    // consistent even if the process-wide table gains the same text later.
+    const std::string *symbol = find(text);
+    if(!symbol && this != &processTable()) {
+        symbol = processTable().find(text);
+    }
+    if(!symbol) {
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        symbol = &*symbols.emplace(text).first;
+    }
+
+    threadCache.symbols.emplace(*symbol, symbol);
+    return symbol;
+}
+
+SymbolTable &SymbolTable::current() {
+    return currentTable ? *currentTable : processTable();
+}
+
+SymbolTable::Scope::Scope(SymbolTable &table): previous(currentTable) {
+    currentTable = &table;
+}
+
+SymbolTable::Scope::~Scope() {
+    currentTable = previous;
+}
+
+const std::string *internSymbol(std::string_view text) {
+    return SymbolTable::current().intern(text);
+}
+
+const std::string *emptySymbol() {
+    static const std::string empty;
+    return &empty;
+}
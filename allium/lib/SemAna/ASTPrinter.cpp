@@ -232,9 +232,9 @@ void ASTPrinter::visit(const AST &ast) {
     indent();
     out << "<TypedAST>\n";
     depth++;
-    for(const auto &x : ast.types) visit(x);
-    for(const auto &x : ast.effects) visit(x);
-    for(const auto &x : ast.predicates) visit(x);
+    for(const auto &x : ast.getTypes()) visit(x);
+    for(const auto &x : ast.getEffects()) visit(x);
+    for(const auto &x : ast.getPredicates()) visit(x);
     depth--;
 }
 
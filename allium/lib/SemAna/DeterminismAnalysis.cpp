@@ -0,0 +1,130 @@
+#include <algorithm>
+
+#include "SemAna/DeterminismAnalysis.h"
+
+namespace TypedAST {
+
+/// True iff no ground value can unify with both `left` and `right`, because
+/// they are built by different constructors or are different literals.
+static bool areDisjoint(const Value &left, const Value &right) {
+    return left.match<bool>(
+    [](AnonymousVariable) { return false; },
+    [](const Variable &) { return false; },
+    [&](const ConstructorRef &lcr) {
+        std::unique_ptr<ConstructorRef> rcr;
+        if(!right.as_a<ConstructorRef>().unwrapInto(rcr)) {
+            return false;
+        }
+        if(lcr.name != rcr->name) {
+            return true;
+        }
+        for(size_t i = 0; i < lcr.arguments.size(); ++i) {
+            if(areDisjoint(lcr.arguments[i], rcr->arguments[i])) {
+                return true;
+            }
+        }
+        return false;
+    },
+    [&](const StringLiteral &) {
+        return right.is_a<StringLiteral>() && !(left == right);
+    },
+    [&](IntegerLiteral) {
+        return right.is_a<IntegerLiteral>() && !(left == right);
+    });
+}
+
+/// True iff the heads of two implications can't both unify with the same
+/// ground arguments.
+static bool areExclusive(const Implication &first, const Implication &second) {
+    for(size_t i = 0; i < first.head.arguments.size(); ++i) {
+        if(areDisjoint(first.head.arguments[i], second.head.arguments[i])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/// True iff the expression has at most one witness, assuming that each of
+/// `predicates` does.
+static bool isSemideterministic(
+    const AST &ast,
+    const Expression &expr,
+    const std::set<Name<Predicate>> &predicates
+) {
+    return expr.match<bool>(
+    [](const TruthLiteral &) { return true; },
+    [&](const PredicateRef &pr) {
+        // Builtin predicates have at most one witness.
+        return ast.resolvePredicateRef(pr).is_a<const BuiltinPredicate*>() ||
+            predicates.contains(pr.name);
+    },
+    // The handler of an effect may prove its continuation any number of
+    // times.
+    [](const EffectCtorRef &) { return false; },
+    [&](const Conjunction &conj) {
+        return isSemideterministic(ast, conj.getLeft(), predicates) &&
+            isSemideterministic(ast, conj.getRight(), predicates);
+    });
+}
+
+std::set<Name<Predicate>> getSemideterministicPredicates(const AST &ast) {
+    /*
+     * Assume that every predicate which could be semideterministic is, and
+     * then disprove it until a fixpoint is reached. A predicate can be
+     * semideterministic if:
+     *  1. All of its parameters are "in", so that it never binds its
+     *     arguments, and
+     *  2. It has no effects or handlers, and
+     *  3. At most one of its implications can match any arguments.
+     * It is semideterministic if, in addition, the body of each implication
+     * is a conjunction of semideterministic predicates.
+     *
+     * Assuming that recursive predicates are semideterministic is sound, since
+     * a recursive proof only has more than one witness if some step of it
+     * does.
+     */
+    std::set<Name<Predicate>> predicates;
+    for(const auto &pred : ast.getPredicates()) {
+        const auto &params = pred.declaration.parameters;
+        bool allInputs = std::all_of(
+            params.begin(),
+            params.end(),
+            [](const Parameter &param) { return param.isInputOnly; });
+        if(!allInputs ||
+                !pred.declaration.effects.empty() ||
+                !pred.handlers.empty()) {
+            continue;
+        }
+
+        bool isExclusive = true;
+        for(size_t i = 0; i < pred.implications.size() && isExclusive; ++i) {
+            for(size_t j = i + 1; j < pred.implications.size() && isExclusive; ++j) {
+                isExclusive = areExclusive(pred.implications[i], pred.implications[j]);
+            }
+        }
+        if(isExclusive) {
+            predicates.insert(pred.declaration.name);
+        }
+    }
+
+    bool changed;
+    do {
+        changed = false;
+        for(const auto &pred : ast.getPredicates()) {
+            if(!predicates.contains(pred.declaration.name)) {
+                continue;
+            }
+            for(const auto &impl : pred.implications) {
+                if(!isSemideterministic(ast, impl.body, predicates)) {
+                    predicates.erase(pred.declaration.name);
+                    changed = true;
+                    break;
+                }
+            }
+        }
+    } while(changed);
+
+    return predicates;
+}
+
+}
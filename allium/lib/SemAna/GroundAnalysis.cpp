@@ -553,10 +553,32 @@ public:
         Context ctx;
         analyzePredicateRef(ctx, PredicateRef("main", {}));
     }
+
+    void analyzeLibrary() {
+        // A library's callers must pass ground arguments to its predicates'
+        // "in" parameters, and may pass anything else.
+        for(const auto &pred : ast.getPredicates()) {
+            Context ctx;
+            std::vector<Value> arguments;
+            for(size_t i=0; i<pred.declaration.parameters.size(); ++i) {
+                const auto &param = pred.declaration.parameters[i];
+                Variable argument("arg" + std::to_string(i), param.type, false);
+                ctx.insert({ argument.name, param.isInputOnly });
+                arguments.push_back(Value(argument));
+            }
+            analyzePredicateRef(
+                ctx,
+                PredicateRef(pred.declaration.name.string(), arguments));
+        }
+    }
 };
 
 void checkGroundParameters(const AST &ast, ErrorEmitter &error) {
     GroundAnalysis(ast, error).analyzeMain();
 }
 
+void checkLibraryGroundParameters(const AST &ast, ErrorEmitter &error) {
+    GroundAnalysis(ast, error).analyzeLibrary();
+}
+
 }
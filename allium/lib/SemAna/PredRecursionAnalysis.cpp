@@ -1,4 +1,5 @@
 
+#include <algorithm>
 #include <functional>
 
 #include "SemAna/PredRecursionAnalysis.h"
@@ -6,7 +7,7 @@
 namespace TypedAST {
 
 PredDependenceGraph::PredDependenceGraph(const AST &ast) {
-    for(const auto &p : ast.predicates) {
+    for(const auto &p : ast.getPredicates()) {
         adjacencyList[p.declaration.name] = {};
         for(const auto &impl : p.implications) {
             forAllPredRefs(impl.body, [&](const PredicateRef &pr) {
@@ -27,7 +28,7 @@ bool PredDependenceGraph::isRecursive(const Name<Predicate> &name) const {
 bool PredDependenceGraph::dependsOnHelper(
     const Name<Predicate> &first,
     const Name<Predicate> &second,
-    std::set<Name<Predicate>> &visited
+    std::unordered_set<Name<Predicate>> &visited
 ) const {
     // There's no need to track recursion for builtin predicates, since this is
     // an implementation detail. Any place where this "would be" used needs to
@@ -55,10 +56,67 @@ bool PredDependenceGraph::dependsOn(
     const Name<Predicate> &first,
     const Name<Predicate> &second
 ) const {
-    std::set<Name<Predicate>> visited;
+    std::unordered_set<Name<Predicate>> visited;
     return dependsOnHelper(first, second, visited);
 
 }
 
+std::vector<std::vector<Name<Predicate>>> PredDependenceGraph::getStronglyConnectedComponents(
+    const AST &ast
+) const {
+    // Tarjan's algorithm, which finds each component after all of the
+    // components reachable from it. The predicates are visited in the order of
+    // the AST so that the result is deterministic.
+    struct Vertex {
+        size_t index;
+        size_t lowLink;
+        bool onStack;
+    };
+    std::unordered_map<Name<Predicate>, Vertex> vertices;
+    std::vector<Name<Predicate>> stack;
+    std::vector<std::vector<Name<Predicate>>> components;
+
+    std::function<void(const Name<Predicate> &)> visit = [&](const Name<Predicate> &p) {
+        size_t index = vertices.size();
+        vertices[p] = { index, index, true };
+        stack.push_back(p);
+
+        // Callees are visited in a deterministic order, since the adjacency
+        // list is unordered.
+        std::vector<Name<Predicate>> callees(
+            adjacencyList.at(p).begin(),
+            adjacencyList.at(p).end());
+        std::sort(callees.begin(), callees.end());
+        for(const auto &q : callees) {
+            auto vertex = vertices.find(q);
+            if(vertex == vertices.end()) {
+                visit(q);
+                vertices[p].lowLink = std::min(vertices[p].lowLink, vertices[q].lowLink);
+            } else if(vertex->second.onStack) {
+                vertices[p].lowLink = std::min(vertices[p].lowLink, vertex->second.index);
+            }
+        }
+
+        if(vertices[p].lowLink == vertices[p].index) {
+            std::vector<Name<Predicate>> component;
+            Name<Predicate> q;
+            do {
+                q = stack.back();
+                stack.pop_back();
+                vertices[q].onStack = false;
+                component.push_back(q);
+            } while(q != p);
+            components.push_back(component);
+        }
+    };
+
+    for(const auto &p : ast.getPredicates()) {
+        if(!vertices.contains(p.declaration.name)) {
+            visit(p.declaration.name);
+        }
+    }
+    return components;
+}
+
 } // namespace TypedAST
 
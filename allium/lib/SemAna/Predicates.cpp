@@ -51,8 +51,8 @@ public:
 
     Optional<TypedAST::PredicateDecl> visit(const PredicateDecl &pd) {
         const auto originalDeclaration = std::find_if(
-            ast.predicates.begin(),
-            ast.predicates.end(),
+            ast.getPredicates().begin(),
+            ast.getPredicates().end(),
             [&](Predicate p) {
                 return p.name.name == pd.name;
             });
@@ -77,7 +77,11 @@ public:
             )
         ).map<TypedAST::PredicateDecl>(
             [&](auto pair) {
-                return TypedAST::PredicateDecl(pd.name.string(), pair.first, pair.second);
+                return TypedAST::PredicateDecl(
+                    pd.name.string(),
+                    pair.first,
+                    pair.second,
+                    pd.location);
             }
         );
     }
@@ -149,7 +153,7 @@ public:
             }
         );
 
-        return TypedAST::PredicateRef(pr.name.string(), arguments);
+        return TypedAST::PredicateRef(pr.name.string(), arguments, pr.location);
     }
 
     Optional<TypedAST::EffectCtorRef> visit(const EffectCtorRef &ecr) {
@@ -374,8 +378,8 @@ public:
         }
 
         const auto originalDeclaration = std::find_if(
-            ast.types.begin(),
-            ast.types.end(),
+            ast.getTypes().begin(),
+            ast.getTypes().end(),
             [&](Type type) {
                 return type.declaration.name == td.name;
             })->declaration;
@@ -652,8 +656,8 @@ public:
         // TODO: builtin effects?
 
         const auto originalDeclaration = std::find_if(
-            ast.effects.begin(),
-            ast.effects.end(),
+            ast.getEffects().begin(),
+            ast.getEffects().end(),
             [&](Effect e) {
                 return e.declaration.name == decl.name;
             })->declaration;
@@ -746,17 +750,17 @@ public:
 
     TypedAST::AST visit(const AST &ast) {
         raisedTypes = compactMap<Type, TypedAST::Type>(
-            ast.types,
+            ast.getTypes(),
             [&](Type type) { return visit(type); }
         );
 
         raisedEffects = compactMap<Effect, TypedAST::Effect>(
-            ast.effects,
+            ast.getEffects(),
             [&](Effect effect) { return visit(effect); }
         );
 
         auto raisedPredicates = compactMap<Predicate, TypedAST::UserPredicate>(
-            ast.predicates,
+            ast.getPredicates(),
             [&](Predicate predicate) { return visit(predicate); }
         );
 
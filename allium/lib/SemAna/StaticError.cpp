@@ -66,8 +66,17 @@ std::ostream& operator<<(std::ostream &out, const ErrorMessage &msg) {
     return out << formatString(msg);
 }
 
+void ErrorEmitter::writeLocation(SourceLocation loc) const {
+    out << "error ";
+    if(loc.module >= 0 && (size_t) loc.module < modulePaths.size()) {
+        out << modulePaths[loc.module] << " ";
+    }
+    out << loc << " - ";
+}
+
 void ErrorEmitter::emit(SourceLocation loc, ErrorMessage msg) const {
-    out << "error " << loc << " - " << formatString(msg) << "\n";
+    writeLocation(loc);
+    out << formatString(msg) << "\n";
     ++errors;
 }
 
@@ -77,7 +86,8 @@ void ErrorEmitter::emit(SourceLocation loc, ErrorMessage msg, std::string a1) co
 
     char *buffer = (char *) malloc(length);
     snprintf(buffer, length, msg_str.c_str(), a1.c_str());
-    out << "error " << loc << " - " << buffer << "\n";
+    writeLocation(loc);
+    out << buffer << "\n";
     free(buffer);
     ++errors;
 }
@@ -89,7 +99,8 @@ void ErrorEmitter::emit(SourceLocation loc, ErrorMessage msg, std::string a1, st
 
     char *buffer = (char *) malloc(length);
     snprintf(buffer, length, msg_str.c_str(), a1.c_str(), a2.c_str());
-    out << "error " << loc << " - " << buffer << "\n";
+    writeLocation(loc);
+    out << buffer << "\n";
     free(buffer);
     ++errors;
 }
@@ -103,7 +114,8 @@ void ErrorEmitter::emit(SourceLocation loc, ErrorMessage msg,
 
     char *buffer = (char *) malloc(length);
     snprintf(buffer, length, msg_str.c_str(), a1.c_str(), a2.c_str(), a3.c_str());
-    out << "error " << loc << " - " << buffer << "\n";
+    writeLocation(loc);
+    out << buffer << "\n";
     free(buffer);
     ++errors;
 }
@@ -79,8 +79,11 @@ bool operator!=(const Handler &left, const Handler &right) {
     return !(left == right);
 }
 
-PredicateRef::PredicateRef(std::string name, std::vector<Value> arguments):
-    name(name), arguments(arguments) {}
+PredicateRef::PredicateRef(
+    std::string name,
+    std::vector<Value> arguments,
+    SourceLocation location
+): name(name), arguments(arguments), location(location) {}
 
 EffectCtorRef::EffectCtorRef(
     std::string effectName,
@@ -256,20 +259,34 @@ std::ostream& operator<<(std::ostream &out, const Implication &impl) {
     return out << impl.head << " <- " << impl.body;
 }
 
-const Type &AST::resolveTypeRef(const Name<Type> &tr) const {
-    auto x = std::find_if(
-        types.begin(),
-        types.end(),
-        [&](const Type &type) { return type.declaration.name == tr; });
+AST::AST(
+    std::vector<Type> types,
+    std::vector<Effect> effects,
+    std::vector<UserPredicate> predicates
+):  types(std::move(types)),
+    effects(std::move(effects)),
+    predicates(std::move(predicates)) {
+
+    // Semantic analysis rejects redefinitions, but if there are any then the
+    // first definition wins, as with a linear search.
+    for(size_t i = 0; i < this->types.size(); ++i)
+        typeIndices.emplace(this->types[i].declaration.name, i);
+    for(size_t i = 0; i < this->effects.size(); ++i)
+        effectIndices.emplace(this->effects[i].declaration.name, i);
+    for(size_t i = 0; i < this->predicates.size(); ++i)
+        predicateIndices.emplace(this->predicates[i].declaration.name, i);
+}
 
-    if(x == types.end()) {
-        x = std::find_if(
-            builtinTypes.begin(),
-            builtinTypes.end(),
-            [&](const Type &type) { return type.declaration.name == tr; });
-        assert(x != builtinTypes.end());
-    }
+const Type &AST::resolveTypeRef(const Name<Type> &tr) const {
+    const auto index = typeIndices.find(tr);
+    if(index != typeIndices.end())
+        return types[index->second];
 
+    const auto x = std::find_if(
+        builtinTypes.begin(),
+        builtinTypes.end(),
+        [&](const Type &type) { return type.declaration.name == tr; });
+    assert(x != builtinTypes.end());
     return *x;
 }
 
@@ -286,19 +303,15 @@ const Constructor &AST::resolveConstructorRef(const Name<Type> &tr, const Constr
 }
 
 const Effect &AST::resolveEffectRef(const Name<Effect> &er) const {
-    auto effect = std::find_if(
-        effects.begin(),
-        effects.end(),
-        [&](const Effect &e) { return e.declaration.name == er; });
-    
-    if(effect == effects.end()) {
-        effect = std::find_if(
-            builtinEffects.begin(),
-            builtinEffects.end(),
-            [&](const Effect &e) { return e.declaration.name == er; });
-        assert(effect != builtinEffects.end());
-    }
+    const auto index = effectIndices.find(er);
+    if(index != effectIndices.end())
+        return effects[index->second];
 
+    const auto effect = std::find_if(
+        builtinEffects.begin(),
+        builtinEffects.end(),
+        [&](const Effect &e) { return e.declaration.name == er; });
+    assert(effect != builtinEffects.end());
     return *effect;
 }
 
@@ -318,22 +331,16 @@ const EffectCtor &AST::resolveEffectCtorRef(
 }
 
 const Predicate AST::resolvePredicateRef(const PredicateRef &pr) const {
-    const auto up = std::find_if(
-        predicates.begin(),
-        predicates.end(),
-        [&](const UserPredicate &up) { return up.declaration.name == pr.name; });
-
-    if(up == predicates.end()) {
-        const auto bp = std::find_if(
-            builtinPredicates.begin(),
-            builtinPredicates.end(),
-            [&](const BuiltinPredicate &bp) { return bp.declaration.name == pr.name; });
-        assert(bp != builtinPredicates.end());
-        return Predicate(&*bp);
-    }
-
-    assert(up != predicates.end());
-    return Predicate(&*up);
+    const auto index = predicateIndices.find(pr.name);
+    if(index != predicateIndices.end())
+        return Predicate(&predicates[index->second]);
+
+    const auto bp = std::find_if(
+        builtinPredicates.begin(),
+        builtinPredicates.end(),
+        [&](const BuiltinPredicate &bp) { return bp.declaration.name == pr.name; });
+    assert(bp != builtinPredicates.end());
+    return Predicate(&*bp);
 }
 
 }
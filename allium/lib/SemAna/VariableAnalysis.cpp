@@ -37,6 +37,11 @@ private:
         getVariables(conj.getRight());
     }
 
+    void getVariables(const HandlerConjunction &hConj) {
+        getVariables(hConj.getLeft());
+        getVariables(hConj.getRight());
+    }
+
 public:
     VariableAnalysis(const AST &ast): ast(ast) {}
 
@@ -53,6 +58,20 @@ public:
         );
     }
 
+    void getVariables(const EffectImplHead &head) {
+        for(const auto &arg : head.arguments) getVariables(arg);
+    }
+
+    void getVariables(const HandlerExpression &hExpr) {
+        hExpr.switchOver(
+        [](TruthLiteral) {},
+        [](Continuation) {},
+        [&](PredicateRef pr) { getVariables_(pr); },
+        [&](EffectCtorRef ecr) { getVariables(ecr); },
+        [&](HandlerConjunction hConj) { getVariables(hConj); }
+        );
+    }
+
     Scope getScope() {
         return scope;
     }
@@ -65,4 +84,11 @@ Scope getVariables(const AST &ast, const Implication &impl) {
     return va.getScope();
 }
 
+Scope getVariables(const AST &ast, const EffectImplication &eImpl) {
+    VariableAnalysis va(ast);
+    va.getVariables(eImpl.head);
+    va.getVariables(eImpl.body);
+    return va.getScope();
+}
+
 }
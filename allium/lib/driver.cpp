@@ -1,16 +1,20 @@
 #include <cstdlib>
 #include <filesystem>
+#include <fstream>
+#include <sstream>
 #include <iostream>
 #include <string>
 #include <vector>
 
 #include "Interpreter/ASTLower.h"
 #include "Interpreter/Program.h"
+#include "Interpreter/ProgramImage.h"
 #ifdef ENABLE_COMPILER
 #include "LLVMCodeGen/CodeGen.h"
 #endif
 #include "Parser/ASTPrinter.h"
 #include "Parser/Lexer.h"
+#include "Parser/Modules.h"
 #include "Parser/Parser.h"
 #include "SemAna/ASTPrinter.h"
 #include "SemAna/GroundAnalysis.h"
@@ -22,6 +26,10 @@ static std::string defaultObjName(std::string sourceName) {
     return std::filesystem::path(sourceName).stem().string() + ".o";
 }
 
+static std::string defaultLibraryName(std::string sourceName) {
+    return "lib" + std::filesystem::path(sourceName).stem().string() + ".so";
+}
+
 struct Arguments {
     /// Represents the possible ways for Allium to execute
     enum class ExecutionMode {
@@ -60,6 +68,9 @@ struct Arguments {
     #endif
     interpreter::Config interpreterConfig;
 
+    /// The directory in which the interpreter caches program images, if any.
+    std::string imageCacheDirectory;
+
     static void issueError(Error error) {
         std::cout << "Error: ";
         switch(error) {
@@ -128,9 +139,49 @@ struct Arguments {
             } else if(arg == "-c") {
                 arguments.compilerOnly();
                 arguments.compilerConfig.outputType = compiler::OutputType::OBJECT;
+            } else if(arg == "-shared") {
+                arguments.compilerOnly();
+                arguments.compilerConfig.outputType = compiler::OutputType::SHARED_LIBRARY;
             } else if(arg == "-g") {
                 arguments.compilerOnly();
                 arguments.compilerConfig.debug = true;
+            } else if(arg.size() == 3 && arg.starts_with("-O") &&
+                    arg[2] >= '0' && arg[2] <= '3') {
+                arguments.compilerOnly();
+                arguments.compilerConfig.optimizationLevel = arg[2] - '0';
+            } else if(arg.starts_with("-march=") || arg.starts_with("-mcpu=")) {
+                arguments.compilerOnly();
+                arguments.compilerConfig.cpu = arg.substr(arg.find('=') + 1);
+            } else if(arg == "--jit") {
+                arguments.compilerOnly();
+                arguments.compilerConfig.jit = true;
+            } else if(arg == "-flto") {
+                arguments.compilerOnly();
+                arguments.compilerConfig.linkTimeOptimization = true;
+            } else if(arg == "-fprofile-generate") {
+                arguments.compilerOnly();
+                arguments.compilerConfig.profileGenerate = "allium.profile";
+            } else if(arg.starts_with("-fprofile-generate=")) {
+                arguments.compilerOnly();
+                arguments.compilerConfig.profileGenerate = arg.substr(19);
+            } else if(arg.starts_with("-fprofile-use=")) {
+                arguments.compilerOnly();
+                arguments.compilerConfig.profileUse = arg.substr(14);
+            } else if(arg == "-fcount") {
+                arguments.compilerOnly();
+                arguments.compilerConfig.countOutput = "allium.counts.json";
+            } else if(arg.starts_with("-fcount=")) {
+                arguments.compilerOnly();
+                arguments.compilerConfig.countOutput = arg.substr(8);
+            } else if(arg.starts_with("--threads=")) {
+                arguments.compilerOnly();
+                arguments.compilerConfig.threads = std::stoul(arg.substr(10));
+            } else if(arg.starts_with("--object-cache=")) {
+                arguments.compilerOnly();
+                arguments.compilerConfig.objectCacheDirectory = arg.substr(15);
+            } else if(arg == "-fcompact-layout") {
+                arguments.compilerOnly();
+                arguments.compilerConfig.compactLayout = true;
             } else if(arg == "--print-llvm") {
                 arguments.compilerOnly();
                 arguments.compilerConfig.printLLVMIR = true;
@@ -142,6 +193,9 @@ struct Arguments {
                 arguments.interpreterOnly();
                 arguments.interpreterConfig.debugLevel =
                     static_cast<interpreter::Config::LogLevel>(std::stoi(&arg.c_str()[12]));
+            } else if(arg.starts_with("--image-cache=")) {
+                arguments.interpreterOnly();
+                arguments.imageCacheDirectory = arg.substr(14);
             } else {
                 if(!arg.ends_with(".allium")) {
                     std::cout << "Attempted to compile or interpret " << arg << "\n";
@@ -172,35 +226,132 @@ struct Arguments {
             case compiler::OutputType::OBJECT:
                 arguments.compilerConfig.outputFile = defaultObjName(arguments.filePaths[0]);
                 break;
+            case compiler::OutputType::SHARED_LIBRARY:
+                arguments.compilerConfig.outputFile = defaultLibraryName(arguments.filePaths[0]);
+                break;
             }
         }
+
+        // The header of a shared library goes next to it.
+        arguments.compilerConfig.headerFile = std::filesystem::path(
+            arguments.compilerConfig.outputFile).replace_extension(".h").string();
         #endif
 
         return arguments;
     }
 };
 
+/// Proves `main` using the interpreter, and exits with the result.
+[[noreturn]] static void interpret(interpreter::Program &program) {
+    program.getEntryPoint().switchOver<void>(
+    [&](interpreter::PredicateReference main) {
+        exit(!program.prove(interpreter::Expression(main)));
+    },
+    [] {
+        std::cout << "Invoked program with no predicate named main.\n";
+        exit(1);
+    });
+    exit(1);
+}
+
 int main(int argc, char *argv[]) {
     Arguments arguments = Arguments::parse(argc, argv);
 
-    // Note: we currently only support single-file programs. This will need to
-    // change someday to support multi-file programs.
-    std::ifstream file(arguments.filePaths.front());
-    ErrorEmitter errorEmitter(std::cout);
+    // Like syntax errors, semantic errors only name their file when there is
+    // more than one to choose from.
+    ErrorEmitter errorEmitter(
+        std::cout,
+        arguments.filePaths.size() > 1 ?
+            arguments.filePaths : std::vector<std::string>());
+
+    // The names of the program are interned in a table which is freed with
+    // the compilation.
+    SymbolTable symbols;
+    SymbolTable::Scope symbolScope(symbols);
 
-    if (!file.is_open()) {
-        std::cout << "Unable to read the specified input file (" << arguments.filePaths.front() << ")\n";
+    for(const std::string &path : arguments.filePaths) {
+        if(!std::ifstream(path).is_open()) {
+            std::cout << "Unable to read the specified input file (" << path << ")\n";
+            exit(1);
+        }
+    }
+
+    // The interpreter can skip the frontend entirely if it has already cached
+    // an image of these exact sources.
+    bool useImageCache = !arguments.imageCacheDirectory.empty() &&
+        !arguments.printAST;
+    uint64_t sourceHash = 0;
+    if(useImageCache) {
+        std::vector<std::string> sources;
+        for(const std::string &path : arguments.filePaths) {
+            std::ostringstream source;
+            source << std::ifstream(path).rdbuf();
+            sources.push_back(source.str());
+        }
+        sourceHash = interpreter::hashSources(sources);
+
+        std::unique_ptr<interpreter::Program> program =
+            interpreter::loadCachedProgram(
+                arguments.imageCacheDirectory,
+                sourceHash,
+                arguments.interpreterConfig);
+        if(program) {
+            interpret(*program);
+        }
+    }
+
+    // Each source file is a module of the program. Modules are parsed
+    // independently, and then linked into a single AST for the whole program.
+    std::vector<parser::ParserResult<parser::AST>> modules =
+        parser::parseModules(arguments.filePaths);
+
+    bool syntaxErrors = false;
+    std::vector<parser::AST> moduleASTs;
+    for(size_t i = 0; i < modules.size(); ++i) {
+        parser::AST ast;
+        std::vector<parser::SyntaxError> errors;
+        if(modules[i].unwrapResultGuard(ast, errors)) {
+            exit(1);
+        }
+
+        if(!errors.empty()) {
+            // Only name the file when there is more than one to choose from.
+            if(modules.size() > 1) {
+                std::cout << "In " << arguments.filePaths[i] << ":\n";
+            }
+            for (parser::SyntaxError const& error : errors) {
+                std::cout << error;
+            }
+            syntaxErrors = true;
+        } else {
+            moduleASTs.push_back(std::move(ast));
+        }
+    }
+
+    if(syntaxErrors) {
         exit(1);
     }
 
-    parser::Parser(file).parseAST()
-    .error([](const std::vector<parser::SyntaxError> &errors) {
-        for (parser::SyntaxError const& error : errors) {
+    // Debug info locates each predicate in the module which defines it.
+    arguments.compilerConfig.sourceFiles = arguments.filePaths;
+    for(size_t i = 0; i < moduleASTs.size(); ++i) {
+        for(const parser::Predicate &predicate : moduleASTs[i].getPredicates()) {
+            arguments.compilerConfig.predicateModules.insert(
+                { predicate.name.name.string(), i });
+        }
+    }
+
+    std::vector<parser::LinkError> linkErrors;
+    parser::AST program = parser::link(
+        moduleASTs, arguments.filePaths, linkErrors);
+    if(!linkErrors.empty()) {
+        for(parser::LinkError const& error : linkErrors) {
             std::cout << error;
         }
         exit(1);
-    })
-    .as_optional()
+    }
+
+    Optional<parser::AST>(std::move(program))
     .then([&](const parser::AST &ast) {
         if(arguments.printAST == Arguments::PrintASTMode::SYNTACTIC) {
             parser::ASTPrinter(std::cout).visit(ast);
@@ -218,6 +369,14 @@ int main(int argc, char *argv[]) {
             exit(1);
         }
     }).then([&](TypedAST::AST ast) {
+        #ifdef ENABLE_COMPILER
+        if(arguments.executionMode == Arguments::ExecutionMode::COMPILER &&
+                !arguments.compilerConfig.jit &&
+                arguments.compilerConfig.outputType == compiler::OutputType::SHARED_LIBRARY) {
+            checkLibraryGroundParameters(ast, errorEmitter);
+            return;
+        }
+        #endif
         checkGroundParameters(ast, errorEmitter);
     }).then([&](TypedAST::AST) {
         unsigned errors = errorEmitter.getErrors();
@@ -233,23 +392,24 @@ int main(int argc, char *argv[]) {
     }).branch(arguments.executionMode == Arguments::ExecutionMode::COMPILER,
         [&](TypedAST::AST ast) {
             #ifdef ENABLE_COMPILER
-            cgProgram(ast, arguments.compilerConfig);
+            if(arguments.compilerConfig.jit) {
+                exit(jitProgram(ast, arguments.compilerConfig));
+            }
+            if(!cgProgram(ast, arguments.compilerConfig)) {
+                exit(1);
+            }
             #else
             std::cout << "Invoked Allium as a compiler, but code generation is disabled in this Allium build.\n";
             exit(1);
             #endif
         },
         [&](TypedAST::AST ast) {
-            using namespace interpreter;
             auto program = lower(ast, arguments.interpreterConfig);
-            return program.getEntryPoint().switchOver<void>(
-            [&](interpreter::PredicateReference main) {
-                exit(!program.prove(interpreter::Expression(main)));
-            },
-            [] {
-                std::cout << "Invoked program with no predicate named main.\n";
-                exit(1);
-            });
+            if(useImageCache) {
+                interpreter::storeCachedProgram(
+                    arguments.imageCacheDirectory, sourceHash, program);
+            }
+            interpret(program);
         }
     );
 }
@@ -0,0 +1,94 @@
+// LIBRARY: Library.allium
+
+#include <stdio.h>
+#include "libLibrary.h"
+
+static int toInt(const allium_value *n) {
+    int i = 0;
+    while(allium_type_Nat_constructor(n) == ALLIUM_TYPE_Nat_S) {
+        n = allium_type_Nat_argument(n, 0);
+        ++i;
+    }
+    return allium_type_Nat_constructor(n) == ALLIUM_TYPE_Nat_Zero ? i : -1;
+}
+
+int main(void) {
+    allium_value *zero = allium_type_Nat_ctor_Zero();
+    allium_value *one = allium_type_Nat_ctor_S(zero);
+    allium_value *two = allium_type_Nat_ctor_S(one);
+
+    // A predicate named `next` doesn't replace allium_query_next.
+    allium_value *n = allium_type_Nat_variable();
+    allium_query *q = allium_pred_next_query(one, n);
+    int found = allium_query_next(q);
+    printf("next: %d %d\n", found, toInt(n));
+    printf("next again: %d\n", allium_query_next(q));
+    allium_query_free(q);
+    printf("after free: %d\n", allium_type_Nat_constructor(n));
+    // CHECK: next: 1 2
+    // CHECK-NEXT: next again: 0
+    // CHECK-NEXT: after free: -1
+
+    // Neither do constructors named `variable`, `constructor` and `argument`
+    // replace the functions of their type.
+    allium_value *flag = allium_type_Flag_variable();
+    q = allium_pred_free_query(flag);
+    while(allium_query_next(q)) {
+        printf("free: %d %d\n",
+            allium_type_Flag_constructor(flag),
+            allium_type_Flag_argument(flag, 0) == NULL);
+    }
+    allium_query_free(q);
+    allium_value *constructor = allium_type_Flag_ctor_constructor();
+    q = allium_pred_free_query(constructor);
+    printf("free(constructor): %d\n", allium_query_next(q));
+    allium_query_free(q);
+    // CHECK-NEXT: free: 0 1
+    // CHECK-NEXT: free: 2 1
+    // CHECK-NEXT: free(constructor): 0
+
+    // The underscore in Flag_ctor is escaped, so its variable function is
+    // distinct from the constructor `variable` of Flag.
+    allium_value *other = allium_type_Flag_0ctor_variable();
+    allium_value *variable = allium_type_Flag_0ctor_ctor_variable();
+    printf("Flag_ctor: %d %d\n",
+        allium_type_Flag_0ctor_constructor(other),
+        allium_type_Flag_0ctor_constructor(variable) == ALLIUM_TYPE_Flag_0ctor_variable);
+    // CHECK-NEXT: Flag_ctor: -1 1
+
+    allium_value *a = allium_type_Nat_variable();
+    allium_value *b = allium_type_Nat_variable();
+    q = allium_pred_add_query(a, b, two);
+    while(allium_query_next(q)) {
+        printf("split: %d + %d\n", toInt(a), toInt(b));
+    }
+    allium_query_free(q);
+    // CHECK-NEXT: split: 0 + 2
+    // CHECK-NEXT: split: 1 + 1
+    // CHECK-NEXT: split: 2 + 0
+
+    allium_value *name = allium_string_new("hello from C");
+    q = allium_pred_greet_query(name);
+    fflush(stdout);
+    int greeted = allium_query_next(q);
+    fflush(stdout);
+    printf("greet: %d\n", greeted);
+    allium_query_free(q);
+    // CHECK-NEXT: hello from C
+    // CHECK-NEXT: greet: 1
+
+    allium_value_free(name);
+    allium_value_free(b);
+    allium_value_free(a);
+    allium_value_free(variable);
+    allium_value_free(other);
+    allium_value_free(constructor);
+    allium_value_free(flag);
+    allium_value_free(n);
+    allium_value_free(two);
+    allium_value_free(one);
+    allium_value_free(zero);
+    return 0;
+}
+
+// CHECK-NEXT: Exit code: 0
@@ -0,0 +1,34 @@
+// LIBRARY: TailCall.allium
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "libTailCall.h"
+
+// Deep enough that the proofs overflow the stack unless each recursive call
+// reuses its caller's frame.
+#define DEPTH 4000000
+
+int main(void) {
+    allium_value **nats = malloc((DEPTH + 1) * sizeof(allium_value*));
+    nats[0] = allium_type_Nat_ctor_Zero();
+    for(int i = 1; i <= DEPTH; ++i) {
+        nats[i] = allium_type_Nat_ctor_S(nats[i - 1]);
+    }
+
+    allium_query *q = allium_pred_even_query(nats[DEPTH]);
+    printf("even(%d): %d\n", DEPTH, allium_query_next(q));
+    allium_query_free(q);
+    q = allium_pred_even_query(nats[DEPTH - 1]);
+    printf("even(%d): %d\n", DEPTH - 1, allium_query_next(q));
+    allium_query_free(q);
+    // CHECK: even(4000000): 1
+    // CHECK-NEXT: even(3999999): 0
+
+    for(int i = DEPTH; i >= 0; --i) {
+        allium_value_free(nats[i]);
+    }
+    free(nats);
+    return 0;
+}
+
+// CHECK-NEXT: Exit code: 0
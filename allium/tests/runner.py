@@ -6,10 +6,53 @@ import tempfile
 allium = os.path.normpath(sys.argv[1])
 filecheck = os.path.normpath(sys.argv[2])
 
+# In compiled mode, each test is also compiled and run with `--jit`, and must
+# produce the same output and exit code as the interpreter. The traces of the
+# two backends differ, so the CHECK lines only apply to the interpreter. Each
+# test is also compiled twice with an object cache, which the second
+# compilation must not add to, both with the default number of threads and
+# with four.
+compiled = "--compiled" in sys.argv[3:]
+
+def option(flag):
+    """Returns the value of a `--flag=value` argument, or None if it is
+    missing."""
+    for argument in sys.argv[3:]:
+        if argument.startswith(f"--{flag}="):
+            return argument[len(flag) + 3:]
+    return None
+
+# The C compiler and the directory of the runtime library, with which the C
+# drivers of the library tests are built.
+cc = option("cc")
+runtime_dir = option("runtime-dir")
+
+# The renderer of binary traces, allium-trace.
+trace_renderer = option("trace-renderer")
+include_dir = os.path.join(os.path.dirname(os.path.realpath(__file__)), "..", "include")
+
 tests_run = 0
 tests_passed = 0
 failed_tests = []
 
+def modules(name):
+    """Returns the paths of the additional modules listed on a test's
+    `// MODULES:` line, which are linked into the program under test."""
+    with open(name) as f:
+        for line in f:
+            if line.startswith("// MODULES:"):
+                return [
+                    os.path.join(os.path.dirname(name), module)
+                    for module in line[len("// MODULES:"):].split()
+                ]
+    return []
+
+def is_test(name):
+    """Modules which only exist to be linked into other tests have no CHECK
+    lines, and are not tests themselves."""
+    with open(name) as f:
+        return "CHECK" in f.read()
+
 def run(name):
     global tests_run, tests_passed
     print("Running test", name)
@@ -18,7 +61,7 @@ def run(name):
     with tempfile.TemporaryFile() as tracefile:
         try:
             exe = subprocess.run(
-                [allium, "-i", name, "--log-level=2"],
+                [allium, "-i", name, *modules(name), "--log-level=2"],
                 stdout=tracefile,
                 stderr=subprocess.STDOUT,
                 timeout=5)
@@ -28,14 +71,170 @@ def run(name):
             pass
         result = subprocess.run([filecheck, name], input=tracefile.read())
 
+    passed = result.returncode == 0
+    if compiled:
+        passed = run_compiled(name) and passed
+
+    tests_run += 1
+    if passed:
+        print("Passed.")
+        tests_passed += 1
+    else:
+        print("Failed.")
+        failed_tests.append(name)
+
+def library(name):
+    """Returns the path of the program on a C driver's `// LIBRARY:` line, or
+    None if it isn't the driver of a library test."""
+    with open(name) as f:
+        for line in f:
+            if line.startswith("// LIBRARY:"):
+                return os.path.join(os.path.dirname(name), line[len("// LIBRARY:"):].strip())
+    return None
+
+def run_library(name):
+    """Compiles a driver's program with `-shared`, builds the driver against
+    the generated header, and checks the driver's output."""
+    global tests_run, tests_passed
+    print("Running library test", name)
+
+    program = library(name)
+    stem = os.path.splitext(os.path.basename(program))[0]
+    passed = False
+    with tempfile.TemporaryDirectory() as tmpdir:
+        shared = os.path.join(tmpdir, f"lib{stem}.so")
+        driver = os.path.join(tmpdir, "driver")
+        built = subprocess.run(
+            [allium, "-shared", "-o", shared, program, *modules(program)]
+        ).returncode == 0 and subprocess.run([
+            cc, "-I", include_dir, "-I", tmpdir, name, "-o", driver,
+            "-L", tmpdir, f"-l{stem}", f"-Wl,-rpath,{tmpdir}",
+            "-L", runtime_dir, "-lAllium", f"-Wl,-rpath,{runtime_dir}",
+        ]).returncode == 0
+        if built:
+            output = run_program([], driver)
+            if output is not None:
+                stdout, returncode = output
+                result = subprocess.run(
+                    [filecheck, name],
+                    input=stdout + f"Exit code: {returncode}".encode('utf8'))
+                passed = result.returncode == 0
+
     tests_run += 1
-    if result.returncode == 0:
+    if passed:
         print("Passed.")
         tests_passed += 1
     else:
         print("Failed.")
         failed_tests.append(name)
 
+def run_program(arguments, program=allium, env=None):
+    """Returns the output and exit code of `program`, which is `allium` by
+    default, with the given arguments and additional environment variables, or
+    None if it times out."""
+    try:
+        exe = subprocess.run(
+            [program, *arguments],
+            stdout=subprocess.PIPE,
+            stderr=subprocess.STDOUT,
+            env={**os.environ, **env} if env else None,
+            timeout=5)
+        return (exe.stdout, exe.returncode)
+    except subprocess.TimeoutExpired:
+        return None
+
+# The flags of each configuration of the compiler in which every program must
+# behave like it does in the interpreter.
+compiler_configurations = [
+    [],
+    ["-fcompact-layout"],
+    ["-O0"],
+    ["-O3"],
+    ["-flto"],
+    ["--threads=4"],
+]
+
+def run_compiled(name):
+    """Checks that the compiled program behaves like the interpreted one in
+    each configuration of the compiler."""
+    interpreted = run_program(["-i", name, *modules(name)])
+    passed = True
+    for flags in compiler_configurations:
+        jitted = run_program(["--jit", *flags, name, *modules(name)])
+        if interpreted != jitted:
+            print("Compiled program differs from the interpreter:")
+            print("\tflags:", " ".join(flags))
+            print("\tinterpreter:", interpreted)
+            print("\tcompiler:", jitted)
+            passed = False
+
+    # A binary trace holds only the events of the proof, so it is only
+    # compared with the text trace of programs which print nothing themselves.
+    if trace_renderer and interpreted is not None and interpreted[0] == b"":
+        passed = run_trace(name) and passed
+    return run_object_cache(name, interpreted) and passed
+
+def run_object_cache(name, interpreted):
+    """Compiles the program twice with an object cache, both with the default
+    number of threads and with four, and checks that the second compilation
+    adds nothing to the cache and still produces an executable which behaves
+    like the interpreter. Programs which don't compile are skipped."""
+    passed = True
+    for flags in [[], ["--threads=4"]]:
+        passed = run_object_cache_with(name, interpreted, flags) and passed
+    return passed
+
+def run_object_cache_with(name, interpreted, flags):
+    with tempfile.TemporaryDirectory() as tmpdir:
+        cache = os.path.join(tmpdir, "cache")
+        executable = os.path.join(tmpdir, "a.out")
+        arguments = [
+            *flags, f"--object-cache={cache}", "-o", executable,
+            name, *modules(name)]
+
+        first = run_program(arguments)
+        if first is not None and first[1] != 0:
+            return True
+        entries = sorted(os.listdir(cache)) if os.path.isdir(cache) else []
+        second = run_program(arguments)
+        cached_entries = sorted(os.listdir(cache)) if os.path.isdir(cache) else []
+        if first is None or not entries or cached_entries != entries:
+            print("Recompiling the program added entries to the object cache:")
+            print("\tflags:", " ".join(flags))
+            print("\tafter the first compilation:", entries)
+            print("\tafter the second compilation:", cached_entries)
+            return False
+
+        executed = second is not None and second[1] == 0 and run_program([], executable)
+        if executed != interpreted:
+            print("Program compiled from the object cache differs from the interpreter:")
+            print("\tflags:", " ".join(flags))
+            print("\tinterpreter:", interpreted)
+            print("\tcompiler:", executed)
+            return False
+    return True
+
+def run_trace(name):
+    """Checks that the binary trace of the compiled program renders as the
+    text trace which it prints at the highest log level."""
+    with tempfile.TemporaryDirectory() as tmpdir:
+        tracefile = os.path.join(tmpdir, "trace")
+        logged = run_program(
+            ["--jit", "-g", name, *modules(name)],
+            env={"ALLIUM_LOG_LEVEL": "3"})
+        traced = run_program(
+            ["--jit", "-g", name, *modules(name)],
+            env={"ALLIUM_TRACE_FILE": tracefile})
+        rendered = None
+        if traced is not None and os.path.exists(tracefile):
+            rendered = run_program([tracefile], trace_renderer)
+        if logged is None or rendered is None or logged[0] != rendered[0]:
+            print("Rendered trace differs from the text trace:")
+            print("\ttext trace:", logged)
+            print("\trendered trace:", rendered)
+            return False
+    return True
+
 if __name__ == "__main__":
     testdir = os.path.dirname(os.path.realpath(__file__))
 
@@ -43,7 +242,12 @@ if __name__ == "__main__":
         for file in files:
             if(file.endswith(".allium")):
                 full_test_path = os.path.normpath(os.path.join(dirpath, file))
-                run(full_test_path)
+                if is_test(full_test_path):
+                    run(full_test_path)
+            elif file.endswith(".c") and compiled and cc and runtime_dir:
+                full_test_path = os.path.normpath(os.path.join(dirpath, file))
+                if library(full_test_path):
+                    run_library(full_test_path)
 
     if failed_tests:
         print("Failing tests:")
@@ -1,6 +1,7 @@
 #include <gtest/gtest.h>
 #include <iostream>
 
+#include "Parser/Modules.h"
 #include "Parser/Parser.h"
 
 using namespace parser;
@@ -225,6 +226,103 @@ TEST(TestParser, lex_peek_beginning) {
     EXPECT_EQ(a, b);
 }
 
+TEST(TestParser, lex_take_after_peek) {
+    std::istringstream f("false;");
+    Lexer lexer(f);
+
+    Token a = lexer.peek_next();
+    Token b = lexer.take_next();
+    Token c = lexer.take_next();
+
+    EXPECT_EQ(a, b);
+    EXPECT_EQ(c, Token(Token::Type::end_of_statement, ";", SourceLocation(1, 5), 5));
+}
+
+TEST(TestParser, lex_rewind) {
+    Lexer lexer("pred p {}");
+
+    Token a = lexer.take_next();
+    lexer.take_next();
+    lexer.rewind(a);
+
+    EXPECT_EQ(lexer.take_next(), a);
+    EXPECT_EQ(lexer.take_next(), Token(Token::Type::identifier, "p", SourceLocation(1, 5), 5));
+}
+
+TEST(TestParser, lex_long_identifier) {
+    Lexer lexer("a_very_long_predicate_name_1234567890(");
+
+    EXPECT_EQ(
+        lexer.take_next(),
+        Token(Token::Type::identifier, "a_very_long_predicate_name_1234567890", SourceLocation(1, 0), 0));
+    EXPECT_TRUE(lexer.take(Token::Type::paren_l));
+}
+
+TEST(TestParser, lex_tracks_lines_through_long_whitespace) {
+    Lexer lexer("\n \n\t\n                   \n    // comment\n\n      true");
+
+    EXPECT_EQ(
+        lexer.take_next(),
+        Token(Token::Type::true_literal, "true", SourceLocation(7, 6), 47));
+}
+
+TEST(TestParser, lex_keyword_with_arguments_as_identifier) {
+    Lexer lexer("in(x) in x");
+
+    EXPECT_EQ(lexer.take_next().type, Token::Type::identifier);
+    lexer.take_next();
+    lexer.take_next();
+    lexer.take_next();
+    EXPECT_EQ(lexer.take_next().type, Token::Type::kw_in);
+}
+
+TEST(TestParser, names_are_interned) {
+    std::string text = "Nat";
+    Name<Type> a(text);
+    Name<Type> b{std::string_view(text)};
+
+    EXPECT_EQ(a, b);
+    EXPECT_EQ(a.symbol(), b.symbol());
+    EXPECT_EQ(std::hash<Name<Type>>()(a), std::hash<Name<Type>>()(b));
+    EXPECT_NE(a, Name<Type>("Nats"));
+
+    // Names are ordered by their text, not by their symbols.
+    EXPECT_LT(Name<Type>("Zero"), Name<Type>("one"));
+    EXPECT_LT(Name<Type>(""), Name<Type>("a"));
+    EXPECT_FALSE(a < b);
+    EXPECT_EQ(Name<Type>().string(), "");
+    EXPECT_EQ(Name<Type>().symbol(), Name<Type>("").symbol());
+}
+
+TEST(TestParser, symbol_tables_share_process_names) {
+    Name<Type> outside("Nat");
+    SymbolTable symbols;
+    {
+        SymbolTable::Scope scope(symbols);
+        EXPECT_EQ(&SymbolTable::current(), &symbols);
+
+        // Names which exist outside of the table, like those of builtins, are
+        // shared with it.
+        EXPECT_EQ(Name<Type>("Nat"), outside);
+
+        std::string text = "Compiled";
+        Name<Type> a(text);
+        EXPECT_EQ(a, Name<Type>(std::string_view(text)));
+        EXPECT_EQ(a.symbol(), symbols.intern("Compiled"));
+        EXPECT_EQ(Name<Type>(), Name<Type>(""));
+    }
+    EXPECT_NE(&SymbolTable::current(), &symbols);
+}
+
+TEST(TestParser, lex_peek_ahead) {
+    Lexer lexer("ctor a;");
+
+    EXPECT_EQ(lexer.peek_ahead(0), lexer.peek_next());
+    EXPECT_EQ(lexer.peek_ahead(1), Token(Token::Type::identifier, "a", SourceLocation(1, 5), 5));
+    EXPECT_EQ(lexer.peek_ahead(5).type, Token::Type::end_of_file);
+    EXPECT_EQ(lexer.take_next().type, Token::Type::kw_ctor);
+}
+
 TEST(TestParser, parse_truth_literal_as_expression) {
     std::istringstream f("false;");
     Parser p(f);
@@ -324,6 +422,27 @@ TEST(TestParser, parse_conjunction_left_associative) {
     );
 }
 
+TEST(TestParser, parse_long_conjunction) {
+    // Each conjunct used to copy the entire expression to its left, which made
+    // parsing long conjunctions quadratic.
+    std::string source = "a";
+    for(int i=0; i<2000; ++i) source += ", a";
+    source += ";";
+    Parser p(source);
+
+    Expression e;
+    std::vector<SyntaxError> errors;
+    ASSERT_TRUE(p.parseExpression().unwrapResultInto(e, errors));
+    EXPECT_TRUE(errors.empty());
+
+    ASSERT_TRUE(e.is_a<Conjunction>());
+    e.as_a<Conjunction>().then([](const Conjunction &conj) {
+        EXPECT_EQ(
+            conj.getRight(),
+            Expression(PredicateRef("a", SourceLocation(1, 6000))));
+    });
+}
+
 TEST(TestParser, parse_implication) {
     std::istringstream f("main <- true;");
     Parser p(f);
@@ -1009,3 +1128,36 @@ TEST(TestParser, parse_effect_handler_with_implications) {
         )
     );
 }
+
+TEST(TestParser, link_concatenates_modules) {
+    Type a(TypeDecl("A", SourceLocation(1, 5)), {});
+    Type b(TypeDecl("B", SourceLocation(1, 5)), {});
+    std::vector<LinkError> errors;
+
+    AST program = link(
+        { AST({ a }, {}, {}), AST({ b }, {}, {}) },
+        { "a.allium", "b.allium" },
+        errors);
+
+    EXPECT_TRUE(errors.empty());
+    EXPECT_EQ(program, AST({ a, b }, {}, {}));
+}
+
+TEST(TestParser, link_type_defined_by_multiple_modules) {
+    Type a(TypeDecl("A", SourceLocation(1, 5)), {});
+    std::vector<LinkError> errors;
+
+    link(
+        { AST({ a }, {}, {}), AST({ a }, {}, {}) },
+        { "a.allium", "b.allium" },
+        errors);
+
+    EXPECT_EQ(
+        errors,
+        std::vector<LinkError>({
+            LinkError(
+                "Type \"A\" was already defined in a.allium at 1:5 and cannot be redefined.",
+                "b.allium",
+                SourceLocation(1, 5))
+        }));
+}
@@ -0,0 +1,165 @@
+#include <gtest/gtest.h>
+#include <sstream>
+
+#include "Interpreter/BuiltinPredicates.h"
+#include "Interpreter/ProgramImage.h"
+
+using namespace interpreter;
+
+class TestProgramImage : public testing::Test {
+public:
+    std::string writeImage(const Program &program, uint64_t sourceHash) {
+        std::ostringstream image;
+        writeProgramImage(program, sourceHash, image);
+        return image.str();
+    }
+
+    // pred p(Nat, String, Int) {
+    //     p(s(let x), "a", 1) <- p(x, "b", 2), concat("a", "b", let y), do print(y);
+    // }
+    // pred main {
+    //     main <- p(_, "a", 1);
+    //     handle IO { do print(let s) <- continue, true; }
+    // }
+    Program program = Program(
+        {
+            Predicate(
+                {
+                    Implication(
+                        PredicateReference(0, {
+                            MatcherValue(MatcherCtorRef(1, { MatcherValue(MatcherVariable(0)) })),
+                            MatcherValue(String("a")),
+                            MatcherValue(Int(1))
+                        }),
+                        Expression(Conjunction(
+                            Expression(Conjunction(
+                                Expression(PredicateReference(0, {
+                                    MatcherValue(MatcherVariable(0)),
+                                    MatcherValue(String("b")),
+                                    MatcherValue(Int(2))
+                                })),
+                                Expression(BuiltinPredicateReference(
+                                    getBuiltinPredicateByName("concat"),
+                                    {
+                                        MatcherValue(String("a")),
+                                        MatcherValue(String("b")),
+                                        MatcherValue(MatcherVariable(1))
+                                    }))
+                            )),
+                            Expression(EffectCtorRef(
+                                0, 0,
+                                { MatcherValue(MatcherVariable(1)) },
+                                TruthValue(true)))
+                        )),
+                        2
+                    )
+                },
+                {}
+            ),
+            Predicate(
+                {
+                    Implication(
+                        PredicateReference(1, {}),
+                        Expression(PredicateReference(0, {
+                            MatcherValue(MatcherVariable(MatcherVariable::anonymousIndex, false)),
+                            MatcherValue(String("a")),
+                            MatcherValue(Int(1))
+                        })),
+                        0
+                    )
+                },
+                {
+                    UserHandler(0, {
+                        EffectImplication(
+                            EffectImplHead(0, 0, { MatcherValue(MatcherVariable(0)) }),
+                            HandlerExpression(HandlerConjunction(
+                                HandlerExpression(Continuation()),
+                                HandlerExpression(TruthValue(true)))),
+                            1
+                        )
+                    })
+                }
+            ),
+        },
+        PredicateReference(1, {}),
+        { "p", "main" }
+    );
+};
+
+TEST_F(TestProgramImage, round_trip) {
+    std::unique_ptr<Program> loaded =
+        readProgramImage(writeImage(program, 42), 42);
+
+    ASSERT_TRUE(loaded);
+    EXPECT_EQ(*loaded, program);
+    EXPECT_EQ(loaded->getPredicate(1).handlers, program.getPredicate(1).handlers);
+    EXPECT_EQ(
+        loaded->asDebugString(PredicateReference(1, {})),
+        program.asDebugString(PredicateReference(1, {})));
+}
+
+TEST_F(TestProgramImage, rejects_image_of_other_sources) {
+    EXPECT_FALSE(readProgramImage(writeImage(program, 42), 43));
+}
+
+TEST_F(TestProgramImage, rejects_truncated_image) {
+    std::string image = writeImage(program, 42);
+    for(size_t size = 0; size < image.size(); ++size) {
+        EXPECT_FALSE(readProgramImage(std::string_view(image).substr(0, size), 42));
+    }
+}
+
+TEST_F(TestProgramImage, rejects_corrupted_image) {
+    std::string image = writeImage(program, 42);
+    for(size_t i = 0; i < image.size(); ++i) {
+        std::string corrupted = image;
+        corrupted[i] ^= 0x40;
+        EXPECT_FALSE(readProgramImage(corrupted, 42));
+    }
+}
+
+TEST_F(TestProgramImage, rejects_out_of_range_indices) {
+    // These images have valid checksums, so only the checks of their indices
+    // can reject them.
+    Program badMain = Program(
+        { program.getPredicate(0), program.getPredicate(1) },
+        PredicateReference(1000000, {}),
+        { "p", "main" });
+    EXPECT_FALSE(readProgramImage(writeImage(badMain, 42), 42));
+
+    Program badVariable = Program(
+        {
+            Predicate(
+                { Implication(PredicateReference(0, { MatcherValue(MatcherVariable(3)) }), TruthValue(true), 1) },
+                {})
+        },
+        PredicateReference(0, { MatcherValue(String("a")) }),
+        { "p" });
+    EXPECT_FALSE(readProgramImage(writeImage(badVariable, 42), 42));
+
+    // IO has a single constructor, print, which has a single argument.
+    for(auto [ctor, arguments] : { std::pair<size_t, size_t>(1, 1), { 0, 2 } }) {
+        Program badEffect = Program(
+            {
+                Predicate(
+                    {
+                        Implication(
+                            PredicateReference(0, {}),
+                            Expression(EffectCtorRef(
+                                0, ctor,
+                                std::vector<MatcherValue>(arguments, MatcherValue(String("a"))),
+                                TruthValue(true))),
+                            0)
+                    },
+                    {})
+            },
+            PredicateReference(0, {}),
+            { "main" });
+        EXPECT_FALSE(readProgramImage(writeImage(badEffect, 42), 42));
+    }
+}
+
+TEST(TestProgramImageHash, hash_depends_on_module_boundaries) {
+    EXPECT_EQ(hashSources({ "ab", "c" }), hashSources({ "ab", "c" }));
+    EXPECT_NE(hashSources({ "ab", "c" }), hashSources({ "a", "bc" }));
+}
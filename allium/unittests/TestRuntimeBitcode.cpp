@@ -0,0 +1,141 @@
+#include <gtest/gtest.h>
+
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/ExecutionEngine/Orc/LLJIT.h>
+#include <llvm/Support/TargetSelect.h>
+
+#include <cstdint>
+#include <vector>
+
+using namespace llvm;
+
+// The bitcode of libAllium.ll, which is embedded in the code generator.
+extern const unsigned char alliumRuntimeBitcode[];
+extern const size_t alliumRuntimeBitcodeSize;
+
+// The out-of-line versions of the helpers in libAllium.c.
+extern "C" {
+void *__allium_get_value(void *value);
+void *__allium_get_tagged_word_value(void *value);
+void __allium_trail_push(void *value);
+size_t __allium_trail_mark();
+void __allium_trail_undo(size_t mark);
+extern void **__allium_trail;
+}
+
+/// Mirrors value_t in libAllium.c.
+struct RuntimeValue {
+    char tag;
+    void *payload;
+};
+
+enum { UNBOUND = 0, VARIABLE = 1, BUILTIN_VALUE = 2 };
+
+/// Compiles the helpers in libAllium.ll with a JIT, so that they can be run
+/// against the same values and trail as their versions in libAllium.c. The
+/// helpers are renamed with an ".ir" suffix and given external linkage, since
+/// they are available_externally, and the trail is resolved to the runtime
+/// library's.
+class TestRuntimeBitcode : public testing::Test {
+protected:
+    static void SetUpTestSuite() {
+        ExitOnError exitOnError("TestRuntimeBitcode: ");
+        InitializeNativeTarget();
+        InitializeNativeTargetAsmPrinter();
+
+        jit = exitOnError(orc::LLJITBuilder().create()).release();
+        jit->getMainJITDylib().addGenerator(exitOnError(
+            orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(
+                jit->getDataLayout().getGlobalPrefix())));
+
+        auto ctx = std::make_unique<LLVMContext>();
+        std::unique_ptr<Module> runtime = exitOnError(parseBitcodeFile(
+            MemoryBufferRef(
+                StringRef(
+                    reinterpret_cast<const char*>(alliumRuntimeBitcode),
+                    alliumRuntimeBitcodeSize),
+                "libAllium.bc"),
+            *ctx));
+        runtime->setDataLayout(jit->getDataLayout());
+        runtime->setTargetTriple(jit->getTargetTriple().str());
+        for(Function &func : *runtime) {
+            if(!func.isDeclaration()) {
+                func.setName(func.getName() + ".ir");
+                func.setLinkage(GlobalValue::ExternalLinkage);
+            }
+        }
+        exitOnError(jit->addIRModule(
+            orc::ThreadSafeModule(std::move(runtime), std::move(ctx))));
+    }
+
+    template <typename Func>
+    static Func *lookup(const char *name) {
+        ExitOnError exitOnError("TestRuntimeBitcode: ");
+        JITEvaluatedSymbol symbol = exitOnError(jit->lookup(std::string(name) + ".ir"));
+        return reinterpret_cast<Func*>(symbol.getAddress());
+    }
+
+    // The JIT is kept for the rest of the process, like that of --jit.
+    static orc::LLJIT *jit;
+};
+
+orc::LLJIT *TestRuntimeBitcode::jit = nullptr;
+
+TEST_F(TestRuntimeBitcode, get_value) {
+    auto getValue = lookup<void *(void*)>("__allium_get_value");
+
+    RuntimeValue unbound { UNBOUND, nullptr };
+    RuntimeValue builtin { BUILTIN_VALUE, reinterpret_cast<void*>(42) };
+    RuntimeValue toUnbound { VARIABLE, &unbound };
+    RuntimeValue toBuiltin { VARIABLE, &builtin };
+    RuntimeValue chain { VARIABLE, &toBuiltin };
+
+    for(RuntimeValue *value : { &unbound, &builtin, &toUnbound, &toBuiltin, &chain }) {
+        EXPECT_EQ(getValue(value), __allium_get_value(value));
+    }
+    EXPECT_EQ(getValue(&chain), &builtin);
+    EXPECT_EQ(getValue(&toUnbound), &unbound);
+}
+
+TEST_F(TestRuntimeBitcode, get_tagged_word_value) {
+    auto getValue = lookup<void *(void*)>("__allium_get_tagged_word_value");
+
+    uintptr_t unbound = 0;
+    uintptr_t constructor = 5;
+    uintptr_t toUnbound = reinterpret_cast<uintptr_t>(&unbound);
+    uintptr_t toConstructor = reinterpret_cast<uintptr_t>(&constructor);
+    uintptr_t chain = reinterpret_cast<uintptr_t>(&toConstructor);
+
+    for(uintptr_t *word : { &unbound, &constructor, &toUnbound, &toConstructor, &chain }) {
+        EXPECT_EQ(getValue(word), __allium_get_tagged_word_value(word));
+    }
+    EXPECT_EQ(getValue(&chain), &constructor);
+    EXPECT_EQ(getValue(&toUnbound), &unbound);
+}
+
+TEST_F(TestRuntimeBitcode, trail) {
+    auto push = lookup<void(void*)>("__allium_trail_push");
+    auto mark = lookup<size_t()>("__allium_trail_mark");
+
+    size_t start = __allium_trail_mark();
+    EXPECT_EQ(mark(), start);
+
+    // Enough pushes by both versions to grow the trail several times.
+    std::vector<RuntimeValue> values(5000, RuntimeValue { BUILTIN_VALUE, nullptr });
+    for(size_t i = 0; i < values.size(); ++i) {
+        if(i % 3 == 0) {
+            push(&values[i]);
+        } else {
+            __allium_trail_push(&values[i]);
+        }
+        EXPECT_EQ(mark(), __allium_trail_mark());
+        EXPECT_EQ(mark(), start + i + 1);
+    }
+    for(size_t i = 0; i < values.size(); ++i) {
+        EXPECT_EQ(__allium_trail[start + i], &values[i]);
+    }
+
+    __allium_trail_undo(start);
+    EXPECT_EQ(mark(), start);
+    EXPECT_EQ(values[0].tag, UNBOUND);
+}